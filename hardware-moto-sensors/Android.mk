@@ -80,6 +80,10 @@ ifeq ($(BOARD_USES_MOT_SENSOR_HUB), true)
 
         ifeq ($(MOT_SENSOR_HUB_HW_AK09912), true)
             SH_CFLAGS += -D_ENABLE_MAGNETOMETER
+            ifeq ($(MOT_SENSOR_HUB_FEATURE_AKM_INPROC), true)
+                # Run the AKM compass inside the sensor HAL, not in akmd09912
+                SH_CFLAGS += -D_ENABLE_AKM_INPROC
+            endif
         endif
 
         ##########################
@@ -110,6 +114,10 @@ ifeq ($(BOARD_USES_MOT_SENSOR_HUB), true)
         ifeq ($(MOT_SENSOR_HUB_FEATURE_ULTRASOUND), true)
             SH_CFLAGS += -D_ENABLE_ULTRASOUND
         endif
+        ifeq ($(MOT_SENSOR_HUB_FEATURE_HUB_FUSION), true)
+            # Needs hub firmware and a kernel with the quaternion records
+            SH_CFLAGS += -D_ENABLE_HUB_FUSION
+        endif
 
         ######################
         # Sensors HAL module #
@@ -137,12 +145,44 @@ ifeq ($(BOARD_USES_MOT_SENSOR_HUB), true)
                 LOCAL_SRC_FILES += \
                     $(SH_PATH)/GeoMagRotationVector.cpp \
                     $(SH_PATH)/RotationVector.cpp
+                ifeq ($(MOT_SENSOR_HUB_FEATURE_AKM_INPROC), true)
+                    # The akmd measurement loop, minus its main(). The HAL
+                    # feeds it the hub accel and takes the results directly.
+                    HAL_AKM_PATH := ak09912_akmd_6D_32b
+                    LOCAL_SRC_FILES += \
+                        $(HAL_AKM_PATH)/AKMD_Driver.c \
+                        $(HAL_AKM_PATH)/Checkpoint.c \
+                        $(HAL_AKM_PATH)/DispMessage.c \
+                        $(HAL_AKM_PATH)/FileIO.c \
+                        $(HAL_AKM_PATH)/Measure.c \
+                        $(HAL_AKM_PATH)/misc.c \
+                        $(HAL_AKM_PATH)/Acc_hal.c \
+                        $(HAL_AKM_PATH)/Hosted.c
+                    LOCAL_C_INCLUDES += \
+                        $(LOCAL_PATH)/$(HAL_AKM_PATH) \
+                        $(LOCAL_PATH)/$(HAL_AKM_PATH)/libSmartCompass
+                    LOCAL_CFLAGS += -DAKMD_FOR_AK09912
+                    LOCAL_CFLAGS += -DAKMD_AK099XX
+                    LOCAL_CFLAGS += -DAKMD_ACC_HAL
+                    LOCAL_STATIC_LIBRARIES += AK09912
+                else
+                    # Starts the akmd09912 daemon
+                    LOCAL_REQUIRED_MODULES += init.ecompass.rc
+                endif
+            endif
+            ifeq ($(MOT_SENSOR_HUB_FEATURE_HUB_FUSION), true)
+                # Hub firmware capability probe for hub-side fusion
+                LOCAL_CFLAGS += -DMODULE_$(SH_MODULE)
+                LOCAL_SHARED_LIBRARIES += libsensorhub
             endif
-
         endif
 
         ifeq ($(MOT_SENSOR_HUB_HW_TYPE_L4), true)
             LOCAL_REQUIRED_MODULES += sensors.iio
+            ifneq (,$(filter userdebug eng,$(TARGET_BUILD_VARIANT)))
+                # IR raw data bulk channel (see _ENABLE_RAW_IR_DATA)
+                LOCAL_SRC_FILES += $(SH_PATH)/IrRawStream.cpp
+            endif
         endif
 
         ifeq ($(MOT_AP_SENSOR_HW_REARPROX), true)
@@ -164,6 +204,8 @@ ifeq ($(BOARD_USES_MOT_SENSOR_HUB), true)
             $(SH_PATH)/SensorsPollContext.cpp
 
         LOCAL_C_INCLUDES += $(LOCAL_PATH)/$(SH_PATH)
+        # Shared headers (Endian.hpp, SensorHub.hpp)
+        LOCAL_C_INCLUDES += $(LOCAL_PATH)/libsensorhub
         LOCAL_C_INCLUDES += external/zlib
 
         LOCAL_C_INCLUDES += $(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr/include \
@@ -188,6 +230,49 @@ ifeq ($(BOARD_USES_MOT_SENSOR_HUB), true)
 
         include $(BUILD_SHARED_LIBRARY)
 
+        ifeq ($(MOT_SENSOR_HUB_HW_TYPE_L4), true)
+            # The on-change deadband
+            include $(CLEAR_VARS)
+            LOCAL_MODULE := motosh_hal_tests
+            LOCAL_MODULE_TAGS := optional
+            LOCAL_PROPRIETARY_MODULE := true
+            LOCAL_CFLAGS += -Wall -Wextra
+            LOCAL_SRC_FILES := $(SH_PATH)/tests/Deadband_test.cpp
+            LOCAL_C_INCLUDES := $(LOCAL_PATH)/$(SH_PATH)
+            include $(BUILD_NATIVE_TEST)
+        endif
+
+        ifeq ($(MOT_SENSOR_HUB_HW_TYPE_L0), true)
+            ifeq ($(MOT_SENSOR_HUB_FEATURE_HUB_FUSION), true)
+                ##########################################
+                # AP vs hub fusion cost on recorded data #
+                ##########################################
+                include $(CLEAR_VARS)
+                LOCAL_MODULE := stml0xx_fusion_bench
+                LOCAL_MODULE_TAGS := optional
+                LOCAL_CFLAGS := -DLOG_TAG=\"MotoSensors\"
+                LOCAL_CFLAGS += $(SH_CFLAGS) -DMODULE_$(SH_MODULE)
+                LOCAL_CFLAGS += -Wall -Wextra
+                LOCAL_SRC_FILES := \
+                    $(SH_PATH)/FusionBench.cpp \
+                    $(SH_PATH)/Quaternion.cpp \
+                    $(SH_PATH)/GyroIntegration.cpp \
+                    $(SH_PATH)/GameRotationVector.cpp \
+                    $(SH_PATH)/GeoMagRotationVector.cpp \
+                    $(SH_PATH)/RotationVector.cpp
+                LOCAL_C_INCLUDES += \
+                    $(LOCAL_PATH)/$(SH_PATH) \
+                    $(LOCAL_PATH)/libsensorhub \
+                    external/zlib \
+                    $(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr/include \
+                    system/core/base/include
+                LOCAL_ADDITIONAL_DEPENDENCIES := $(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr
+                LOCAL_SHARED_LIBRARIES := liblog libcutils libz
+                LOCAL_PROPRIETARY_MODULE := true
+                include $(BUILD_EXECUTABLE)
+            endif
+        endif
+
     endif # !TARGET_SIMULATOR
 
     #########################
@@ -233,28 +318,53 @@ ifeq ($(BOARD_USES_MOT_SENSOR_HUB), true)
 
     LOCAL_SRC_FILES := \
         motosh_bin/motosh.cpp \
+        motosh_bin/BootFlasher.cpp \
+        motosh_bin/BootReport.cpp \
+        motosh_bin/FirmwareCache.cpp \
+        motosh_bin/FirmwareImage.cpp \
+        motosh_bin/FlashPipeline.cpp \
         motosh_bin/CRC32.c
-    LOCAL_REQUIRED_MODULES += sensorhub-blacklist.txt
+    LOCAL_REQUIRED_MODULES += sensorhub-blacklist.bin
 
 
     LOCAL_C_INCLUDES := \
         $(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr/include \
-        hardware/moto/sensors/libsensorhub
+        $(LOCAL_PATH)/libsensorhub
 
     # Need the UAPI output directory to be populated with motosh.h/stml0xx.h
     LOCAL_ADDITIONAL_DEPENDENCIES := $(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr
 
     include $(BUILD_EXECUTABLE)
 
+    # The boot download and its report, against a fake hub
+    include $(CLEAR_VARS)
+    LOCAL_MODULE := motosh_tests
+    LOCAL_MODULE_TAGS := optional
+    LOCAL_PROPRIETARY_MODULE := true
+    LOCAL_CFLAGS += -Wall -Wextra
+    LOCAL_CXXFLAGS += -Weffc++
+    LOCAL_SHARED_LIBRARIES := libcutils liblog
+    LOCAL_SRC_FILES := \
+        motosh_bin/tests/BootFlasher_test.cpp \
+        motosh_bin/BootFlasher.cpp \
+        motosh_bin/BootReport.cpp \
+        motosh_bin/FirmwareImage.cpp \
+        motosh_bin/CRC32.c
+    LOCAL_C_INCLUDES := $(LOCAL_PATH)/motosh_bin
+    include $(BUILD_NATIVE_TEST)
+
     #########################
     # AKM executable        #
     #########################
     ifeq ($(MOT_SENSOR_HUB_HW_AK09912), true)
-        include $(CLEAR_VARS)
-
         AKM_PATH := ak09912_akmd_6D_32b
         SMARTCOMPASS_LIB := libSmartCompass
 
+      # With MOT_SENSOR_HUB_FEATURE_AKM_INPROC the HAL runs the compass and
+      # the daemon must not be started, it would fight over /dev/akm09912.
+      ifneq ($(MOT_SENSOR_HUB_FEATURE_AKM_INPROC), true)
+        include $(CLEAR_VARS)
+
         LOCAL_MODULE_TAGS := optional
 
         LOCAL_MODULE  := akmd09912
@@ -263,10 +373,12 @@ ifeq ($(BOARD_USES_MOT_SENSOR_HUB), true)
             $(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr/include \
             $(LOCAL_PATH)/$(AKM_PATH) \
             $(LOCAL_PATH)/$(AKM_PATH)/$(SMARTCOMPASS_LIB) \
-            $(LOCAL_PATH)/$(SH_PATH)
+            $(LOCAL_PATH)/$(SH_PATH) \
+            external/zlib
 
         LOCAL_SRC_FILES := \
             $(AKM_PATH)/AKMD_Driver.c \
+            $(AKM_PATH)/Checkpoint.c \
             $(AKM_PATH)/DispMessage.c \
             $(AKM_PATH)/FileIO.c \
             $(AKM_PATH)/Measure.c \
@@ -286,10 +398,70 @@ ifeq ($(BOARD_USES_MOT_SENSOR_HUB), true)
         LOCAL_STATIC_LIBRARIES := AK09912
 
         LOCAL_FORCE_STATIC_EXECUTABLE := false
-        LOCAL_SHARED_LIBRARIES := libc libm libutils libcutils liblog
+        LOCAL_SHARED_LIBRARIES := libc libm libutils libcutils liblog libz
 
         include $(BUILD_EXECUTABLE)
 
+        # Replays an "akmd09912 -r" recording through the measurement code
+        # and reports its CPU cost and latency. No device is needed.
+        include $(CLEAR_VARS)
+        LOCAL_MODULE := akmd09912_replay
+        LOCAL_MODULE_TAGS := optional
+        LOCAL_C_INCLUDES := \
+            $(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr/include \
+            $(LOCAL_PATH)/$(AKM_PATH) \
+            $(LOCAL_PATH)/$(AKM_PATH)/$(SMARTCOMPASS_LIB) \
+            $(LOCAL_PATH)/$(SH_PATH) \
+            external/zlib
+        LOCAL_SRC_FILES := \
+            $(AKM_PATH)/Bench.c \
+            $(AKM_PATH)/Checkpoint.c \
+            $(AKM_PATH)/DispMessage.c \
+            $(AKM_PATH)/FileIO.c \
+            $(AKM_PATH)/Measure.c \
+            $(AKM_PATH)/misc.c \
+            $(AKM_PATH)/Replay.c
+        LOCAL_CFLAGS := -DAKMD_FOR_AK09912
+        LOCAL_CFLAGS += -DAKMD_AK099XX
+        LOCAL_CFLAGS += -Wall -Wextra
+        LOCAL_CFLAGS += $(SH_CFLAGS)
+        LOCAL_CFLAGS += -Wno-gnu-designator -Wno-writable-strings
+        LOCAL_STATIC_LIBRARIES := AK09912
+        LOCAL_SHARED_LIBRARIES := libc libm libutils libcutils liblog libz
+        include $(BUILD_EXECUTABLE)
+      endif # !MOT_SENSOR_HUB_FEATURE_AKM_INPROC
+
+        # The in-process compass start and stop, against a fake device
+        include $(CLEAR_VARS)
+        LOCAL_MODULE := akmd09912_tests
+        LOCAL_MODULE_TAGS := optional
+        LOCAL_C_INCLUDES := \
+            $(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr/include \
+            $(LOCAL_PATH)/$(AKM_PATH) \
+            $(LOCAL_PATH)/$(AKM_PATH)/$(SMARTCOMPASS_LIB) \
+            $(LOCAL_PATH)/$(AKM_PATH)/tests \
+            external/zlib
+        LOCAL_SRC_FILES := \
+            $(AKM_PATH)/tests/Hosted_test.cpp \
+            $(AKM_PATH)/tests/FakeEcs.c \
+            $(AKM_PATH)/Checkpoint.c \
+            $(AKM_PATH)/DispMessage.c \
+            $(AKM_PATH)/FileIO.c \
+            $(AKM_PATH)/Hosted.c \
+            $(AKM_PATH)/Measure.c \
+            $(AKM_PATH)/misc.c
+        LOCAL_CFLAGS := -DAKMD_FOR_AK09912
+        LOCAL_CFLAGS += -DAKMD_AK099XX
+        LOCAL_CFLAGS += -DAKMD_ACC_HAL
+        # Keep the calibration of the device out of the way
+        LOCAL_CFLAGS += -DCSPEC_DATA_DIR=\"/data/local/tmp\"
+        LOCAL_CFLAGS += -Wall -Wextra
+        LOCAL_CFLAGS += -Wno-gnu-designator -Wno-writable-strings
+        LOCAL_STATIC_LIBRARIES := AK09912
+        LOCAL_SHARED_LIBRARIES := libcutils liblog libz
+        LOCAL_ADDITIONAL_DEPENDENCIES := $(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr
+        include $(BUILD_NATIVE_TEST)
+
         include $(CLEAR_VARS)
         LOCAL_MODULE        := AK09912
         LOCAL_MODULE_TAGS   := optional
@@ -328,13 +500,28 @@ ifeq ($(BOARD_USES_MOT_SENSOR_HUB), true)
     endif
 
     # ** Firmware BlackList **********************************************************
+    # The text list is compiled into a sorted CRC table (see BlackList.h) so
+    # that motosh can map and binary search it.
     include $(CLEAR_VARS)
-    LOCAL_MODULE        := sensorhub-blacklist.txt
+    LOCAL_MODULE        := sensorhub-blacklist-gen
+    LOCAL_MODULE_TAGS   := optional
+    LOCAL_SRC_FILES     := motosh_bin/blacklist_gen.c
+    LOCAL_CFLAGS        += -Wall -Wextra
+    include $(BUILD_HOST_EXECUTABLE)
+
+    include $(CLEAR_VARS)
+    LOCAL_MODULE        := sensorhub-blacklist.bin
     LOCAL_MODULE_TAGS   := optional
     LOCAL_MODULE_CLASS  := ETC
     LOCAL_MODULE_PATH   := $(TARGET_OUT)/etc/firmware
-    LOCAL_SRC_FILES     := motosh_bin/sensorhub-blacklist.txt
-    include $(BUILD_PREBUILT)
+    include $(BUILD_SYSTEM)/base_rules.mk
+    BLACKLIST_GEN := $(HOST_OUT_EXECUTABLES)/sensorhub-blacklist-gen$(HOST_EXECUTABLE_SUFFIX)
+    $(LOCAL_BUILT_MODULE): PRIVATE_BLACKLIST_GEN := $(BLACKLIST_GEN)
+    $(LOCAL_BUILT_MODULE): $(LOCAL_PATH)/motosh_bin/sensorhub-blacklist.txt $(BLACKLIST_GEN)
+    # WARNING - the below lines must be indented with a TAB, not spaces
+		@echo "Blacklist: $@"
+		@mkdir -p $(dir $@)
+		$(hide) $(PRIVATE_BLACKLIST_GEN) $< $@
     # ********************************************************************************
 
 else # For non sensorhub version of sensors
@@ -37,6 +37,7 @@
 
 /* Definition for operation mode */
 #define OPMODE_CONSOLE      (0x01)
+#define OPMODE_REPLAY       (0x02)	/*!< Replaying a recording, see Replay.h */
 
 /*** Type declaration *********************************************************/
 
@@ -22,11 +22,23 @@
  *
  ******************************************************************************/
 #include <fcntl.h>
+#include <sys/eventfd.h>
 #include "AKCommon.h"		// DBGPRINT()
 #include "AKMD_Driver.h"
+#include "Replay.h"
 
 #define AKM_MEASURE_RETRY_NUM	3
 int s_fdDev = -1;
+/*! Raised by AKD_NotifyDelay(), see AKD_GetDelayEventFd() */
+static int s_fdDelay = -1;
+
+/* Recording, see AKD_StartRecord() */
+static FILE* s_recFile = NULL;
+static REPLAY_HEADER s_recHeader;
+static REPLAY_RECORD s_recRecord;
+static int s_recStarted;	/*!< Header written */
+static int s_recPending;	/*!< s_recRecord holds a magnetic sample */
+static int64_t s_recDelay[AKM_NUM_SENSORS];
 
 /* Include proper acceleration file. */
 #ifdef AKMD_ACC_EXTERNAL
@@ -36,10 +48,22 @@ static ACCFNC_DEINITDEVICE Acc_DeinitDevice = AOT_DeinitDevice;
 static ACCFNC_SET_ENABLE Acc_SetEnable		= AOT_SetEnable;
 static ACCFNC_SET_DELAY Acc_SetDelay		= AOT_SetDelay;
 static ACCFNC_GETACCDATA Acc_GetAccData		= AOT_GetAccData;
+static ACCFNC_GETACCDATA_AT Acc_GetAccDataAt	= NULL;
 static ACCFNC_GETACCOFFSET Acc_GetAccOffset	= AOT_GetAccOffset;
 static ACCFNC_GETACCVEC Acc_GetAccVector	= AOT_GetAccVector;
 
 #else
+#ifdef AKMD_ACC_HAL
+#include "Acc_hal.h"
+static ACCFNC_INITDEVICE Acc_InitDevice		= ACCHAL_InitDevice;
+static ACCFNC_DEINITDEVICE Acc_DeinitDevice = ACCHAL_DeinitDevice;
+static ACCFNC_SET_ENABLE Acc_SetEnable		= ACCHAL_SetEnable;
+static ACCFNC_SET_DELAY Acc_SetDelay		= ACCHAL_SetDelay;
+static ACCFNC_GETACCDATA Acc_GetAccData		= ACCHAL_GetAccData;
+static ACCFNC_GETACCDATA_AT Acc_GetAccDataAt	= ACCHAL_GetAccDataAt;
+static ACCFNC_GETACCOFFSET Acc_GetAccOffset	= ACCHAL_GetAccOffset;
+static ACCFNC_GETACCVEC Acc_GetAccVector	= ACCHAL_GetAccVector;
+#endif
 #ifdef AKMD_ACC_ADXL346
 #include "Acc_adxl34x.h"
 static ACCFNC_INITDEVICE Acc_InitDevice		= ADXL_InitDevice;
@@ -47,6 +71,7 @@ static ACCFNC_DEINITDEVICE Acc_DeinitDevice = ADXL_DeinitDevice;
 static ACCFNC_SET_ENABLE Acc_SetEnable		= ADXL_SetEnable;
 static ACCFNC_SET_DELAY Acc_SetDelay		= ADXL_SetDelay;
 static ACCFNC_GETACCDATA Acc_GetAccData		= ADXL_GetAccData;
+static ACCFNC_GETACCDATA_AT Acc_GetAccDataAt	= NULL;
 static ACCFNC_GETACCOFFSET Acc_GetAccOffset	= ADXL_GetAccOffset;
 static ACCFNC_GETACCVEC Acc_GetAccVector	= ADXL_GetAccVector;
 #endif
@@ -57,6 +82,7 @@ static ACCFNC_DEINITDEVICE Acc_DeinitDevice = KXTF9_DeinitDevice;
 static ACCFNC_SET_ENABLE Acc_SetEnable		= KXTF9_SetEnable;
 static ACCFNC_SET_DELAY Acc_SetDelay		= KXTF9_SetDelay;
 static ACCFNC_GETACCDATA Acc_GetAccData		= KXTF9_GetAccData;
+static ACCFNC_GETACCDATA_AT Acc_GetAccDataAt	= NULL;
 static ACCFNC_GETACCOFFSET Acc_GetAccOffset	= KXTF9_GetAccOffset;
 static ACCFNC_GETACCVEC Acc_GetAccVector	= KXTF9_GetAccVector;
 #endif
@@ -67,11 +93,52 @@ static ACCFNC_DEINITDEVICE Acc_DeinitDevice	= ACC_DUMMY_DeinitDevice;
 static ACCFNC_SET_ENABLE Acc_SetEnable		= ACC_DUMMY_SetEnable;
 static ACCFNC_SET_DELAY  Acc_SetDelay		= ACC_DUMMY_SetDelay;
 static ACCFNC_GETACCDATA Acc_GetAccData		= ACC_DUMMY_GetAccData;
+static ACCFNC_GETACCDATA_AT Acc_GetAccDataAt	= NULL;
 static ACCFNC_GETACCOFFSET Acc_GetAccOffset	= ACC_DUMMY_GetAccOffset;
 static ACCFNC_GETACCVEC Acc_GetAccVector	= ACC_DUMMY_GetAccVector;
 #endif
 #endif
 
+/*!
+ Write a record to the recording. Recording stops on error.
+ */
+static void recordWrite(const void* data, size_t size)
+{
+	if (fwrite(data, size, 1, s_recFile) != 1) {
+		AKMERROR_STR("fwrite");
+		fclose(s_recFile);
+		s_recFile = NULL;
+	}
+}
+
+/*!
+ Add a magnetic sample to the recording. The previous sample is written
+ first, with the latest acceleration which was read after it.
+ */
+static void recordMag(const BYTE data[AKM_SENSOR_DATA_SIZE + AKM_SENSOR_TIME_SIZE])
+{
+	if (s_recFile == NULL) {
+		return;
+	}
+	if (!s_recStarted) {
+		/* The delays are known once the measurement has started */
+		memcpy(s_recHeader.delay, s_recDelay, sizeof(s_recHeader.delay));
+		recordWrite(&s_recHeader, sizeof(s_recHeader));
+		s_recStarted = AKD_TRUE;
+	} else if (s_recPending) {
+		recordWrite(&s_recRecord, sizeof(s_recRecord));
+	}
+	memcpy(s_recRecord.mag, data, sizeof(s_recRecord.mag));
+	s_recPending = AKD_TRUE;
+}
+
+static void recordAcc(const int16_t data[3])
+{
+	if (s_recFile != NULL) {
+		memcpy(s_recRecord.acc, data, sizeof(s_recRecord.acc));
+	}
+}
+
 /*!
  Open device driver.
  This function opens both device drivers of magnetic sensor and acceleration
@@ -333,6 +400,8 @@ int16_t AKD_GetMagneticData(BYTE data[AKM_SENSOR_DATA_SIZE + AKM_SENSOR_TIME_SIZ
 	}
 #endif
 
+	recordMag(data);
+
 	AKMDEBUG(AKMDBG_MAGDRV,
 			"bdata(HEX)= %02x %02x %02x %02x %02x %02x %02x %02x %02x | %02x %02x %02x %02x %02x %02x %02x %02x\n",
 			data[0], data[1], data[2], data[3], data[4], data[5], data[6], data[7], data[8],
@@ -422,9 +491,54 @@ int16_t AKD_GetDelay(int64_t delay[AKM_NUM_SENSORS])
 		AKMERROR_STR("ioctl");
 		return AKD_FAIL;
 	}
+	memcpy(s_recDelay, delay, sizeof(s_recDelay));
 	return AKD_SUCCESS;
 }
 
+/*!
+ Promise to call AKD_NotifyDelay() whenever a requested delay changes, so
+ that the measurement loop doesn't have to poll the delays. The driver
+ doesn't notify the changes itself, so only a host which makes them, in the
+ same process, can do this.
+ @return If this function succeeds, the return value is #AKD_SUCCESS.
+ Otherwise the return value is #AKD_FAIL, and the delays are still polled.
+ */
+int16_t AKD_InitDelayEvent(void)
+{
+	if (s_fdDelay < 0) {
+		s_fdDelay = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (s_fdDelay < 0) {
+			AKMERROR_STR("eventfd");
+			return AKD_FAIL;
+		}
+	}
+	return AKD_SUCCESS;
+}
+
+/*!
+ Get a file descriptor to wait for delay changes on. It becomes readable
+ when AKD_NotifyDelay() is called, and stays so until it is read.
+ @return The eventfd, or -1 if the delay changes are not notified, see
+ AKD_InitDelayEvent().
+ */
+int AKD_GetDelayEventFd(void)
+{
+	return s_fdDelay;
+}
+
+/*!
+ Tell the measurement loop that the requested delays have changed.
+ This function is async-signal-safe.
+ */
+void AKD_NotifyDelay(void)
+{
+	uint64_t one = 1;
+
+	if (s_fdDelay >= 0) {
+		write(s_fdDelay, &one, sizeof(one));
+	}
+}
+
 /*!
  Get layout information from device driver, i.e. platform data.
  */
@@ -460,7 +574,33 @@ int16_t AKD_AccSetDelay(int64_t delay)
 /*!  */
 int16_t AKD_GetAccelerationData(int16_t data[3])
 {
-	return Acc_GetAccData(data);
+	int16_t ret = Acc_GetAccData(data);
+
+	if (ret == AKD_SUCCESS) {
+		recordAcc(data);
+	}
+	return ret;
+}
+
+/*!
+ Get the acceleration at the time of a magnetic measurement. Sources without
+ timestamped samples return their latest data instead.
+ @param[in] time Timestamp of the magnetic data in nano second.
+ @param[out] data Acceleration data.
+ */
+int16_t AKD_GetAccelerationDataAt(int64_t time, int16_t data[3])
+{
+	int16_t ret;
+
+	if (Acc_GetAccDataAt == NULL) {
+		ret = Acc_GetAccData(data);
+	} else {
+		ret = Acc_GetAccDataAt(time, data);
+	}
+	if (ret == AKD_SUCCESS) {
+		recordAcc(data);
+	}
+	return ret;
 }
 
 /*!  */
@@ -500,3 +640,52 @@ int16_t AKD_WaitReady(void)
 
 	return AKD_SUCCESS;
 }
+
+/*!
+ Record the raw magnetic and acceleration data to \a path, for replay with
+ Replay.c. The device must be open. See Replay.h for the format.
+ @return If this function succeeds, the return value is #AKD_SUCCESS. Otherwise
+ the return value is #AKD_FAIL.
+ @param[in] path The recording, replaced if it exists.
+ */
+int16_t AKD_StartRecord(const char* path)
+{
+	AKD_StopRecord();
+
+	memset(&s_recHeader, 0, sizeof(s_recHeader));
+	memset(&s_recRecord, 0, sizeof(s_recRecord));
+	memcpy(s_recHeader.magic, REPLAY_MAGIC, sizeof(s_recHeader.magic));
+	s_recHeader.version = REPLAY_VERSION;
+	if ((AKD_GetLayout(&s_recHeader.layout) != AKD_SUCCESS) ||
+		(AKD_GetSensorInfo(s_recHeader.info) != AKD_SUCCESS) ||
+		(AKD_GetSensorConf(s_recHeader.conf) != AKD_SUCCESS)) {
+		AKMERROR;
+		return AKD_FAIL;
+	}
+
+	if ((s_recFile = fopen(path, "wb")) == NULL) {
+		AKMERROR_STR("fopen");
+		return AKD_FAIL;
+	}
+	s_recStarted = AKD_FALSE;
+	s_recPending = AKD_FALSE;
+	return AKD_SUCCESS;
+}
+
+/*!
+ Write the last sample and close the recording.
+ */
+void AKD_StopRecord(void)
+{
+	if (s_recFile == NULL) {
+		return;
+	}
+	if (s_recPending) {
+		recordWrite(&s_recRecord, sizeof(s_recRecord));
+		s_recPending = AKD_FALSE;
+	}
+	if ((s_recFile != NULL) && (fclose(s_recFile) != 0)) {
+		AKMERROR_STR("fclose");
+	}
+	s_recFile = NULL;
+}
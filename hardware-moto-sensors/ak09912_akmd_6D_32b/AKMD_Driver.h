@@ -44,6 +44,23 @@
 /*! Typical interval in ns */
 #define AKM_MEASUREMENT_TIME_NS	((AKM_MEASURE_TIME_US) * 1000)
 
+/*! AK09912 continuous measurement modes. They are used only when the driver
+ defines them, i.e. when it lets the daemon choose the measurement rate.
+ Otherwise the driver measures the device on its own. */
+#ifdef AKM_MODE_CONT1_MEASURE
+#define AKMD_CONT_MEASURE	1
+#else
+#define AKMD_CONT_MEASURE	0
+#define AKM_MODE_CONT1_MEASURE	0x02	/*!< 10Hz */
+#define AKM_MODE_CONT2_MEASURE	0x04	/*!< 20Hz */
+#define AKM_MODE_CONT3_MEASURE	0x06	/*!< 50Hz */
+#define AKM_MODE_CONT4_MEASURE	0x08	/*!< 100Hz */
+#endif
+
+
+/*! Size of one result record for the device driver, in int */
+#define AKM_YPR_RECORD_SIZE	\
+	(AKM_YPR_DATA_SIZE + (AKM_SENSOR_TIME_SIZE / sizeof(int)))
 
 /*** Type declaration *********************************************************/
 typedef unsigned char BYTE;
@@ -81,6 +98,17 @@ typedef int16_t(*ACCFNC_SET_DELAY)(const int64_t ns);
  */
 typedef int16_t(*ACCFNC_GETACCDATA)(int16_t data[3]);
 
+/*!
+ Acquire data from other sensor, as it was at a given time. Only sources
+ which keep timestamped samples provide this.
+ @return If this function succeeds, the return value is #AKD_SUCCESS. Otherwise
+ the return value is #AKD_FAIL.
+ @param[in] time The time in nano second, in the time base of the magnetic
+ data.
+ @param[out] data A data array, as for #ACCFNC_GETACCDATA.
+ */
+typedef int16_t(*ACCFNC_GETACCDATA_AT)(int64_t time, int16_t data[3]);
+
 /*!
  Acquire offset from other sensor.
  @return If this function succeeds, the return value is #AKD_SUCCESS. Otherwise
@@ -136,6 +164,12 @@ int16_t AKD_SetMode(const BYTE mode);
 
 int16_t AKD_GetDelay(int64_t delay[AKM_NUM_SENSORS]);
 
+int16_t AKD_InitDelayEvent(void);
+
+int AKD_GetDelayEventFd(void);
+
+void AKD_NotifyDelay(void);
+
 int16_t AKD_GetLayout(int16_t* layout);
 
 int16_t AKD_AccSetEnable(int8_t enabled);
@@ -144,6 +178,8 @@ int16_t AKD_AccSetDelay(int64_t delay);
 
 int16_t AKD_GetAccelerationData(int16_t data[3]);
 
+int16_t AKD_GetAccelerationDataAt(int64_t time, int16_t data[3]);
+
 int16_t AKD_GetAccelerationOffset(int16_t offset[3]);
 
 void AKD_GetAccelerationVector(
@@ -153,5 +189,9 @@ void AKD_GetAccelerationVector(
 
 int16_t AKD_WaitReady(void);
 
+int16_t AKD_StartRecord(const char* path);
+
+void AKD_StopRecord(void);
+
 #endif //AKMD_INC_AKMD_DRIVER_H
 
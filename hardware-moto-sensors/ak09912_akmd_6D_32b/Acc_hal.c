@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2016 Motorola Mobility
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include "Acc_hal.h"
+#include "AKCommon.h"	/* For AKMERROR */
+#include "Sensors.h"
+
+/*! Number of samples kept. The hub streams the accelerometer at least as
+ fast as the compass measures, so this covers a few magnetometer periods. */
+#define ACCHAL_NUM_SAMPLES	8
+
+typedef struct _ACCHAL_SAMPLE {
+	int64_t time;		/*!< Timestamp in nano second */
+	int16_t data[3];	/*!< Raw sample, hub units */
+} ACCHAL_SAMPLE;
+
+static pthread_mutex_t s_accLock = PTHREAD_MUTEX_INITIALIZER;
+static ACCHAL_SAMPLE s_acc[ACCHAL_NUM_SAMPLES];
+static int s_accHead = 0;	/*!< Index of the next sample to write */
+static int s_accCount = 0;	/*!< Number of valid samples */
+
+/*!
+ Convert a raw sample to the AKSC scale.
+ */
+static void scaleAccData(int16_t data[3])
+{
+	data[0] *= (AKSC_LSG / LSG);
+	data[1] *= (AKSC_LSG / LSG);
+	data[2] *= (AKSC_LSG / LSG);
+
+	AKMDEBUG(AKMDBG_ACCDRV, "%s: acc=%d, %d, %d\n",
+			__FUNCTION__, data[0], data[1], data[2]);
+}
+
+/* Initialize communication device. See "AKMD_Driver.h" */
+int16_t ACCHAL_InitDevice(void)
+{
+	pthread_mutex_lock(&s_accLock);
+	s_accHead = 0;
+	s_accCount = 0;
+	pthread_mutex_unlock(&s_accLock);
+
+	return AKD_SUCCESS;
+}
+
+/* Release communication device and resources. See "AKMD_Driver.h" */
+void ACCHAL_DeinitDevice(void)
+{
+}
+
+int16_t ACCHAL_SetEnable(const int8_t enabled)
+{
+	/* The HAL enables the accelerometer along with the compass */
+	(void)enabled;
+	return AKD_SUCCESS;
+}
+
+int16_t ACCHAL_SetDelay(const int64_t ns)
+{
+	/* The HAL runs the accelerometer at least at the compass rate */
+	(void)ns;
+	return AKD_SUCCESS;
+}
+
+int16_t ACCHAL_GetAccData(int16_t data[3])
+{
+	const ACCHAL_SAMPLE* latest;
+
+	pthread_mutex_lock(&s_accLock);
+	if (s_accCount == 0) {
+		pthread_mutex_unlock(&s_accLock);
+		AKMDEBUG(AKMDBG_ACCDRV, "%s: no sample yet\n", __FUNCTION__);
+		return AKD_FAIL;
+	}
+	latest = &s_acc[(s_accHead + ACCHAL_NUM_SAMPLES - 1) % ACCHAL_NUM_SAMPLES];
+	memcpy(data, latest->data, sizeof(latest->data));
+	pthread_mutex_unlock(&s_accLock);
+
+	scaleAccData(data);
+	return AKD_SUCCESS;
+}
+
+/*!
+ Get the acceleration at a given time, interpolated between the samples
+ around it. Outside of the kept samples, the nearest one is used as is.
+ @return #AKD_SUCCESS, or #AKD_FAIL when there is no sample yet.
+ @param[in] time The time in nano second.
+ @param[out] data Acceleration data.
+ */
+int16_t ACCHAL_GetAccDataAt(int64_t time, int16_t data[3])
+{
+	const ACCHAL_SAMPLE* before = NULL;
+	const ACCHAL_SAMPLE* after = NULL;
+	const ACCHAL_SAMPLE* s;
+	int64_t span;
+	int i;
+
+	pthread_mutex_lock(&s_accLock);
+	if (s_accCount == 0) {
+		pthread_mutex_unlock(&s_accLock);
+		AKMDEBUG(AKMDBG_ACCDRV, "%s: no sample yet\n", __FUNCTION__);
+		return AKD_FAIL;
+	}
+
+	/* Walk from the newest sample to the oldest one */
+	for (i = 1; i <= s_accCount; i++) {
+		s = &s_acc[(s_accHead + ACCHAL_NUM_SAMPLES - i) % ACCHAL_NUM_SAMPLES];
+		if (s->time <= time) {
+			before = s;
+			break;
+		}
+		after = s;
+	}
+
+	if (before == NULL) {
+		/* Older than all samples */
+		memcpy(data, after->data, sizeof(after->data));
+	} else if ((after == NULL) || ((span = after->time - before->time) <= 0)) {
+		/* Newer than all samples, or nothing to interpolate */
+		memcpy(data, before->data, sizeof(before->data));
+	} else {
+		for (i = 0; i < 3; i++) {
+			data[i] = (int16_t)(before->data[i] +
+				((int64_t)(after->data[i] - before->data[i]) *
+				 (time - before->time)) / span);
+		}
+	}
+	pthread_mutex_unlock(&s_accLock);
+
+	scaleAccData(data);
+	return AKD_SUCCESS;
+}
+
+int16_t ACCHAL_GetAccOffset(int16_t offset[3])
+{
+	offset[0] = 0;
+	offset[1] = 0;
+	offset[2] = 0;
+	return AKD_SUCCESS;
+}
+
+void ACCHAL_GetAccVector(const int16_t data[3], const int16_t offset[3], int16_t vec[3])
+{
+	vec[0] = (int16_t)(data[0] - offset[0]);
+	vec[1] = (int16_t)(data[1] - offset[1]);
+	vec[2] = (int16_t)(data[2] - offset[2]);
+}
+
+/*!
+ Hand over an accelerometer sample from the sensor HAL.
+ @param[in] data Raw sample in the hub units and the Android coordinate system.
+ @param[in] time Timestamp of the sample in nano second.
+ */
+void ACCHAL_SetAccData(const int16_t data[3], int64_t time)
+{
+	ACCHAL_SAMPLE* s;
+
+	pthread_mutex_lock(&s_accLock);
+	s = &s_acc[s_accHead];
+	s->time = time;
+	memcpy(s->data, data, sizeof(s->data));
+	s_accHead = (s_accHead + 1) % ACCHAL_NUM_SAMPLES;
+	if (s_accCount < ACCHAL_NUM_SAMPLES) {
+		s_accCount++;
+	}
+	pthread_mutex_unlock(&s_accLock);
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2016 Motorola Mobility
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AKMD_INC_ACCHAL_H
+#define AKMD_INC_ACCHAL_H
+
+#include "AKMD_Driver.h"
+
+/*** Constant definition ******************************************************/
+
+/*** Type declaration *********************************************************/
+
+/*** Global variables *********************************************************/
+
+/*** Prototype of function ****************************************************/
+/*
+ Acceleration source used when akmd runs inside the sensor HAL. The HAL
+ already streams the hub accelerometer, so it hands every sample over with
+ ACCHAL_SetAccData() instead of akmd asking the driver for one. The last few
+ samples are kept, so the acceleration can be interpolated to the time of a
+ magnetic measurement.
+ */
+int16_t ACCHAL_InitDevice(void);
+void	ACCHAL_DeinitDevice(void);
+int16_t ACCHAL_SetEnable(const int8_t enabled);
+int16_t ACCHAL_SetDelay(const int64_t ns);
+int16_t ACCHAL_GetAccData(int16_t data[3]);
+int16_t ACCHAL_GetAccDataAt(int64_t time, int16_t data[3]);
+int16_t ACCHAL_GetAccOffset(int16_t offset[3]);
+void	ACCHAL_GetAccVector(const int16_t data[3], const int16_t offset[3], int16_t vec[3]);
+
+void	ACCHAL_SetAccData(const int16_t data[3], int64_t time);
+
+#endif //AKMD_INC_ACCHAL_H
@@ -0,0 +1,240 @@
+/*
+ * Copyright (C) 2016 Motorola Mobility
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ Replays a recording made with "akmd09912 -r <file>" through the measurement
+ code and reports what it costs.
+
+ The first pass calls GetMagneticVector(), CalcDirection() and
+ ConvertCoordinate() once per sample and measures their CPU time. The second
+ pass runs MeasureSNGLoop() on the replay device at the requested speed and
+ measures the latency from a sample being read to its result being reported.
+
+ Usage: akmd09912_replay [-x speed] [-p] [-z dbgzone] <recording>
+   -x  Replay speed for the second pass, 1 (default) for the recorded rate.
+       The minimum intervals of GetInterval() still apply.
+   -p  Start from the saved calibration instead of the defaults. It is
+       not updated by the replay.
+ */
+#include <time.h>
+
+#include "AKCommon.h"
+#include "AKMD_Driver.h"
+#include "DispMessage.h"
+#include "FileIO.h"
+#include "Measure.h"
+#include "Replay.h"
+#include "misc.h"
+
+/*! ConvertCoordinate() is too short to time alone */
+#define BENCH_CONVERT_LOOPS	1000
+
+/* Global variable. See AKCommon.h file. */
+int g_stopRequest = 0;
+int g_opmode = OPMODE_REPLAY;
+int g_dbgzone = 0;
+
+typedef struct _BENCH_STAT {
+	const char*	name;
+	int64_t		count;
+	int64_t		total;	/*!< ns */
+	int64_t		worst;	/*!< ns */
+} BENCH_STAT;
+
+/* Static variable. */
+static BENCH_STAT s_latency = { "end-to-end latency", 0, 0, 0 };
+static int64_t s_firstTime;		/*!< Recorded timestamp of the first result */
+static int64_t s_highTime = -1;	/*!< Recorded time to the highest level */
+
+static int64_t now(clockid_t clock)
+{
+	struct timespec ts = { 0, 0 };
+
+	clock_gettime(clock, &ts);
+	return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void addSample(BENCH_STAT* stat, int64_t ns)
+{
+	stat->count++;
+	stat->total += ns;
+	if (ns > stat->worst) {
+		stat->worst = ns;
+	}
+}
+
+static void printStat(const BENCH_STAT* stat)
+{
+	if (stat->count == 0) {
+		printf("%-20s no samples\n", stat->name);
+		return;
+	}
+	printf("%-20s %8lld samples, avg %9.3f us, worst %9.3f us\n",
+			stat->name, (long long)stat->count,
+			(double)stat->total / stat->count / 1000.0,
+			(double)stat->worst / 1000.0);
+}
+
+/*!
+ Collect the latency of every result. See DispMessage.h.
+ */
+void Disp_MeasurementResultHook(AKSCPRMS* prms, const uint16 flag, uint8 *time)
+{
+	int64_t recorded;
+
+	(void)flag;
+	addSample(&s_latency, now(CLOCK_BOOTTIME) - REPLAY_GetDeliveryTime());
+
+	memcpy(&recorded, time, sizeof(recorded));
+	if (s_firstTime == 0) {
+		s_firstTime = recorded;
+	}
+	if ((s_highTime < 0) && (prms->m_hdst == AKSC_HDST_L2)) {
+		s_highTime = recorded - s_firstTime;
+	}
+}
+
+/*!
+ Time the calculations, one sample at a time, without the loop around them.
+ */
+static void measureCpu(AKSCPRMS* prms)
+{
+	BYTE	i2cData[AKM_SENSOR_DATA_SIZE + AKM_SENSOR_TIME_SIZE];
+	int16	bData[AKM_SENSOR_DATA_SIZE];
+	int16	adata[3];
+	int16vec	vec;
+	int64_t	begin;
+	int		i;
+	BENCH_STAT mag = { "GetMagneticVector", 0, 0, 0 };
+	BENCH_STAT dir = { "CalcDirection", 0, 0, 0 };
+	BENCH_STAT conv = { "ConvertCoordinate", 0, 0, 0 };
+
+	if (Init_Measure(prms) != AKRET_PROC_SUCCEED) {
+		AKMERROR;
+		return;
+	}
+
+	while (AKD_GetMagneticData(i2cData) == AKD_SUCCESS) {
+		for (i = 0; i < AKM_SENSOR_DATA_SIZE; i++) {
+			bData[i] = i2cData[i];
+		}
+		begin = now(CLOCK_THREAD_CPUTIME_ID);
+		GetMagneticVector(bData, prms, 0, 1);
+		addSample(&mag, now(CLOCK_THREAD_CPUTIME_ID) - begin);
+
+		AKD_GetAccelerationData(adata);
+		AKD_GetAccelerationVector(adata, prms->m_AO.v, prms->m_avec.v);
+		begin = now(CLOCK_THREAD_CPUTIME_ID);
+		CalcDirection(prms);
+		addSample(&dir, now(CLOCK_THREAD_CPUTIME_ID) - begin);
+
+		vec = prms->m_hvec;
+		begin = now(CLOCK_THREAD_CPUTIME_ID);
+		for (i = 0; i < BENCH_CONVERT_LOOPS; i++) {
+			ConvertCoordinate(prms->m_hlayout, &vec);
+		}
+		addSample(&conv, (now(CLOCK_THREAD_CPUTIME_ID) - begin) / BENCH_CONVERT_LOOPS);
+	}
+
+	printf("CPU time per sample:\n");
+	printStat(&mag);
+	printStat(&dir);
+	printStat(&conv);
+}
+
+int main(int argc, char **argv)
+{
+	static AKSCPRMS prms;
+	static AKSCPRMS initial;
+	int		opt;
+	int		speed = 1;
+	int		loadParameters = AKD_FALSE;
+	int16_t	layout;
+	int64_t	begin;
+
+	while ((opt = getopt(argc, argv, "x:pz:")) != -1) {
+		switch (opt) {
+			case 'x':
+				speed = atoi(optarg);
+				break;
+			case 'p':
+				loadParameters = AKD_TRUE;
+				break;
+			case 'z':
+				g_dbgzone = (int)strtol(optarg, (char**)NULL, 0);
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-x speed] [-p] [-z dbgzone] <recording>\n",
+						argv[0]);
+				return 1;
+		}
+	}
+	if ((optind >= argc) || (REPLAY_SetSource(argv[optind], speed) != AKD_SUCCESS)) {
+		fprintf(stderr, "Usage: %s [-x speed] [-p] [-z dbgzone] <recording>\n",
+				argv[0]);
+		return 1;
+	}
+
+	InitAKSCPRMS(&prms);
+	if (AKD_InitDevice() != AKD_SUCCESS) {
+		fprintf(stderr, "Can't open %s\n", argv[optind]);
+		return 1;
+	}
+	if ((AKD_GetLayout(&layout) != AKD_SUCCESS) || (layout < PAT1) || (PAT8 < layout)) {
+		fprintf(stderr, "Bad layout in %s\n", argv[optind]);
+		AKD_DeinitDevice();
+		return 1;
+	}
+	prms.m_hlayout = (AKMD_PATNO)layout;
+	if (ReadFUSEROM(&prms) != AKRET_PROC_SUCCEED) {
+		AKD_DeinitDevice();
+		return 1;
+	}
+	if (loadParameters) {
+		LoadPDC(&prms);
+		if (LoadParameters(&prms) == 0) {
+			SetDefaultPRMS(&prms);
+		}
+	} else {
+		SetDefaultPRMS(&prms);
+	}
+	/* Both passes start from the same calibration */
+	initial = prms;
+
+	measureCpu(&prms);
+
+	prms = initial;
+	if (REPLAY_Rewind() != AKD_SUCCESS) {
+		AKD_DeinitDevice();
+		return 1;
+	}
+	g_stopRequest = 0;
+	begin = now(CLOCK_BOOTTIME);
+	MeasureSNGLoop(&prms);
+
+	printf("Measurement loop at %dx, %.2f s:\n", speed,
+			(double)(now(CLOCK_BOOTTIME) - begin) / 1000000000.0);
+	printStat(&s_latency);
+	if (s_highTime >= 0) {
+		printf("Accuracy high after %.2f s of recording\n",
+				(double)s_highTime / 1000000000.0);
+	} else {
+		printf("Accuracy high not reached\n");
+	}
+
+	AKD_DeinitDevice();
+	return 0;
+}
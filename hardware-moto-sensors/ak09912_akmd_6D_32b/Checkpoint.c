@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2016 Motorola Mobility
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ Saves the calibration while the measurement loop runs, so that it survives
+ a crash or a forced stop and the next start doesn't begin from stale
+ offsets. The loop only compares a few values and hands over a copy; the
+ file is written on a separate thread.
+ */
+#include <pthread.h>
+
+#include "AKCommon.h"
+#include "Checkpoint.h"
+#include "FileIO.h"
+
+/* Static variable. */
+static pthread_t s_thread;
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_cond = PTHREAD_COND_INITIALIZER;
+static int s_running = AKD_FALSE;	/*!< Writer thread started */
+static int s_stop;					/*!< Writer thread asked to exit */
+static int s_pending;				/*!< s_snapshot not written yet */
+static AKSCPRMS s_snapshot;			/*!< Parameters to be written */
+
+/* Owned by the measurement thread */
+static AKSC_HDST s_savedHdst[CSPEC_NUM_FORMATION];
+static int16vec s_savedHo[CSPEC_NUM_FORMATION];
+static int64_t s_lastSave;			/*!< Time of the last checkpoint, or -1 */
+
+/*!
+ Copy the members which SaveParameters() writes.
+ */
+static void copyCalibration(AKSCPRMS* dst, const AKSCPRMS* src)
+{
+	memcpy(dst->HSUC_HDST, src->HSUC_HDST, sizeof(dst->HSUC_HDST));
+	memcpy(dst->HSUC_HO, src->HSUC_HO, sizeof(dst->HSUC_HO));
+	memcpy(dst->HFLUCV_HREF, src->HFLUCV_HREF, sizeof(dst->HFLUCV_HREF));
+	memcpy(dst->HSUC_HBASE, src->HSUC_HBASE, sizeof(dst->HSUC_HBASE));
+	dst->m_AO = src->m_AO;
+}
+
+static void* thread_main(void* args)
+{
+	(void)args;
+
+	pthread_mutex_lock(&s_lock);
+	while (AKD_TRUE) {
+		while (!s_pending && !s_stop) {
+			pthread_cond_wait(&s_cond, &s_lock);
+		}
+		if (s_pending) {
+			if (SaveParameters(&s_snapshot) == 0) {
+				AKMERROR;
+			}
+			s_pending = 0;
+		}
+		if (s_stop) {
+			break;
+		}
+	}
+	pthread_mutex_unlock(&s_lock);
+	return ((void*)0);
+}
+
+/*!
+ Start checkpointing. \a prms holds the calibration as it was loaded, which
+ is the baseline for the first checkpoint.
+ */
+void Checkpoint_Start(const AKSCPRMS* prms)
+{
+	/* A replayed recording must not replace the device calibration */
+	if (s_running || (g_opmode & OPMODE_REPLAY)) {
+		return;
+	}
+	memcpy(s_savedHdst, prms->HSUC_HDST, sizeof(s_savedHdst));
+	memcpy(s_savedHo, prms->HSUC_HO, sizeof(s_savedHo));
+	s_lastSave = -1;
+	s_stop = 0;
+	s_pending = 0;
+
+	if (pthread_create(&s_thread, NULL, thread_main, NULL) != 0) {
+		/* Calibration is still saved when the loop ends */
+		AKMERROR_STR("pthread_create");
+		return;
+	}
+	s_running = AKD_TRUE;
+}
+
+/*!
+ Write the calibration if it is worth it: the offset level has improved or
+ the offset has moved by more than #CSPEC_CHECKPOINT_HO_DIFF since the last
+ checkpoint. At most one checkpoint is written per #CSPEC_CHECKPOINT_INTERVAL;
+ a change which comes earlier is written when the interval is over. This is
+ called on the measurement thread and never waits for the writer.
+ @param[in] prms The current parameters.
+ @param[in] now The current time in nano second.
+ */
+void Checkpoint_Update(const AKSCPRMS* prms, int64_t now)
+{
+	int16 i, changed = 0;
+
+	if (!s_running) {
+		return;
+	}
+	if ((s_lastSave >= 0) && (now - s_lastSave < CSPEC_CHECKPOINT_INTERVAL)) {
+		return;
+	}
+
+	for (i = 0; i < CSPEC_NUM_FORMATION; i++) {
+		if ((prms->HSUC_HDST[i] > s_savedHdst[i]) ||
+			(abs(prms->HSUC_HO[i].u.x - s_savedHo[i].u.x) > CSPEC_CHECKPOINT_HO_DIFF) ||
+			(abs(prms->HSUC_HO[i].u.y - s_savedHo[i].u.y) > CSPEC_CHECKPOINT_HO_DIFF) ||
+			(abs(prms->HSUC_HO[i].u.z - s_savedHo[i].u.z) > CSPEC_CHECKPOINT_HO_DIFF)) {
+			changed = 1;
+			break;
+		}
+	}
+	if (!changed) {
+		return;
+	}
+
+	/* The writer is busy with the previous one, try again next time */
+	if (pthread_mutex_trylock(&s_lock) != 0) {
+		return;
+	}
+	copyCalibration(&s_snapshot, prms);
+	s_pending = 1;
+	pthread_cond_signal(&s_cond);
+	pthread_mutex_unlock(&s_lock);
+
+	memcpy(s_savedHdst, prms->HSUC_HDST, sizeof(s_savedHdst));
+	memcpy(s_savedHo, prms->HSUC_HO, sizeof(s_savedHo));
+	s_lastSave = now;
+
+	AKMDEBUG(AKMDBG_DEBUG, "%s: level=%d\n", __FUNCTION__, prms->HSUC_HDST[0]);
+}
+
+/*!
+ Stop checkpointing. A pending checkpoint is written before this returns,
+ so the caller can save the final parameters right after.
+ */
+void Checkpoint_Stop(void)
+{
+	if (!s_running) {
+		return;
+	}
+	pthread_mutex_lock(&s_lock);
+	s_stop = 1;
+	pthread_cond_signal(&s_cond);
+	pthread_mutex_unlock(&s_lock);
+	pthread_join(s_thread, NULL);
+	s_running = AKD_FALSE;
+}
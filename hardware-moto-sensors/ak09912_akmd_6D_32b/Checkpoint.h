@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2016 Motorola Mobility
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AKMD_INC_CHECKPOINT_H
+#define AKMD_INC_CHECKPOINT_H
+
+#include "AKCompass.h"
+
+/*** Constant definition ******************************************************/
+
+/*** Type declaration *********************************************************/
+
+/*** Global variables *********************************************************/
+
+/*** Prototype of function ****************************************************/
+void Checkpoint_Start(const AKSCPRMS* prms);
+
+void Checkpoint_Update(const AKSCPRMS* prms, int64_t now);
+
+void Checkpoint_Stop(void);
+
+#endif //AKMD_INC_CHECKPOINT_H
@@ -60,9 +60,23 @@
 //	0x60 : High
 #define CSPEC_NSF				0x40
 
+// Directory of the setting files. The tests use their own.
+#ifndef CSPEC_DATA_DIR
+#define CSPEC_DATA_DIR		"/data/misc/akmd"
+#endif
+
 // Setting file
-#define CSPEC_SETTING_FILE	"/data/misc/akmd/akmd_set.txt"
-#define CSPEC_PDC_FILE		"/data/misc/akmd/pdc.txt"
+#define CSPEC_SETTING_FILE	CSPEC_DATA_DIR "/akmd_set.txt"
+#define CSPEC_PDC_FILE		CSPEC_DATA_DIR "/pdc.txt"
+// Binary copies of the setting files, see FileIO.h
+#define CSPEC_SETTING_BIN_FILE	CSPEC_DATA_DIR "/akmd_set.bin"
+#define CSPEC_PDC_BIN_FILE		CSPEC_DATA_DIR "/pdc.bin"
+
+// Calibration checkpoints while measuring, see Checkpoint.c
+//	Minimum time between two checkpoints in nano second.
+#define CSPEC_CHECKPOINT_INTERVAL	(30LL * 1000000000LL)
+//	Offset change, in HO units, which is worth a checkpoint.
+#define CSPEC_CHECKPOINT_HO_DIFF	16
 
 #endif //AKMD_INC_CUSTOMERSPEC_H
 
@@ -23,6 +23,7 @@
  ******************************************************************************/
 #include "DispMessage.h"
 #include "AKCommon.h"
+#include "misc.h"
 
 /*!
  Print startup message to Android Log daemon.
@@ -46,6 +47,56 @@ void Disp_EndMessage(int ret)
 	ALOGI("AKMD end (%d).", ret);
 }
 
+/*!
+ Pack the measurement result into the record format of the device driver.
+ @param[in] prms pointer to #AKSCPRMS structure.
+ @param[in] flag This flag shows which data contains the valid data.
+ @param[in] time Timestamp of the magnetic data, #AKM_SENSOR_TIME_SIZE bytes.
+ @param[out] rbuf The record.
+ */
+void Disp_MeasurementRecord(
+	AKSCPRMS* prms,
+	const uint16 flag,
+	const uint8 *time,
+	int rbuf[AKM_YPR_RECORD_SIZE])
+{
+	int16vec rawmag;
+
+	memset(rbuf, 0, AKM_YPR_RECORD_SIZE * sizeof(int));
+
+	/* Coordinate system is already converted to Android */
+	rbuf[0] = flag;				/* Data flag */
+	rbuf[1] = prms->m_avec.u.x;	/* Ax */
+	rbuf[2] = prms->m_avec.u.y;	/* Ay */
+	rbuf[3] = prms->m_avec.u.z;	/* Az */
+	rbuf[4] = 3;				/* Acc status */
+	rbuf[5] = prms->m_hvec.u.x;	/* Mx */
+	rbuf[6] = prms->m_hvec.u.y;	/* My */
+	rbuf[7] = prms->m_hvec.u.z;	/* Mz */
+	rbuf[8] = prms->m_hdst;		/* Mag status */
+	/* Orientation (Q6 format)*/
+	rbuf[9] = prms->m_theta;	/* yaw	(deprecate) */
+	rbuf[10] = prms->m_phi180;	/* pitch (deprecate) */
+	rbuf[11] = prms->m_eta90;	/* roll  (deprecate) */
+	/* Axis conversion, from AKSC to Android is done here */
+	/* RotVec (AKSC Q4 format deg/sec ) */
+	rbuf[12] = prms->m_quat.u.y;
+	rbuf[13] = prms->m_quat.u.x * (-1);
+	rbuf[14] = prms->m_quat.u.z * (-1);
+	rbuf[15] = prms->m_quat.u.w;
+
+	/* Get the uncalibrated reading */
+	rawmag.u.x = prms->m_hdata[0].u.x;
+	rawmag.u.y = prms->m_hdata[0].u.y;
+	rawmag.u.z = prms->m_hdata[0].u.z;
+	ConvertCoordinate(prms->m_hlayout, &rawmag);
+	rbuf[16] = rawmag.u.x;
+	rbuf[17] = rawmag.u.y;
+	rbuf[18] = rawmag.u.z;
+
+	memcpy(&rbuf[AKM_YPR_DATA_SIZE], time, AKM_SENSOR_TIME_SIZE);
+}
+
 /*!
  Print calculated result.
  @param[in] prms A pointer to a #AKSCPRMS structure. The value of member
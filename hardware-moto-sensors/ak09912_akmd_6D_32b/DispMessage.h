@@ -26,6 +26,7 @@
 
 // Include file for SmartCompass Library.
 #include "AKCompass.h"
+#include "AKMD_Driver.h"
 
 /*** Constant definition ******************************************************/
 #define DISP_CONV_AKSCF(val)	((val)*0.06f)
@@ -52,7 +53,13 @@ void Disp_EndMessage(int ret);
 
 void Disp_MeasurementResult(AKSCPRMS* prms);
 
-// Defined in main.c
+void Disp_MeasurementRecord(
+	AKSCPRMS* prms,
+	const uint16 flag,
+	const uint8 *time,
+	int rbuf[AKM_YPR_RECORD_SIZE]);
+
+// Defined in main.c, or in Hosted.c when akmd runs inside the sensor HAL
 void Disp_MeasurementResultHook(AKSCPRMS* prms, const uint16 flag, uint8 *time);
 
 MODE Menu_Main(void);
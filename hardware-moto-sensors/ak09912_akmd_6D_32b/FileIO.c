@@ -22,115 +22,501 @@
  *
  ******************************************************************************/
 #include "FileIO.h"
+#include <limits.h>
 #include <sys/stat.h>
+#include <zlib.h>
 
 #define AKM_PERM (S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP)
 
+/*! Largest text parameter file which is accepted */
+#define FILEIO_TEXT_SIZE	4096
+
+static void TableInit(FILEIO_TABLE* table)
+{
+	table->count = 0;
+	table->hint = 0;
+}
+
 /*!
- Load parameters from file which is specified with #CSPEC_SETTING_FILE.
- This function reads data from a beginning of the file line by line, and
- check parameter name sequentially. In otherword, this function depends on
- the order of eache parameter described in the file.
- @return If function fails, the return value is 0. When function fails, the
- output is undefined. Therefore, parameters which are possibly overwritten
- by this function should be initialized again. If function succeeds, the
- return value is 1.
- @param[out] prms A pointer to #AKSCPRMS structure. Loaded parameter is
- stored to the member of this structure.
+ Append a key and its value to \a table.
+ @return 1 on success, 0 if the table is full or the key is too long.
  */
-int16 LoadParameters(AKSCPRMS * prms)
+static int16 TablePut(FILEIO_TABLE* table, const char* key, size_t keyLen, int val)
 {
-	int16	i, ret;
-	int		tmp;
-	FILE	*fp = NULL;
-	char	keyName[KEYNAME_SIZE];
+	FILEIO_KV* kv;
+
+	if ((table->count >= FILEIO_MAX_KEYS) || (keyLen >= KEYNAME_SIZE)) {
+		ALOGE("%s: no room for %.*s", __FUNCTION__, (int)keyLen, key);
+		return 0;
+	}
+	kv = &table->kv[table->count++];
+	memcpy(kv->key, key, keyLen);
+	kv->key[keyLen] = '\0';
+	kv->val = val;
+	return 1;
+}
+
+/*!
+ CRC of the key names of \a table, to tell whether a binary file has the
+ same layout.
+ */
+static uint32 TableKeyCrc(const FILEIO_TABLE* table)
+{
+	uint32 crc = 0;
+	int16 i;
+
+	for (i = 0; i < table->count; i++) {
+		crc = crc32(crc, (const Bytef*)table->kv[i].key,
+				strlen(table->kv[i].key) + 1);
+	}
+	return crc;
+}
+
+/*!
+ Read a text parameter file in one pass into \a table.
+ @return 1 on success, otherwise 0.
+ @param[in] path The text file.
+ @param[out] table The "key = value" lines of the file, in file order.
+ @param[out] header If not NULL, the first line of the file is a free text
+ header which is copied here instead of being parsed.
+ @param[in] headerSize Size of \a header.
+ */
+static int16 ParseTable(
+	const char* path,
+	FILEIO_TABLE* table,
+	char* header,
+	size_t headerSize)
+{
+	char	buf[FILEIO_TEXT_SIZE];
+	char	*p, *key, *end;
+	size_t	len, keyLen;
+	long	val;
+	FILE	*fp;
 
-	//Open setting file for read.
-	if ((fp = fopen(CSPEC_SETTING_FILE, "r")) == NULL) {
+	if ((fp = fopen(path, "r")) == NULL) {
 		AKMERROR_STR("fopen");
 		return 0;
 	}
+	len = fread(buf, 1, sizeof(buf), fp);
+	if (ferror(fp) || (len == sizeof(buf))) {
+		ALOGE("%s: can't read %s (%zu bytes)", __FUNCTION__, path, len);
+		fclose(fp);
+		return 0;
+	}
+	fclose(fp);
+	buf[len] = '\0';
+
+	TableInit(table);
+	p = buf;
+
+	if (header != NULL) {
+		if (len == 0) {
+			ALOGE("%s: %s is empty", __FUNCTION__, path);
+			return 0;
+		}
+		len = strcspn(p, "\n");
+		snprintf(header, headerSize, "%.*s", (int)len, p);
+		p += len;
+	}
+
+	while (AKD_TRUE) {
+		p += strspn(p, " \t\r\n");
+		if (*p == '\0') {
+			break;
+		}
+		key = p;
+		keyLen = strcspn(p, " \t\r\n=");
+		p += keyLen;
+		p += strspn(p, " \t");
+		if (*p != '=') {
+			ALOGE("%s: bad line for %.*s", __FUNCTION__, (int)keyLen, key);
+			return 0;
+		}
+		val = strtol(p + 1, &end, 10);
+		if (end == p + 1) {
+			ALOGE("%s: no value for %.*s", __FUNCTION__, (int)keyLen, key);
+			return 0;
+		}
+		if (TablePut(table, key, keyLen, (int)val) == 0) {
+			return 0;
+		}
+		p = end;
+	}
+	return 1;
+}
+
+/*!
+ Get the modification time and size of a file.
+ @return 1 on success, otherwise 0.
+ */
+static int16 StatSource(const char* path, int64_t* size, int64_t* mtime)
+{
+	struct stat st;
+
+	if (stat(path, &st) != 0) {
+		return 0;
+	}
+	*size = st.st_size;
+	*mtime = (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+	return 1;
+}
+
+/*!
+ Load the values of \a table from its binary sidecar file. The sidecar is
+ used only if it matches the keys of \a table and the text file \a txtPath
+ exactly as it was when the sidecar was written.
+ @return 1 on success, otherwise 0 and the table values are undefined.
+ @param[in] binPath The binary file.
+ @param[in] txtPath The text file the binary file was written with.
+ @param[in,out] table Holds the expected keys. Gets the values.
+ */
+static int16 LoadBinTable(
+	const char* binPath,
+	const char* txtPath,
+	FILEIO_TABLE* table)
+{
+	FILEIO_BIN_HEADER hdr;
+	int32_t	vals[FILEIO_MAX_KEYS];
+	int64_t	srcSize, srcMtime;
+	int16	i;
+	FILE	*fp;
+
+	/* The text file is the reference */
+	if (StatSource(txtPath, &srcSize, &srcMtime) == 0) {
+		return 0;
+	}
+	if ((fp = fopen(binPath, "rb")) == NULL) {
+		AKMDEBUG(AKMDBG_DEBUG, "%s: no %s\n", __FUNCTION__, binPath);
+		return 0;
+	}
+	if ((fread(&hdr, sizeof(hdr), 1, fp) != 1) ||
+		(memcmp(hdr.magic, FILEIO_BIN_MAGIC, sizeof(hdr.magic)) != 0) ||
+		(hdr.version != FILEIO_BIN_VERSION) ||
+		(hdr.count != (uint32)table->count) ||
+		(hdr.keyCrc != TableKeyCrc(table)) ||
+		(hdr.srcSize != srcSize) ||
+		(hdr.srcMtime != srcMtime) ||
+		(fread(vals, sizeof(vals[0]), hdr.count, fp) != hdr.count) ||
+		(hdr.crc != crc32(0, (const Bytef*)vals, hdr.count * sizeof(vals[0])))) {
+		ALOGI("%s: %s is stale or corrupted, using %s",
+			__FUNCTION__, binPath, txtPath);
+		fclose(fp);
+		return 0;
+	}
+	fclose(fp);
+
+	for (i = 0; i < table->count; i++) {
+		table->kv[i].val = vals[i];
+	}
+	table->hint = 0;
+	return 1;
+}
+
+/*!
+ Open a temporary file next to \a path, to be moved over it by CommitFile().
+ If the temporary file may not be created, \a path is written in place. It
+ is then not replaced atomically, but the calibration is still saved under
+ a policy which only lets akmd write its existing files.
+ @return The file, or NULL on error.
+ @param[in] path The file to be replaced.
+ @param[in] mode As for fopen().
+ @param[out] tmpPath Name of the temporary file, or an empty string when
+ \a path is written in place.
+ @param[in] tmpSize Size of \a tmpPath.
+ */
+static FILE* OpenCommitFile(
+	const char* path,
+	const char* mode,
+	char* tmpPath,
+	size_t tmpSize)
+{
+	FILE	*fp;
+
+	snprintf(tmpPath, tmpSize, "%s.tmp", path);
+	if ((fp = fopen(tmpPath, mode)) != NULL) {
+		return fp;
+	}
+	if (errno != EACCES) {
+		AKMERROR_STR("fopen");
+		return NULL;
+	}
+	ALOGW("%s: can't create %s, writing %s in place",
+		__FUNCTION__, tmpPath, path);
+	tmpPath[0] = '\0';
+	if ((fp = fopen(path, mode)) == NULL) {
+		AKMERROR_STR("fopen");
+	}
+	return fp;
+}
+
+/*!
+ Finish writing a file opened with OpenCommitFile(). A temporary file is
+ synced before it is moved over \a path, so after a crash \a path holds
+ either the old or the new content, never a partial one.
+ @return 1 on success, otherwise 0 and \a tmpPath is removed.
+ @param[in] fp The file, closed by this function.
+ @param[in] tmpPath Name of the temporary file, empty if \a path has been
+ written in place.
+ @param[in] path The file to be replaced.
+ @param[in] ok 0 if writing the content has already failed.
+ */
+static int16 CommitFile(FILE* fp, const char* tmpPath, const char* path, int16 ok)
+{
+	if (ok && ((fflush(fp) != 0) || (fsync(fileno(fp)) != 0))) {
+		AKMERROR_STR("fsync");
+		ok = 0;
+	}
+	if (fclose(fp) != 0) {
+		AKMERROR_STR("fclose");
+		ok = 0;
+	}
+	if (tmpPath[0] == '\0') {
+		return ok;
+	}
+	if (ok && (chmod(tmpPath, AKM_PERM) != 0)) {
+		AKMERROR_STR("chmod");
+		ok = 0;
+	}
+	if (ok && (rename(tmpPath, path) != 0)) {
+		AKMERROR_STR("rename");
+		ok = 0;
+	}
+	if (ok == 0) {
+		unlink(tmpPath);
+	}
+	return ok;
+}
+
+/*!
+ Write the values of \a table to a binary sidecar file. The file is
+ replaced atomically, see CommitFile().
+ @return 1 on success, otherwise 0.
+ @param[in] binPath The binary file.
+ @param[in] txtPath The text file holding the same values.
+ @param[in] table The values.
+ */
+static int16 SaveBinTable(
+	const char* binPath,
+	const char* txtPath,
+	const FILEIO_TABLE* table)
+{
+	FILEIO_BIN_HEADER hdr;
+	int32_t	vals[FILEIO_MAX_KEYS];
+	char	tmpPath[PATH_MAX];
+	int16	i, ret = 1;
+	FILE	*fp;
+
+	memset(&hdr, 0, sizeof(hdr));
+	if (StatSource(txtPath, &hdr.srcSize, &hdr.srcMtime) == 0) {
+		AKMERROR_STR("stat");
+		return 0;
+	}
+	for (i = 0; i < table->count; i++) {
+		vals[i] = table->kv[i].val;
+	}
+	memcpy(hdr.magic, FILEIO_BIN_MAGIC, sizeof(hdr.magic));
+	hdr.version = FILEIO_BIN_VERSION;
+	hdr.count = table->count;
+	hdr.keyCrc = TableKeyCrc(table);
+	hdr.crc = crc32(0, (const Bytef*)vals, hdr.count * sizeof(vals[0]));
+
+	if ((fp = OpenCommitFile(binPath, "wb", tmpPath, sizeof(tmpPath))) == NULL) {
+		return 0;
+	}
+	if ((fwrite(&hdr, sizeof(hdr), 1, fp) != 1) ||
+		(fwrite(vals, sizeof(vals[0]), hdr.count, fp) != hdr.count)) {
+		AKMERROR_STR("fwrite");
+		ret = 0;
+	}
+	return CommitFile(fp, tmpPath, binPath, ret);
+}
+
+/*!
+ Copy one value between a variable and \a table.
+ @param[in] load #AKD_TRUE to read the value from \a table, #AKD_FALSE to
+ append it to \a table.
+ */
+static int16 BindInt(FILEIO_TABLE* table, const char* key, int* val, int16 load)
+{
+	if (load) {
+		return LoadInt(table, key, val);
+	}
+	return TablePut(table, key, strlen(key), *val);
+}
+
+static int16 BindInt16vec(FILEIO_TABLE* table, const char* key, int16vec* vec, int16 load)
+{
+	char	keyName[KEYNAME_SIZE];
+	int16	ret = 1;
+
+	if (load) {
+		return LoadInt16vec(table, key, vec);
+	}
+	snprintf(keyName, sizeof(keyName), "%s.x", key);
+	ret = ret && TablePut(table, keyName, strlen(keyName), vec->u.x);
+	snprintf(keyName, sizeof(keyName), "%s.y", key);
+	ret = ret && TablePut(table, keyName, strlen(keyName), vec->u.y);
+	snprintf(keyName, sizeof(keyName), "%s.z", key);
+	ret = ret && TablePut(table, keyName, strlen(keyName), vec->u.z);
+	return ret;
+}
+
+static int16 BindInt32vec(FILEIO_TABLE* table, const char* key, int32vec* vec, int16 load)
+{
+	char	keyName[KEYNAME_SIZE];
+	int16	ret = 1;
+
+	if (load) {
+		return LoadInt32vec(table, key, vec);
+	}
+	snprintf(keyName, sizeof(keyName), "%s.x", key);
+	ret = ret && TablePut(table, keyName, strlen(keyName), vec->u.x);
+	snprintf(keyName, sizeof(keyName), "%s.y", key);
+	ret = ret && TablePut(table, keyName, strlen(keyName), vec->u.y);
+	snprintf(keyName, sizeof(keyName), "%s.z", key);
+	ret = ret && TablePut(table, keyName, strlen(keyName), vec->u.z);
+	return ret;
+}
 
-	ret = 1;
+/*!
+ The parameter file layout. The same list is used to load and to save, so
+ the text file, its binary sidecar and #AKSCPRMS always agree on the keys.
+ @param[in,out] prms Parameters, written when \a load is #AKD_TRUE.
+ @param[in,out] table Values, appended to when \a load is #AKD_FALSE.
+ @param[in] load Direction of the copy.
+ */
+static int16 BindParameters(AKSCPRMS* prms, FILEIO_TABLE* table, int16 load)
+{
+	int16	i, ret = 1;
+	int		tmp;
+	char	keyName[KEYNAME_SIZE];
 
-	// Load data to HDST, HO, HREF, THRE
+	// HDST, HO, HREF, THRE
 	for (i = 0; i < CSPEC_NUM_FORMATION; i++) {
 		snprintf(keyName, sizeof(keyName), "HSUC_HDST_FORM%d", i);
-		tmp = 0;
-		ret = ret && LoadInt(fp, keyName, &tmp);
-		prms->HSUC_HDST[i] = (AKSC_HDST)tmp;
+		tmp = (int)prms->HSUC_HDST[i];
+		ret = ret && BindInt(table, keyName, &tmp, load);
+		if (load) {
+			prms->HSUC_HDST[i] = (AKSC_HDST)tmp;
+		}
 
 		snprintf(keyName, sizeof(keyName), "HSUC_HO_FORM%d", i);
-		ret = ret && LoadInt16vec(fp, keyName, &prms->HSUC_HO[i]);
+		ret = ret && BindInt16vec(table, keyName, &prms->HSUC_HO[i], load);
 
 		snprintf(keyName, sizeof(keyName), "HFLUCV_HREF_FORM%d", i);
-		ret = ret && LoadInt16vec(fp, keyName, &prms->HFLUCV_HREF[i]);
+		ret = ret && BindInt16vec(table, keyName, &prms->HFLUCV_HREF[i], load);
 
 		snprintf(keyName, sizeof(keyName), "HSUC_HBASE_FORM%d", i);
-		ret = ret && LoadInt32vec(fp, keyName, &prms->HSUC_HBASE[i]);
+		ret = ret && BindInt32vec(table, keyName, &prms->HSUC_HBASE[i], load);
 	}
 
 	// Offset of other sensors.
-	ret = ret && LoadInt16vec(fp, "AO", &prms->m_AO);
+	ret = ret && BindInt16vec(table, "AO", &prms->m_AO, load);
 
-	if (fclose(fp) != 0) {
-		AKMERROR_STR("fclose");
-		ret = 0;
+	return ret;
+}
+
+/*!
+ The PDC file layout. See BindParameters().
+ */
+static int16 BindPDC(AKSCPRMS* prms, FILEIO_TABLE* table, int16 load)
+{
+	int16	i, ret = 1;
+	int		tmp;
+	char	keyName[KEYNAME_SIZE];
+
+	for (i = 0; i < PDC_SIZE; i++) {
+		snprintf(keyName, sizeof(keyName), "HPRMS%d", i);
+		tmp = prms->m_pdc[i];
+		ret = ret && BindInt(table, keyName, &tmp, load);
+		if (load) {
+			prms->m_pdc[i] = (uint8)tmp;
+		}
 	}
+	return ret;
+}
 
+/*!
+ Load parameters from file which is specified with #CSPEC_SETTING_FILE.
+ The binary copy #CSPEC_SETTING_BIN_FILE is used when it is up to date,
+ otherwise the text file is parsed once and the binary copy is refreshed.
+ The parameters may be in any order in the text file.
+ @return If function fails, the return value is 0. When function fails, the
+ output is undefined. Therefore, parameters which are possibly overwritten
+ by this function should be initialized again. If function succeeds, the
+ return value is 1.
+ @param[out] prms A pointer to #AKSCPRMS structure. Loaded parameter is
+ stored to the member of this structure.
+ */
+int16 LoadParameters(AKSCPRMS * prms)
+{
+	FILEIO_TABLE	table;
+	int16	ret, fromText = 0;
+
+	/* The expected keys, the values are replaced below */
+	TableInit(&table);
+	if (BindParameters(prms, &table, AKD_FALSE) == 0) {
+		AKMERROR;
+		return 0;
+	}
+
+	if (LoadBinTable(CSPEC_SETTING_BIN_FILE, CSPEC_SETTING_FILE, &table) == 0) {
+		if (ParseTable(CSPEC_SETTING_FILE, &table, NULL, 0) == 0) {
+			AKMERROR;
+			return 0;
+		}
+		fromText = 1;
+	}
+
+	ret = BindParameters(prms, &table, AKD_TRUE);
 	if (ret == 0) {
 		AKMERROR;
+	} else if (fromText && !(g_opmode & OPMODE_REPLAY)) {
+		/* Keys in the binary file are in the order of BindParameters().
+		   A replayed recording must not touch the device files. */
+		TableInit(&table);
+		BindParameters(prms, &table, AKD_FALSE);
+		SaveBinTable(CSPEC_SETTING_BIN_FILE, CSPEC_SETTING_FILE, &table);
 	}
 	return ret;
 }
 
-/*! Load PDC from file named with #SETTING_PDC_FILE_NAME.
-  This function reads parameters from a beginning of the file line by line,
-  and check parameter name sequentially.
+/*! Load PDC from file named with #CSPEC_PDC_FILE, or from its binary copy
+  #CSPEC_PDC_BIN_FILE when that one is up to date. The first line of the
+  text file is a free text header.
 
   @return When function fails, the return value is 0. In that case, all
   related parameters, i.e. m_pdc and m_pdcptr, are initialized with 0.
 */
 int16 LoadPDC(AKSCPRMS* prms)
 {
-	int16   ret, i;
-	FILE*   fp;
-	char    keyName[KEYNAME_SIZE];
-	char    header[HEADER_SIZE];
-	int		tmp;
-
-	ret = 1;
+	FILEIO_TABLE	table;
+	char	header[HEADER_SIZE] = "(binary)";
+	int16	fromText = 0;
 
-	//Open setting file for read.
-	if((fp = fopen(CSPEC_PDC_FILE, "r")) == NULL){
-		AKMERROR_STR("fopen");
+	TableInit(&table);
+	if (BindPDC(prms, &table, AKD_FALSE) == 0) {
+		AKMERROR;
 		goto PDCREAD_FAILED;
 	}
 
-	//Read file header
-	if(fgets(header, sizeof(header), fp) == NULL){
-		AKMERROR_STR("fgets");
-		fclose(fp);
-		goto PDCREAD_FAILED;
+	if (LoadBinTable(CSPEC_PDC_BIN_FILE, CSPEC_PDC_FILE, &table) == 0) {
+		if (ParseTable(CSPEC_PDC_FILE, &table, header, sizeof(header)) == 0) {
+			AKMERROR;
+			goto PDCREAD_FAILED;
+		}
+		fromText = 1;
 	}
 
-	//Set loaded data to pdc.
-	for (i = 0; i<PDC_SIZE; i++) {
-		snprintf(keyName, sizeof(keyName), "HPRMS%d", i);
-		tmp = 0;
-		ret = ret && LoadInt(fp, keyName, &tmp);
-		prms->m_pdc[i] = (uint8)tmp;
-	}
-
-	if (fclose(fp) != 0) {
-		AKMERROR_STR("fclose");
-		goto PDCREAD_FAILED;
-	}
-
-	if(ret != 1){
+	if (BindPDC(prms, &table, AKD_TRUE) != 1) {
 		AKMERROR;
 		goto PDCREAD_FAILED;
 	}
+	if (fromText && !(g_opmode & OPMODE_REPLAY)) {
+		TableInit(&table);
+		BindPDC(prms, &table, AKD_FALSE);
+		SaveBinTable(CSPEC_PDC_BIN_FILE, CSPEC_PDC_FILE, &table);
+	}
 
 	// Set parameter's pointer.
 	prms->m_pdcptr = prms->m_pdc;
@@ -147,93 +533,91 @@ PDCREAD_FAILED:
 }
 
 /*!
- Load \c int type value from file. The name of parameter is specified with
- \a lpKeyName. If the name matches the beginning of read line, the string
- after #DELIMITER will converted to \c int type value.
+ Load \c int type value from a parsed file. The lookup starts after the
+ previous one, so reading the keys in file order costs one compare each.
  @return If function fails, the return value is 0. When function fails, the
  value @ val is not overwritten. If function succeeds, the return value is 1.
- @param[in] fp Pointer to \c FILE structure.
+ @param[in,out] table The parsed file.
  @param[in] lpKeyName The name of parameter.
  @param[out] val Pointer to \c int type value. Upon successful completion
  of this function, read value is copied to this variable.
  */
-int16 LoadInt(FILE * fp, const char *lpKeyName, int *val)
+int16 LoadInt(FILEIO_TABLE* table, const char *lpKeyName, int *val)
 {
-	char buf[KEYNAME_SIZE] = { '\0' };
-
-	// ATTENTION! %ns should be modified according to the size of buf.
-	if (fscanf(fp, "%63s" DELIMITER "%11d", buf, val) != 2) {
-		AKMERROR;
-		return 0;
-	}
-	// Compare the read parameter name with given name.
-	if (strncmp(buf, lpKeyName, sizeof(buf)) != 0) {
-		ALOGE("%s: strncmp (%s) error.", __FUNCTION__, lpKeyName);
-		return 0;
+	int16 i, n;
+
+	for (n = 0; n < table->count; n++) {
+		i = (table->hint + n) % table->count;
+		if (strncmp(table->kv[i].key, lpKeyName, KEYNAME_SIZE) == 0) {
+			*val = table->kv[i].val;
+			table->hint = i + 1;
+			return 1;
+		}
 	}
 
-	return 1;
+	ALOGE("%s: (%s) not found.", __FUNCTION__, lpKeyName);
+	return 0;
 }
 
 /*!
- Load \c int16vec type value from file and convert it to int16vec type
- structure. This function adds ".x", ".y" and ".z" to the last of parameter
- name and try to read value with combined name.
+ Load \c int16vec type value from a parsed file and convert it to int16vec
+ type structure. This function adds ".x", ".y" and ".z" to the last of
+ parameter name and try to read value with combined name.
  @return If function fails, the return value is 0. When function fails, the
  output is undefined. If function succeeds, the return value is 1.
- @param[in] fp A opened \c FILE pointer.
+ @param[in,out] table The parsed file.
  @param[in] lpKeyName The parameter name.
  @param[out] vec A pointer to int16vec structure. Upon successful completion
  of this function, read values are copied to this variable.
  */
-int16 LoadInt16vec(FILE * fp, const char *lpKeyName, int16vec * vec)
+int16 LoadInt16vec(FILEIO_TABLE* table, const char *lpKeyName, int16vec * vec)
 {
 	char	keyName[KEYNAME_SIZE];
 	int16	ret = 1;
 	int		tmp;
 
 	snprintf(keyName, sizeof(keyName), "%s.x", lpKeyName);
-	ret = ret && LoadInt(fp, keyName, &tmp);
+	ret = ret && LoadInt(table, keyName, &tmp);
 	vec->u.x = (int16)tmp;
 
 	snprintf(keyName, sizeof(keyName), "%s.y", lpKeyName);
-	ret = ret && LoadInt(fp, keyName, &tmp);
+	ret = ret && LoadInt(table, keyName, &tmp);
 	vec->u.y = (int16)tmp;
 
 	snprintf(keyName, sizeof(keyName), "%s.z", lpKeyName);
-	ret = ret && LoadInt(fp, keyName, &tmp);
+	ret = ret && LoadInt(table, keyName, &tmp);
 	vec->u.z = (int16)tmp;
 
 	return ret;
 }
 
 /*!
- Load \c int32vec type value from file and convert it to int32vec type
- structure. This function adds ".x", ".y" and ".z" to the last of parameter
- name and try to read value with combined name.
+ Load \c int32vec type value from a parsed file and convert it to int32vec
+ type structure. This function adds ".x", ".y" and ".z" to the last of
+ parameter name and try to read value with combined name.
  @return If function fails, the return value is 0. When function fails, the
  output is undefined. If function succeeds, the return value is 1.
- @param[in] fp A opened \c FILE pointer.
+ @param[in,out] table The parsed file.
  @param[in] lpKeyName The parameter name.
  @param[out] vec A pointer to int32vec structure. Upon successful completion
  of this function, read values are copied to this variable.
  */
-int16 LoadInt32vec(FILE * fp, const char *lpKeyName, int32vec * vec)
+int16 LoadInt32vec(FILEIO_TABLE* table, const char *lpKeyName, int32vec * vec)
 {
 	char	keyName[KEYNAME_SIZE];
 	int16	ret = 1;
 	int		tmp;
 
 	snprintf(keyName, sizeof(keyName), "%s.x", lpKeyName);
-	ret = ret && LoadInt(fp, keyName, &tmp);
+	ret = ret && LoadInt(table, keyName, &tmp);
 	vec->u.x = (int32)tmp;
 
 	snprintf(keyName, sizeof(keyName), "%s.y", lpKeyName);
-	ret = ret && LoadInt(fp, keyName, &tmp);
+	ret = ret && LoadInt(table, keyName, &tmp);
 	vec->u.y = (int32)tmp;
 
 	snprintf(keyName, sizeof(keyName), "%s.z", lpKeyName);
-	ret = ret && LoadInt(fp, keyName, &tmp);
+	ret = ret && LoadInt(table, keyName, &tmp);
 	vec->u.z = (int32)tmp;
 
 	return ret;
@@ -241,56 +625,48 @@ int16 LoadInt32vec(FILE * fp, const char *lpKeyName, int32vec * vec)
 
 
 /*!
- Save parameters to file which is specified with #CSPEC_SETTING_FILE. This
- function saves variables when the offsets of magnetic sensor estimated
- successfully.
+ Save parameters to file which is specified with #CSPEC_SETTING_FILE, and
+ to its binary copy #CSPEC_SETTING_BIN_FILE. This function saves variables
+ when the offsets of magnetic sensor estimated successfully. Both files are
+ replaced atomically, so this is safe to call while akmd may be killed.
+ Only if the files can't be replaced are they written in place, see
+ OpenCommitFile().
  @return If function fails, the return value is 0. When function fails, the
- parameter file may collapsed. Therefore, the parameters file should be
- discarded. If function succeeds, the return value is 1.
+ previous parameter file is kept. If function succeeds, the return value
+ is 1.
  @param[out] prms A pointer to #AKSCPRMS structure. Member variables are
  saved to the parameter file.
  */
 int16 SaveParameters(AKSCPRMS * prms)
 {
+	FILEIO_TABLE	table;
+	char	tmpPath[PATH_MAX];
 	int16	ret = 1;
 	int16	i;
 	FILE	*fp;
-	char	keyName[KEYNAME_SIZE];
 
-	//Open setting file for write.
-	if ((fp = fopen(CSPEC_SETTING_FILE, "w")) == NULL) {
-		AKMERROR_STR("fopen");
+	TableInit(&table);
+	if (BindParameters(prms, &table, AKD_FALSE) == 0) {
+		AKMERROR;
 		return 0;
 	}
 
-	for (i = 0; i < CSPEC_NUM_FORMATION; i++) {
-		snprintf(keyName, sizeof(keyName), "HSUC_HDST_FORM%d", i);
-		ret = ret && SaveInt(fp, keyName, (int)prms->HSUC_HDST[i]);
-
-		snprintf(keyName, sizeof(keyName), "HSUC_HO_FORM%d", i);
-		ret = ret && SaveInt16vec(fp, keyName, &prms->HSUC_HO[i]);
-
-		snprintf(keyName, sizeof(keyName), "HFLUCV_HREF_FORM%d", i);
-		ret = ret && SaveInt16vec(fp, keyName, &prms->HFLUCV_HREF[i]);
-
-		snprintf(keyName, sizeof(keyName), "HSUC_HBASE_FORM%d", i);
-		ret = ret && SaveInt32vec(fp, keyName, &prms->HSUC_HBASE[i]);
+	//Open setting file for write. It replaces the old one when complete.
+	fp = OpenCommitFile(CSPEC_SETTING_FILE, "w", tmpPath, sizeof(tmpPath));
+	if (fp == NULL) {
+		return 0;
 	}
 
-	// Offset of other sensors.
-	ret = ret && SaveInt16vec(fp, "AO", &prms->m_AO);
-
-	if (fclose(fp) != 0) {
-		AKMERROR_STR("fclose");
-		ret = 0;
-	}
-    if (chmod(CSPEC_SETTING_FILE, AKM_PERM) != 0) {
-		AKMERROR_STR("chmod");
-		ret = 0;
+	for (i = 0; i < table.count; i++) {
+		ret = ret && SaveInt(fp, table.kv[i].key, table.kv[i].val);
 	}
+	ret = CommitFile(fp, tmpPath, CSPEC_SETTING_FILE, ret);
 
 	if (ret == 0) {
 		AKMERROR;
+	} else if (SaveBinTable(CSPEC_SETTING_BIN_FILE, CSPEC_SETTING_FILE, &table) == 0) {
+		/* Not fatal, the text file is loaded instead */
+		AKMERROR;
 	}
 
 	return ret;
@@ -313,64 +689,3 @@ int16 SaveInt(FILE * fp, const char *lpKeyName, const int val)
 		return 1;
 	}
 }
-
-/*!
- Save parameters of int16vec type structure to file. This function adds
- ".x", ".y" and ".z" to the last of parameter name and save value with
- the combined name.
- @return If function fails, the return value is 0. When function fails, not
- all parameters are saved to file, i.e. parameters file may collapsed.
- If function succeeds, the return value is 1.
- @param[in] fp Pointer to \c FILE structure.
- @param[in] lpKeyName The name of paraemter.
- @param[in] vec Pointer to \c int16vec type structure.
- */
-int16 SaveInt16vec(FILE * fp, const char *lpKeyName,
-				   const int16vec * vec)
-{
-	int16 ret = 0;
-	char keyName[KEYNAME_SIZE];
-
-	ret = 1;
-	snprintf(keyName, sizeof(keyName), "%s.x", lpKeyName);
-	ret = ret && SaveInt(fp, keyName, vec->u.x);
-
-	snprintf(keyName, sizeof(keyName), "%s.y", lpKeyName);
-	ret = ret && SaveInt(fp, keyName, vec->u.y);
-
-	snprintf(keyName, sizeof(keyName), "%s.z", lpKeyName);
-	ret = ret && SaveInt(fp, keyName, vec->u.z);
-
-	return ret;
-}
-
-/*!
- Save parameters of int32vec type structure to file. This function adds
- ".x", ".y" and ".z" to the last of parameter name and save value with
- the combined name.
- @return If function fails, the return value is 0. When function fails, not
- all parameters are saved to file, i.e. parameters file may collapsed.
- If function succeeds, the return value is 1.
- @param[in] fp Pointer to \c FILE structure.
- @param[in] lpKeyName The name of paraemter.
- @param[in] vec Pointer to \c int32vec type structure.
- */
-int16 SaveInt32vec(FILE * fp, const char *lpKeyName,
-				   const int32vec * vec)
-{
-	int16 ret = 0;
-	char keyName[KEYNAME_SIZE];
-
-	ret = 1;
-	snprintf(keyName, sizeof(keyName), "%s.x", lpKeyName);
-	ret = ret && SaveInt(fp, keyName, vec->u.x);
-
-	snprintf(keyName, sizeof(keyName), "%s.y", lpKeyName);
-	ret = ret && SaveInt(fp, keyName, vec->u.y);
-
-	snprintf(keyName, sizeof(keyName), "%s.z", lpKeyName);
-	ret = ret && SaveInt(fp, keyName, vec->u.z);
-
-	return ret;
-}
-
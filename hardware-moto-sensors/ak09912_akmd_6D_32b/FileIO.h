@@ -35,8 +35,48 @@
 #define HEADER_SIZE     256
 #define DELIMITER		" = "
 
+/*! Maximum number of values in a parameter or PDC file */
+#define FILEIO_MAX_KEYS		64
+
+/*! Binary sidecar of a text parameter file. See #FILEIO_BIN_HEADER. */
+#define FILEIO_BIN_MAGIC	"AKMB"
+#define FILEIO_BIN_VERSION	1
+
 /*** Type declaration *********************************************************/
 
+/*! One "key = value" line of a text parameter file. */
+typedef struct _FILEIO_KV {
+	char	key[KEYNAME_SIZE];
+	int		val;
+} FILEIO_KV;
+
+/*!
+ The values of a parameter file, in file order. Lookups start after the
+ previous hit, so reading the keys in file order is a single pass.
+ */
+typedef struct _FILEIO_TABLE {
+	FILEIO_KV	kv[FILEIO_MAX_KEYS];
+	int16		count;
+	int16		hint;	/*!< Where the next lookup starts */
+} FILEIO_TABLE;
+
+/*!
+ Header of a binary sidecar file. It is followed by \a count int32 values,
+ in the order akmd saves the keys. The sidecar is only used while
+ the text file it was written with is unchanged, so the text file stays the
+ reference and can still be edited by hand.
+ */
+typedef struct _FILEIO_BIN_HEADER {
+	char	magic[4];	/*!< #FILEIO_BIN_MAGIC, not NUL terminated */
+	uint32	version;	/*!< #FILEIO_BIN_VERSION */
+	uint32	count;		/*!< Number of values */
+	uint32	keyCrc;		/*!< CRC-32 of the key names, NUL included */
+	int64_t	srcSize;	/*!< Size of the text file */
+	int64_t	srcMtime;	/*!< Modification time of the text file in ns */
+	uint32	crc;		/*!< CRC-32 of the values */
+	uint32	reserved;
+} FILEIO_BIN_HEADER;
+
 /*** Global variables *********************************************************/
 
 /*** Prototype of function ****************************************************/
@@ -45,19 +85,19 @@ int16 LoadParameters(AKSCPRMS* prms);
 int16 LoadPDC(AKSCPRMS* prms);
 
 int16 LoadInt(
-	FILE* lpFile,
+	FILEIO_TABLE* table,
 	const char* lpKeyName,
 	int* val
 );
 
 int16 LoadInt16vec(
-	FILE* lpFile,
+	FILEIO_TABLE* table,
 	const char* lpKeyName,
 	int16vec* vec
 );
 
 int16 LoadInt32vec(
-	FILE* lpFile,
+	FILEIO_TABLE* table,
 	const char* lpKeyName,
 	int32vec* vec
 );
@@ -70,17 +110,5 @@ int16 SaveInt(
 	const int val
 );
 
-int16 SaveInt16vec(
-	FILE* lpFile,
-	const char* lpKeyName,
-	const int16vec* vec
-);
-
-int16 SaveInt32vec(
-	FILE* lpFile,
-	const char* lpKeyName,
-	const int32vec* vec
-);
-
 #endif
 
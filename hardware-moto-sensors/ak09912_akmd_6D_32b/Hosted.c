@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2016 Motorola Mobility
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ Runs the measurement loop inside the sensor HAL instead of the akmd09912
+ daemon. The HAL starts and stops it when it needs magnetic data, feeds the
+ acceleration with ACCHAL_SetAccData() and gets the results back through a
+ callback, so they never go through the device driver.
+ */
+#include <pthread.h>
+
+#include "AKCommon.h"
+#include "AKMD_Driver.h"
+#include "DispMessage.h"
+#include "FileIO.h"
+#include "Hosted.h"
+#include "Measure.h"
+
+/* Global variable. See AKCommon.h file. */
+int g_stopRequest = 0;
+int g_opmode = 0;
+int g_dbgzone = 0;
+
+/* Static variable. */
+static AKSCPRMS s_prms;
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_cond = PTHREAD_COND_INITIALIZER;
+static int s_started = AKD_FALSE;	/*!< Measurement thread created */
+static int s_wanted = AKD_FALSE;	/*!< Measurement requested by the host */
+static HOSTED_RESULT_CALLBACK s_callback;
+static void* s_callbackCtx;
+/* Owned by the measurement thread */
+static int s_prepared = AKD_FALSE;	/*!< Device opened and fuse ROM read */
+
+/*!
+ Open the device and read the parameters which don't change until the device
+ is closed again.
+ @return #AKD_SUCCESS or #AKD_FAIL.
+ */
+static int16_t prepare(void)
+{
+	int16_t n;
+
+	Disp_StartMessage();
+	InitAKSCPRMS(&s_prms);
+
+	if (AKD_InitDevice() != AKD_SUCCESS) {
+		return AKD_FAIL;
+	}
+	if (AKD_WaitReady() != AKD_SUCCESS) {
+		goto PREPARE_FAIL;
+	}
+	/* The host calls Hosted_DelayChanged(); the delays are polled if not */
+	AKD_InitDelayEvent();
+	if ((AKD_GetLayout(&n) != AKD_SUCCESS) || (n < PAT1) || (PAT8 < n)) {
+		ALOGE("Magnetic sensor's layout is not specified.");
+		goto PREPARE_FAIL;
+	}
+	s_prms.m_hlayout = (AKMD_PATNO)n;
+	if (ReadFUSEROM(&s_prms) != AKRET_PROC_SUCCEED) {
+		goto PREPARE_FAIL;
+	}
+	LoadPDC(&s_prms);
+	return AKD_SUCCESS;
+
+PREPARE_FAIL:
+	AKD_DeinitDevice();
+	return AKD_FAIL;
+}
+
+/*!
+ The measurement thread. It lives as long as the process and runs the
+ measurement loop whenever the host wants it, so neither Hosted_Start() nor
+ Hosted_Stop() has to wait for the device. The device is opened here too,
+ as that may wait for the sensor hub to boot.
+ */
+static void* thread_main(void* args)
+{
+	(void)args;
+
+	while (AKD_TRUE) {
+		pthread_mutex_lock(&s_lock);
+		while (!s_wanted) {
+			pthread_cond_wait(&s_cond, &s_lock);
+		}
+		pthread_mutex_unlock(&s_lock);
+
+		if (!s_prepared) {
+			if (prepare() != AKD_SUCCESS) {
+				/* Give up until the next start */
+				ALOGE("Could not open the compass.");
+				pthread_mutex_lock(&s_lock);
+				s_wanted = AKD_FALSE;
+				pthread_mutex_unlock(&s_lock);
+				continue;
+			}
+			s_prepared = AKD_TRUE;
+			/* The host may have stopped meanwhile */
+			continue;
+		}
+
+		/* Read Parameters from file. */
+		if (LoadParameters(&s_prms) == 0) {
+			SetDefaultPRMS(&s_prms);
+		}
+		MeasureSNGLoop(&s_prms);
+		/* Write Parameters to file. */
+		SaveParameters(&s_prms);
+	}
+	return ((void*)0);
+}
+
+/*!
+ Start measuring. This only wakes the measurement thread. The device is
+ opened there on the first start and stays open. If it cannot be opened,
+ measuring stops, and the next start tries again.
+ @return #AKD_SUCCESS or #AKD_FAIL.
+ @param[in] callback Receives every result record.
+ @param[in] ctx Passed to \a callback.
+ */
+int16_t Hosted_Start(HOSTED_RESULT_CALLBACK callback, void* ctx)
+{
+	pthread_attr_t attr;
+	int16_t ret = AKD_SUCCESS;
+
+	pthread_mutex_lock(&s_lock);
+	s_callback = callback;
+	s_callbackCtx = ctx;
+	/* A loop which has not noticed a previous stop yet just goes on */
+	g_stopRequest = 0;
+	s_wanted = AKD_TRUE;
+	if (!s_started) {
+		pthread_t thread;
+
+		pthread_attr_init(&attr);
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+		if (pthread_create(&thread, &attr, thread_main, NULL) == 0) {
+			s_started = AKD_TRUE;
+		} else {
+			AKMERROR_STR("pthread_create");
+			s_wanted = AKD_FALSE;
+			ret = AKD_FAIL;
+		}
+		pthread_attr_destroy(&attr);
+	} else {
+		pthread_cond_signal(&s_cond);
+	}
+	pthread_mutex_unlock(&s_lock);
+	return ret;
+}
+
+/*!
+ Stop measuring. This returns without waiting for the measurement thread,
+ which may be blocked in a magnetometer read: WakeMeasureSNGLoop() cannot
+ interrupt that, so the loop only ends, and saves the calibration, once the
+ read completes. The callback is not called any more after this returns.
+ */
+void Hosted_Stop(void)
+{
+	pthread_mutex_lock(&s_lock);
+	if (s_wanted) {
+		s_wanted = AKD_FALSE;
+		g_stopRequest = 1;
+		WakeMeasureSNGLoop();
+	}
+	pthread_mutex_unlock(&s_lock);
+}
+
+/*!
+ Tell the measurement loop that the host has changed the delays of the
+ compass outputs, so that it reads them again. The loop doesn't poll them.
+ */
+void Hosted_DelayChanged(void)
+{
+	AKD_NotifyDelay();
+}
+
+/*!
+ Hand the measurement result to the host. See DispMessage.h.
+ */
+void Disp_MeasurementResultHook(AKSCPRMS* prms, const uint16 flag, uint8 *time)
+{
+	int rbuf[AKM_YPR_RECORD_SIZE];
+
+	Disp_MeasurementRecord(prms, flag, time, rbuf);
+	/* A read which completes after Hosted_Stop() is not reported */
+	pthread_mutex_lock(&s_lock);
+	if (s_wanted && s_callback) {
+		s_callback(rbuf, s_callbackCtx);
+	}
+	pthread_mutex_unlock(&s_lock);
+}
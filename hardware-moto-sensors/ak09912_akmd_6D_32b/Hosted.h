@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2016 Motorola Mobility
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AKMD_INC_HOSTED_H
+#define AKMD_INC_HOSTED_H
+
+#include "AKMD_Driver.h"
+
+/*** Constant definition ******************************************************/
+
+/*** Type declaration *********************************************************/
+
+/*!
+ Receives the measurement results when akmd runs inside another process.
+ It is called on the measurement thread with the Hosted.c lock held, so it
+ must not block, nor call Hosted_Start() or Hosted_Stop().
+ @param[in] rbuf One result record, as sent to the device driver by the daemon.
+ @param[in] ctx The pointer given to Hosted_Start().
+ */
+typedef void (*HOSTED_RESULT_CALLBACK)(const int rbuf[AKM_YPR_RECORD_SIZE], void* ctx);
+
+/*** Global variables *********************************************************/
+
+/*** Prototype of function ****************************************************/
+int16_t Hosted_Start(HOSTED_RESULT_CALLBACK callback, void* ctx);
+
+void Hosted_Stop(void);
+
+void Hosted_DelayChanged(void);
+
+#endif //AKMD_INC_HOSTED_H
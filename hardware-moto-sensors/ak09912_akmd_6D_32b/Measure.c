@@ -23,20 +23,20 @@
  ******************************************************************************/
 #include "AKCommon.h"
 #include "AKMD_Driver.h"
+#include "Checkpoint.h"
 #include "DispMessage.h"
 #include "FileIO.h"
 #include "Measure.h"
 #include "misc.h"
 
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
 
 #define ACC_ACQ_FLAG_POS	ACC_DATA_FLAG
 #define MAG_ACQ_FLAG_POS	MAG_DATA_FLAG
 #define FUSION_ACQ_FLAG_POS	FUSION_DATA_FLAG
-#define ACC_MES_FLAG_POS	8
-#define ACC_INT_FLAG_POS	9
-#define MAG_MES_FLAG_POS	10
-#define MAG_INT_FLAG_POS	11
-#define SETTING_FLAG_POS	12
 
 #define AKMD_MAG_MIN_INTERVAL	20000000	/*!< magnetometer interval */
 #define AKMD_ACC_MIN_INTERVAL	20000000	/*!< acceleration interval */
@@ -44,11 +44,36 @@
 #define AKMD_MAG_INTERVAL		50000000	/*!< magnetometer interval */
 #define AKMD_ACC_INTERVAL		50000000	/*!< acceleration interval */
 #define AKMD_FUSION_INTERVAL	20000000	/*!< fusion interval */
-#define AKMD_LOOP_MARGIN		3000000		/*!< Minimum sleep time */
 #define AKMD_SETTING_INTERVAL	500000000	/*!< Setting event interval */
 
+/*! Stages of the measurement loop, in the order they run when due together. */
+enum {
+	STAGE_SETTING = 0,	/*!< Interval update */
+	STAGE_MAG,			/*!< Magnetometer acquisition and offset estimation */
+	STAGE_ACC,			/*!< Accelerometer acquisition */
+	STAGE_FUSION,		/*!< Orientation calculation */
+	AKMD_NUM_STAGES
+};
+
+/*! A periodic stage of the measurement loop, driven by its own timer. */
+typedef struct _AKMD_STAGE {
+	const char*	name;		/*!< Name for logging */
+	int			fd;			/*!< timerfd */
+	int64_t		interval;	/*!< Period in ns, negative while disarmed */
+	uint32_t	runs;		/*!< Number of executions */
+	uint32_t	missed;		/*!< Deadlines merged into a late execution */
+	int64_t		total;		/*!< Total execution time in ns */
+	int64_t		worst;		/*!< Longest execution time in ns */
+} AKMD_STAGE;
+
 static FORM_CLASS* g_form = NULL;
 
+/*! Clock of the stage timers. CLOCK_BOOTTIME keeps counting in suspend. */
+static clockid_t s_stageClock = CLOCK_BOOTTIME;
+
+/*! eventfd to wake the measurement loop. It is kept open for the process. */
+static int s_wakeFd = -1;
+
 /*!
  This function open formation status device.
  @return Return 0 on success. Negative value on fail.
@@ -151,8 +176,9 @@ void SetDefaultPRMS(AKSCPRMS* prms)
 }
 
 /*!
- Get interval from device driver. This function will not resolve dependencies.
- Dependencies will be resolved in Sensor HAL.
+ Get interval from device driver, and resolve the measurement intervals
+ which the requested outputs depend on. The orientation output needs both
+ the magnetometer and the accelerometer to be measured at least as often.
  @param[out] acc_mes Accelerometer measurement timing.
  @param[out] mag_mes Magnetometer measurement timing.
  @param[out] acc_acq Accelerometer acquisition timing.
@@ -173,6 +199,8 @@ int16 GetInterval(
 	/* Negative value means the sensor is disabled.*/
 	int64_t delay[AKM_NUM_SENSORS];
 	int64_t acc_last_interval = 0;
+	int64_t mag_last_interval = 0;
+	BYTE mode = AKM_MODE_POWERDOWN;
 
 	if (AKD_GetDelay(delay) != AKD_SUCCESS) {
 		return AKRET_PROC_FAIL;
@@ -181,26 +209,14 @@ int16 GetInterval(
 	AKMDEBUG(AKMDBG_GETINTERVAL,"delay=%lld,%lld,%lld\n",
 		delay[0], delay[1], delay[2]);
 
-#if 0
-#ifdef AKMD_ACC_EXTERNAL
-	/* Always disabled */
-	delay[0] = -1;
-#else
 	/* Accelerometer's interval limit */
 	if ((0 <= delay[0]) && (delay[0] <= AKMD_ACC_MIN_INTERVAL)) {
 		delay[0] = AKMD_ACC_MIN_INTERVAL;
-	}    
-#endif
-#endif
-	/* Magnetmeter's frequency should be discrete value */
-	if (0 <= delay[1]) {
-		GetHDOEDecimator(&(delay[1]), hdoe_dec);
-	}    
-#if 0
+	}
 	/* Fusion sensor's interval limit */
 	if ((0 <= delay[2]) && (delay[2] <= AKMD_FUSION_MIN_INTERVAL)) {
 		delay[2] = AKMD_FUSION_MIN_INTERVAL;
-	}    
+	}
 
 	if ((delay[0] != acc_acq->interval) ||
 			(delay[1] != mag_acq->interval) ||
@@ -208,6 +224,7 @@ int16 GetInterval(
 
 		/* reserve previous value */
 		acc_last_interval = acc_mes->interval;
+		mag_last_interval = mag_mes->interval;
 
 		/* Copy new value */
 		acc_acq->duration = acc_acq->interval = delay[0];
@@ -240,6 +257,24 @@ int16 GetInterval(
 			}
 		}
 
+		/* Magnetmeter's frequency should be discrete value */
+		if (0 <= mag_mes->interval) {
+			GetHDOEDecimator(&(mag_mes->interval), hdoe_dec, &mode);
+		}
+
+#if AKMD_CONT_MEASURE
+		/* The device keeps measuring at the selected rate, and each
+		 acquisition only reads the latest data-ready sample. */
+		if (mag_last_interval != mag_mes->interval) {
+			if (AKD_SetMode(mode) != AKD_SUCCESS) {
+				AKMERROR;
+				return AKRET_PROC_FAIL;
+			}
+		}
+#else
+		(void)mag_last_interval;
+#endif
+
 		if (acc_last_interval != acc_mes->interval) {
 			if (acc_mes->interval >= 0) {
 				/* Acc is enabled */
@@ -248,7 +283,7 @@ int16 GetInterval(
 					return AKRET_PROC_FAIL;
 				}
 				/* Then set interval */
-				if (AKD_AccSetDelay(acc_acq->interval) != AKD_SUCCESS) {
+				if (AKD_AccSetDelay(acc_mes->interval) != AKD_SUCCESS) {
 					AKMERROR;
 					return AKRET_PROC_FAIL;
 				}
@@ -269,34 +304,246 @@ int16 GetInterval(
 				mag_acq->interval, acc_acq->interval, fusion_acq->interval,
 				mag_mes->interval, acc_mes->interval);
 	}
-#endif
 
 	return AKRET_PROC_SUCCEED;
 }
 
 /*!
- Calculate loop duration
- @return If it is time to fire the event, the return value is 1, otherwise 0.
- @param[in,out] tm An event.
- @param[in] execTime The time to execute main loop for one time.
- @param[in,out] minDuration The minimum sleep time in all events.
+ Get the current time of the stage timers.
+ @return The current time in nano second.
+ */
+static int64_t stageNow(void)
+{
+	struct timespec now = { 0, 0 };
+
+	clock_gettime(s_stageClock, &now);
+	return timespec_to_int64(&now);
+}
+
+/*!
+ Create the timer of a stage. The timer is disarmed until armStage() is
+ called.
+ @return Return 0 on success. Negative value on fail.
+ @param[out] stage The stage to be initialized.
+ @param[in] name The name of the stage, for logging.
+ */
+static int openStage(AKMD_STAGE* stage, const char* name)
+{
+	memset(stage, 0, sizeof(AKMD_STAGE));
+	stage->name = name;
+	stage->interval = -1;
+
+	stage->fd = timerfd_create(s_stageClock, TFD_NONBLOCK | TFD_CLOEXEC);
+	if ((stage->fd < 0) && (errno == EINVAL) &&
+			(s_stageClock != CLOCK_MONOTONIC)) {
+		/* Older kernels have no CLOCK_BOOTTIME timers */
+		s_stageClock = CLOCK_MONOTONIC;
+		stage->fd = timerfd_create(s_stageClock, TFD_NONBLOCK | TFD_CLOEXEC);
+	}
+	if (stage->fd < 0) {
+		AKMERROR_STR("timerfd_create");
+		return -1;
+	}
+	return 0;
+}
+
+/*!
+ Close the timer of a stage, and log how long the stage took to execute.
+ @param[in,out] stage The stage to be closed.
+ */
+static void closeStage(AKMD_STAGE* stage)
+{
+	if (stage->fd < 0) {
+		return;
+	}
+	if (stage->runs > 0) {
+		ALOGI("%s: %u runs (%u late), exec avg %lld us, max %lld us",
+				stage->name, stage->runs, stage->missed,
+				(long long)((stage->total / stage->runs) / 1000),
+				(long long)(stage->worst / 1000));
+	}
+	close(stage->fd);
+	stage->fd = -1;
+}
+
+/*!
+ Set the period of a stage. Deadlines are absolute, so the period does not
+ drift with the time spent in the loop. The first deadline is now, i.e. a
+ stage which has just been enabled runs right away. If the period has not
+ changed, the timer is left alone.
+ @return Return 0 on success. Negative value on fail.
+ @param[in,out] stage The stage to be armed.
+ @param[in] interval The period in nano second. Negative value disarms the
+ timer.
+ */
+static int armStage(AKMD_STAGE* stage, int64_t interval)
+{
+	struct itimerspec its;
+
+	if (interval == stage->interval) {
+		return 0;
+	}
+
+	memset(&its, 0, sizeof(its));
+	if (interval > 0) {
+		its.it_value = int64_to_timespec(stageNow());
+		its.it_interval = int64_to_timespec(interval);
+	}
+	if (timerfd_settime(stage->fd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+		AKMERROR_STR("timerfd_settime");
+		return -1;
+	}
+
+	AKMDEBUG(AKMDBG_EXECTIME, "%s: interval=%lld\n",
+			stage->name, (long long)interval);
+	stage->interval = interval;
+	return 0;
+}
+
+/*!
+ Account the execution time of a stage.
+ @param[in,out] stage The stage which has been executed.
+ @param[in] begin The time when the stage has started, in nano second.
+ */
+static void endStage(AKMD_STAGE* stage, int64_t begin)
+{
+	int64_t execTime = stageNow() - begin;
+
+	stage->runs++;
+	stage->total += execTime;
+	if (execTime > stage->worst) {
+		stage->worst = execTime;
+	}
+
+	AKMDEBUG(AKMDBG_EXECTIME, "%s(%6.2f)\n",
+			stage->name, (double)execTime / 1000000.0);
+}
+
+/*!
+ Sleep until at least one stage is due, the requested delays change, or
+ WakeMeasureSNGLoop() is called.
+ @return A bit mask of the due stages. A delay change makes the setting stage
+ due. It may be 0 when the sleep has been interrupted. Negative value on fail.
+ @param[in,out] stages The array of #AKMD_NUM_STAGES stages.
+ @param[in] eventFd The delay change event file descriptor, or -1.
+ */
+static int waitStages(AKMD_STAGE stages[], int eventFd)
+{
+	struct pollfd fds[AKMD_NUM_STAGES + 2];
+	uint64_t expirations;
+	int due = 0;
+	int i;
+
+	for (i = 0; i < AKMD_NUM_STAGES; i++) {
+		fds[i].fd = stages[i].fd;
+		fds[i].events = POLLIN;
+		fds[i].revents = 0;
+	}
+	/* Negative descriptors are ignored by poll */
+	fds[AKMD_NUM_STAGES].fd = eventFd;
+	fds[AKMD_NUM_STAGES].events = POLLIN;
+	fds[AKMD_NUM_STAGES].revents = 0;
+	fds[AKMD_NUM_STAGES + 1].fd = s_wakeFd;
+	fds[AKMD_NUM_STAGES + 1].events = POLLIN;
+	fds[AKMD_NUM_STAGES + 1].revents = 0;
+
+	if (poll(fds, AKMD_NUM_STAGES + 2, -1) < 0) {
+		if (errno == EINTR) {
+			return 0;
+		}
+		AKMERROR_STR("poll");
+		return -1;
+	}
+
+	for (i = 0; i < AKMD_NUM_STAGES; i++) {
+		if (!(fds[i].revents & POLLIN)) {
+			continue;
+		}
+		/* Fails with EAGAIN if the timer has been re-armed meanwhile */
+		if (read(stages[i].fd, &expirations, sizeof(expirations))
+				!= sizeof(expirations)) {
+			continue;
+		}
+		/* A late stage runs once, not once per missed deadline */
+		if (expirations > 1) {
+			stages[i].missed += (uint32_t)(expirations - 1);
+		}
+		due |= (1 << i);
+	}
+
+	/* Cleared before the delays are read, so that a change made while
+	 they are read raises it again */
+	if (fds[AKMD_NUM_STAGES].revents & POLLIN) {
+		read(eventFd, &expirations, sizeof(expirations));
+		due |= (1 << STAGE_SETTING);
+	}
+	if (fds[AKMD_NUM_STAGES + 1].revents & POLLIN) {
+		read(s_wakeFd, &expirations, sizeof(expirations));
+	}
+	return due;
+}
+
+/*!
+ Arm the data stages with the resolved measurement intervals. When no output
+ is requested at all, the loop goes idle: the magnetometer is powered down
+ and nothing is read from the devices until a consumer appears.
+ The accelerometer stage only serves the acceleration output. The fusion
+ stage reads the acceleration it needs itself, at the magnetic data time.
+ @return Return 0 on success. Negative value on fail.
+ @param[in,out] stages The array of #AKMD_NUM_STAGES stages.
+ @param[in] mag_mes Magnetometer measurement timing.
+ @param[in] acc_acq Accelerometer acquisition timing.
+ @param[in] fusion_acq Orientation sensor acquisition timing.
+ @param[in,out] idle 1 while the loop is idle, otherwise 0.
  */
-int SetLoopTime(
-	AKMD_LOOP_TIME* tm,
-	int64_t execTime,
-	int64_t* minDuration)
+static int scheduleStages(
+	AKMD_STAGE stages[],
+	const AKMD_LOOP_TIME* mag_mes,
+	const AKMD_LOOP_TIME* acc_acq,
+	const AKMD_LOOP_TIME* fusion_acq,
+	int* idle)
 {
-	int ret = 0;
-	if (tm->interval >= 0) {
-		tm->duration -= execTime;
-		if (tm->duration <= AKMD_LOOP_MARGIN) {
-			tm->duration = tm->interval;
-			ret = 1;
-		} else if (tm->duration < *minDuration) {
-			*minDuration = tm->duration;
+	int nowIdle;
+
+	if ((armStage(&stages[STAGE_MAG], mag_mes->interval) < 0) ||
+		(armStage(&stages[STAGE_ACC], acc_acq->interval) < 0) ||
+		(armStage(&stages[STAGE_FUSION], fusion_acq->interval) < 0)) {
+		return -1;
+	}
+
+	nowIdle = (mag_mes->interval < 0) && (acc_acq->interval < 0) &&
+		(fusion_acq->interval < 0);
+	if (nowIdle == *idle) {
+		return 0;
+	}
+	*idle = nowIdle;
+
+	if (nowIdle) {
+		AKMDEBUG(AKMDBG_EXECTIME, "Idle.\n");
+		/* The device is left as at the end of a measurement session, so
+		 it is resumed the same way as when a session starts. */
+		if (AKD_SetMode(AKM_MODE_POWERDOWN) != AKD_SUCCESS) {
+			AKMERROR;
 		}
+	} else {
+		AKMDEBUG(AKMDBG_EXECTIME, "Resumed.\n");
+	}
+	return 0;
+}
+
+/*!
+ Wake the measurement loop, so that it notices #g_stopRequest without
+ waiting for its next deadline. A magnetometer read in progress is not
+ interrupted; the loop notices the request once the read returns.
+ This function is async-signal-safe.
+ */
+void WakeMeasureSNGLoop(void)
+{
+	uint64_t one = 1;
+
+	if (s_wakeFd >= 0) {
+		write(s_wakeFd, &one, sizeof(one));
 	}
-	return ret;
 }
 
 /*!
@@ -417,7 +664,9 @@ int16 Init_Measure(AKSCPRMS* prms)
 
 
 /*!
- This is the main routine of measurement.
+ This is the main routine of measurement. Magnetometer acquisition,
+ accelerometer acquisition and orientation calculation each run on their own
+ timer, at the interval requested for them, and only when they are due.
  @param[in,out] prms A pointer to a #AKSCPRMS structure.
  */
 void MeasureSNGLoop(AKSCPRMS* prms)
@@ -440,29 +689,34 @@ void MeasureSNGLoop(AKSCPRMS* prms)
 	AKMD_LOOP_TIME mag_mes = { -1, 0 };
 	/* Acceleration acquisition interval */
 	AKMD_LOOP_TIME acc_mes = { -1, 0 };
-	/* Magnetic measurement interval */
-	AKMD_LOOP_TIME mag_int = { AKM_MEASUREMENT_TIME_NS, 0 };
-	/* Setting interval */
-	AKMD_LOOP_TIME setting = { AKMD_SETTING_INTERVAL, 0 };
 
 	/* 0x0001: Acceleration execute flag (data output) */
 	/* 0x0002: Magnetic execute flag (data output) */
 	/* 0x0004: Fusion execute flag (data output) */
-	/* 0x0100: Magnetic measurement flag */
-	/* 0x0200: Magnetic interrupt flag */
-	/* 0x0400: Acceleration measurement flag */
-	/* 0x0800: Acceleration interrupt flag */
-	/* 0x0400: Setting execute flag */
 	uint16 exec_flags;
 
-#if 0
-	struct timespec currTime = { 0, 0 }; /* Current time */
-	struct timespec lastTime = { 0, 0 }; /* Previous time */
+	AKMD_STAGE stages[AKMD_NUM_STAGES];
+	int64_t begin;
+	int due;
+	int idle = 0;
+	int eventFd = AKD_GetDelayEventFd();
+	uint64_t changes;
+	int64_t magTime = 0;	/* Timestamp of the latest magnetic data */
+	int64_t startTime = stageNow();
+	int highLogged = 0;
+
+	for (i = 0; i < AKMD_NUM_STAGES; i++) {
+		stages[i].fd = -1;
+	}
+	memset(timestamp, 0, sizeof(timestamp));
 
-	int64_t execTime; /* Time between two points */
-	int64_t minVal; /* The minimum duration to the next event */
-	int measuring = 0; /* The value is 1, if while measuring. */
-#endif
+	if (s_wakeFd < 0) {
+		s_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (s_wakeFd < 0) {
+			AKMERROR_STR("eventfd");
+			return;
+		}
+	}
 
 	if (openForm() < 0) {
 		AKMERROR;
@@ -474,6 +728,20 @@ void MeasureSNGLoop(AKSCPRMS* prms)
 		goto MEASURE_SNG_END;
 	}
 
+	Checkpoint_Start(prms);
+
+	if ((openStage(&stages[STAGE_SETTING], "setting") < 0) ||
+		(openStage(&stages[STAGE_MAG], "mag") < 0) ||
+		(openStage(&stages[STAGE_ACC], "acc") < 0) ||
+		(openStage(&stages[STAGE_FUSION], "fusion") < 0)) {
+		goto MEASURE_SNG_END;
+	}
+
+	/* Changes made so far are covered by the initial read */
+	if (eventFd >= 0) {
+		read(eventFd, &changes, sizeof(changes));
+	}
+
 	/* Get initial interva */
 	if (GetInterval(
 				&acc_mes, &mag_mes,
@@ -483,171 +751,136 @@ void MeasureSNGLoop(AKSCPRMS* prms)
 		goto MEASURE_SNG_END;
 	}
 
-#if 0
-	/* Beginning time */
-	if (clock_gettime(CLOCK_MONOTONIC, &currTime) < 0) {
-		AKMERROR;
+	/* Delays whose changes are notified are not polled; the setting stage
+	 then only runs when the event is raised. See AKD_InitDelayEvent(). */
+	if ((eventFd < 0) &&
+		(armStage(&stages[STAGE_SETTING], AKMD_SETTING_INTERVAL) < 0)) {
+		goto MEASURE_SNG_END;
+	}
+	if (scheduleStages(stages, &mag_mes, &acc_acq, &fusion_acq, &idle) < 0) {
 		goto MEASURE_SNG_END;
 	}
-#endif
-
 
-	//TODO: Define stop flag
 	while (g_stopRequest != 1) {
-#if 0
-	        exec_flags = 0;
-		minVal = 1000000000; /*1sec*/
-
-		/* Copy the last time */
-		lastTime = currTime;
-
-		/* Get current time */
-		if (clock_gettime(CLOCK_MONOTONIC, &currTime) < 0) {
-			AKMERROR;
+		/* Sleep until the nearest deadline */
+		due = waitStages(stages, eventFd);
+		if (due < 0) {
 			break;
 		}
+		AKMDEBUG(AKMDBG_EXECTIME, "Due=0x%02X\n", due);
+
+		exec_flags = 0;
+
+		if (due & (1 << STAGE_SETTING)) {
+			begin = stageNow();
+			/* Get measurement interval from device driver */
+			if (GetInterval(
+					&acc_mes, &mag_mes,
+					&acc_acq, &mag_acq, &fusion_acq,
+					&hdoe_interval) == AKRET_PROC_SUCCEED) {
+				/* Re-arm the stages whose interval has changed */
+				scheduleStages(stages, &mag_mes, &acc_acq, &fusion_acq,
+						&idle);
+			}
+			endStage(&stages[STAGE_SETTING], begin);
+		}
 
-		/* Calculate the difference */
-		execTime = CalcDuration(&currTime, &lastTime);
-
-		AKMDEBUG(AKMDBG_EXECTIME,
-				"Executing(%6.2f)\n", (double)execTime / 1000000.0);
-
-		/* Subtract the differential time from each event.
-		 If subtracted value is negative turn event flag on. */
-		exec_flags |= (SetLoopTime(&setting, execTime, &minVal)
-					   << (SETTING_FLAG_POS));
-
-		exec_flags |= (SetLoopTime(&acc_acq, execTime, &minVal)
-					   << (ACC_ACQ_FLAG_POS));
-
-		exec_flags |= (SetLoopTime(&mag_acq, execTime, &minVal)
-					   << (MAG_ACQ_FLAG_POS));
-
-		exec_flags |= (SetLoopTime(&fusion_acq, execTime, &minVal)
-					   << (FUSION_ACQ_FLAG_POS)); 
-
-		exec_flags |= (SetLoopTime(&acc_mes, execTime, &minVal)
-					   << (ACC_MES_FLAG_POS));
-
-		/* Magnetometer needs special care. While the device is
-		 under measuring, measurement start flag should not be turned on.*/
-		if (mag_mes.interval >= 0) {
-			mag_mes.duration -= execTime;
-			if (!measuring) {
-				/* Not measuring */
-				if (mag_mes.duration <= AKMD_LOOP_MARGIN) {
-					exec_flags |= (1 << (MAG_MES_FLAG_POS));
-				} else if (mag_mes.duration < minVal) {
-					minVal = mag_mes.duration;
-				}
+		if ((due & (1 << STAGE_MAG)) && (mag_mes.interval >= 0)) {
+			begin = stageNow();
+			/* Get magnetometer measurement data */
+			if (AKD_GetMagneticData(i2cData) != AKD_SUCCESS) {
+				AKMERROR;
+				// Reset driver
+				AKD_Reset();
 			} else {
-				/* While measuring */
-				mag_int.duration -= execTime;
-				/* NO_MARGIN! */
-				if (mag_int.duration <= 0) {
-					exec_flags |= (1 << (MAG_INT_FLAG_POS));
-				} else if (mag_int.duration < minVal) {
-					minVal = mag_int.duration;
+				// Copy to local variable
+				for (i=0; i<AKM_SENSOR_DATA_SIZE; i++) {
+					bData[i] = i2cData[i];
 				}
-			}
-		}
+				for (i=0; i<AKM_SENSOR_TIME_SIZE; i++) {
+					timestamp[i] = i2cData[i + AKM_SENSOR_DATA_SIZE];
+				}
+				memcpy(&magTime, timestamp, sizeof(magTime));
 
-		/* If all flag is off, go sleep */
-		if (exec_flags == 0) {
-			AKMDEBUG(AKMDBG_EXECTIME, "Sleeping(%6.2f)...\n",
-					(double)minVal / 1000000.0);
-			if (minVal > 0) {
-				struct timespec doze = { 0, 0 };
-				doze = int64_to_timespec(minVal);
-				nanosleep(&doze, NULL);
-			}
-		} else {
-			AKMDEBUG(AKMDBG_EXECTIME, "ExecFlags=0x%04X\n", exec_flags);
+				ret = GetMagneticVector(
+						bData,
+						prms,
+						checkForm(),
+						hdoe_interval);
 
-			if (exec_flags & (1 << (MAG_MES_FLAG_POS))) {
-				/* Set to SNG measurement pattern (Set CNTL register) */
-				if (AKD_SetMode(AKM_MODE_SNG_MEASURE) != AKD_SUCCESS) {
-					AKMERROR;
-				} else {
-					mag_mes.duration = mag_mes.interval;
-					mag_int.duration = mag_int.interval;
-					measuring = 1;
+				// Check the return value
+				if ((ret != AKRET_PROC_SUCCEED) && (ret != AKRET_FORMATION_CHANGED)) {
+					ALOGE("GetMagneticVector has failed (0x%04X).\n", ret);
 				}
-			}
-#endif
 
-//			if (exec_flags & (1 << (MAG_INT_FLAG_POS))) {
-				/* Get magnetometer measurement data */
-				if (AKD_GetMagneticData(i2cData) != AKD_SUCCESS) {
-					AKMERROR;
-					// Reset driver
-					AKD_Reset();
-					// Unset flag
-					exec_flags &= ~(1 << (MAG_INT_FLAG_POS));
-				} else {
-					// Copy to local variable
-					for (i=0; i<AKM_SENSOR_DATA_SIZE; i++) {
-						bData[i] = i2cData[i];
-					}
-					for (i=0; i<AKM_SENSOR_TIME_SIZE; i++) {
-						timestamp[i] = i2cData[i + AKM_SENSOR_DATA_SIZE];
-					}
-
-					ret = GetMagneticVector(
-							bData,
-							prms,
-							checkForm(),
-							hdoe_interval);
-
-					// Check the return value
-					if ((ret != AKRET_PROC_SUCCEED) && (ret != AKRET_FORMATION_CHANGED)) {
-						ALOGE("GetMagneticVector has failed (0x%04X).\n", ret);
-					}
-
-					AKMDEBUG(AKMDBG_VECTOR, "mag(dec)=%6d,%6d,%6d\n",
-							prms->m_hvec.u.x, prms->m_hvec.u.y, prms->m_hvec.u.z);
+				AKMDEBUG(AKMDBG_VECTOR, "mag(dec)=%6d,%6d,%6d\n",
+						prms->m_hvec.u.x, prms->m_hvec.u.y, prms->m_hvec.u.z);
+
+				/* Save the calibration early, in case akmd doesn't exit
+				 cleanly. */
+				Checkpoint_Update(prms, begin);
+				if (!highLogged && (prms->m_hdst == AKSC_HDST_L2)) {
+					ALOGI("Accuracy high %lld ms after start",
+						(long long)((begin - startTime) / 1000000));
+					highLogged = 1;
 				}
-//				measuring = 0;
-//			}
 
-//			if (exec_flags & (1 << (ACC_MES_FLAG_POS))) {
-				/* Get accelerometer data */
-				if (AKD_GetAccelerationData(adata) != AKD_SUCCESS) {
-					AKMERROR;
-					break;
+				if (mag_acq.interval >= 0) {
+					exec_flags |= (1 << (MAG_ACQ_FLAG_POS));
 				}
+			}
+			endStage(&stages[STAGE_MAG], begin);
+		}
+
+		if ((due & (1 << STAGE_ACC)) && (acc_acq.interval >= 0)) {
+			begin = stageNow();
+			/* Get accelerometer data */
+			if (AKD_GetAccelerationData(adata) != AKD_SUCCESS) {
+				AKMERROR;
+			} else {
 				AKD_GetAccelerationVector(adata, prms->m_AO.v, prms->m_avec.v);
 
 				AKMDEBUG(AKMDBG_VECTOR, "acc(dec)=%6d,%6d,%6d\n",
 						prms->m_avec.u.x, prms->m_avec.u.y, prms->m_avec.u.z);
-//			}
 
-//			if (exec_flags & (1 << (FUSION_ACQ_FLAG_POS))) {
+				exec_flags |= (1 << (ACC_ACQ_FLAG_POS));
+			}
+			endStage(&stages[STAGE_ACC], begin);
+		}
+
+		if ((due & (1 << STAGE_FUSION)) && (fusion_acq.interval >= 0)) {
+			begin = stageNow();
+			/* The direction is calculated from the acceleration at the time
+			 of the magnetic data, not from whatever was read last. */
+			if (((magTime > 0) ?
+					AKD_GetAccelerationDataAt(magTime, adata) :
+					AKD_GetAccelerationData(adata)) != AKD_SUCCESS) {
+				AKMERROR;
+			} else {
+				AKD_GetAccelerationVector(adata, prms->m_AO.v, prms->m_avec.v);
+				/* Calculate direction angle */
 				if (CalcDirection(prms) != AKRET_PROC_SUCCEED) {
 					AKMERROR;
-				}   
-//			}
-
-			/* Calculate direction angle */
-//			if (exec_flags & 0x0F) {
-				/* If any ACQ flag is on, report the data to device driver */
-				Disp_MeasurementResultHook(prms, (uint16)(exec_flags & 0x0F), timestamp);
-//			}
-
-//			if (exec_flags & (1 << (SETTING_FLAG_POS))) {
-				/* Get measurement interval from device driver */
-				GetInterval(
-						&acc_mes, &mag_mes,
-						&acc_acq, &mag_acq, &fusion_acq,
-						&hdoe_interval);
-//			}
-#if 0
+				} else {
+					exec_flags |= (1 << (FUSION_ACQ_FLAG_POS));
+				}
+			}
+			endStage(&stages[STAGE_FUSION], begin);
+		}
+
+		if (exec_flags & 0x0F) {
+			/* If any ACQ flag is on, report the data to device driver */
+			Disp_MeasurementResultHook(prms, (uint16)(exec_flags & 0x0F), timestamp);
 		}
-#endif
 	}
 
 MEASURE_SNG_END:
+	Checkpoint_Stop();
+
+	for (i = 0; i < AKMD_NUM_STAGES; i++) {
+		closeStage(&stages[i]);
+	}
+
 	// Disable all sensors
 	if (AKD_SetMode(AKM_MODE_POWERDOWN) != AKD_SUCCESS) {AKMERROR;}
 	if (AKD_AccSetEnable(AKD_DISABLE)   != AKD_SUCCESS) {AKMERROR;}
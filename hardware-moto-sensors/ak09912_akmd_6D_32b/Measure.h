@@ -75,12 +75,6 @@ int16 GetInterval(
 	int16* hdoe_dec
 );
 
-int SetLoopTime(
-	AKMD_LOOP_TIME* tm,
-	int64_t execTime,
-	int64_t* minDuration
-);
-
 int16 ReadFUSEROM(
 	AKSCPRMS*	prms
 );
@@ -93,6 +87,8 @@ void MeasureSNGLoop(
 	AKSCPRMS*	prms
 );
 
+void WakeMeasureSNGLoop(void);
+
 int16 GetMagneticVector(
 	const int16	bData[],
 	AKSCPRMS*	prms,
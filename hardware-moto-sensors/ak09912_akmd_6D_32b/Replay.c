@@ -0,0 +1,292 @@
+/*
+ * Copyright (C) 2016 Motorola Mobility
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ AKMD_Driver.h on top of a recording instead of /dev/akm09912, so that the
+ measurement loop runs without the sensor hub. Link it in place of
+ AKMD_Driver.c and the Acc_*.c backends.
+
+ Every AKD_GetMagneticData() returns the next recorded sample, with its
+ recorded timestamp, and the acceleration calls return the acceleration
+ which was recorded with it. The loop paces itself with the delays from
+ AKD_GetDelay(), which are the recorded ones divided by the replay speed.
+ At the end of the recording g_stopRequest is set.
+ */
+#include <time.h>
+
+#include "AKCommon.h"
+#include "AKMD_Driver.h"
+#include "Replay.h"
+
+/* Static variable. */
+static const char* s_path = NULL;
+static int s_speed = 1;
+static FILE* s_file = NULL;
+static REPLAY_HEADER s_header;
+static REPLAY_RECORD s_record;		/*!< The sample returned last */
+static int64_t s_deliveryTime;		/*!< When s_record was returned */
+
+/*!
+ Select the recording which AKD_InitDevice() opens.
+ @return #AKD_SUCCESS or #AKD_FAIL.
+ @param[in] path The recording, see Replay.h.
+ @param[in] speed Replay speed, 1 for the recorded rate.
+ */
+int16_t REPLAY_SetSource(const char* path, int speed)
+{
+	if ((path == NULL) || (speed < 1)) {
+		AKMERROR;
+		return AKD_FAIL;
+	}
+	s_path = path;
+	s_speed = speed;
+	return AKD_SUCCESS;
+}
+
+/*!
+ Start again from the first sample.
+ @return #AKD_SUCCESS or #AKD_FAIL.
+ */
+int16_t REPLAY_Rewind(void)
+{
+	if ((s_file == NULL) || (fseek(s_file, sizeof(s_header), SEEK_SET) != 0)) {
+		AKMERROR;
+		return AKD_FAIL;
+	}
+	memset(&s_record, 0, sizeof(s_record));
+	return AKD_SUCCESS;
+}
+
+/*!
+ Get the time at which the latest sample was returned by
+ AKD_GetMagneticData(), i.e. when it would have arrived from the driver.
+ @return CLOCK_BOOTTIME in nano second.
+ */
+int64_t REPLAY_GetDeliveryTime(void)
+{
+	return s_deliveryTime;
+}
+
+/* Open the recording. See "AKMD_Driver.h" */
+int16_t AKD_InitDevice(void)
+{
+	if (s_file != NULL) {
+		return AKD_SUCCESS;
+	}
+	if (s_path == NULL) {
+		AKMERROR;
+		return AKD_FAIL;
+	}
+	if ((s_file = fopen(s_path, "rb")) == NULL) {
+		AKMERROR_STR("fopen");
+		return AKD_FAIL;
+	}
+	if ((fread(&s_header, sizeof(s_header), 1, s_file) != 1) ||
+		(memcmp(s_header.magic, REPLAY_MAGIC, sizeof(s_header.magic)) != 0) ||
+		(s_header.version != REPLAY_VERSION)) {
+		ALOGE("%s: %s is not a recording", __FUNCTION__, s_path);
+		AKD_DeinitDevice();
+		return AKD_FAIL;
+	}
+	memset(&s_record, 0, sizeof(s_record));
+	return AKD_SUCCESS;
+}
+
+/* Close the recording. See "AKMD_Driver.h" */
+void AKD_DeinitDevice(void)
+{
+	if (s_file != NULL) {
+		fclose(s_file);
+		s_file = NULL;
+	}
+}
+
+/* The registers are not recorded, writes are ignored. */
+int16_t AKD_TxData(
+		const BYTE address,
+		const BYTE * data,
+		const uint16_t numberOfBytesToWrite)
+{
+	(void)address;
+	(void)data;
+	(void)numberOfBytesToWrite;
+	return AKD_SUCCESS;
+}
+
+/* The registers are not recorded. */
+int16_t AKD_RxData(
+		const BYTE address,
+		BYTE * data,
+		const uint16_t numberOfBytesToRead)
+{
+	(void)address;
+	memset(data, 0, numberOfBytesToRead);
+	return AKD_FAIL;
+}
+
+int16_t AKD_Reset(void)
+{
+	return AKD_SUCCESS;
+}
+
+int16_t AKD_GetSensorInfo(BYTE data[AKM_SENSOR_INFO_SIZE])
+{
+	memcpy(data, s_header.info, AKM_SENSOR_INFO_SIZE);
+	return (s_file != NULL) ? AKD_SUCCESS : AKD_FAIL;
+}
+
+int16_t AKD_GetSensorConf(BYTE data[AKM_SENSOR_CONF_SIZE])
+{
+	memcpy(data, s_header.conf, AKM_SENSOR_CONF_SIZE);
+	return (s_file != NULL) ? AKD_SUCCESS : AKD_FAIL;
+}
+
+/*!
+ Get the next recorded sample. See "AKMD_Driver.h"
+ @return #AKD_FAIL at the end of the recording.
+ */
+int16_t AKD_GetMagneticData(BYTE data[AKM_SENSOR_DATA_SIZE])
+{
+	struct timespec now = { 0, 0 };
+
+	if ((s_file == NULL) ||
+		(fread(&s_record, sizeof(s_record), 1, s_file) != 1)) {
+		AKMDEBUG(AKMDBG_DEBUG, "%s: end of recording\n", __FUNCTION__);
+		g_stopRequest = 1;
+		return AKD_FAIL;
+	}
+	memcpy(data, s_record.mag, sizeof(s_record.mag));
+
+	clock_gettime(CLOCK_BOOTTIME, &now);
+	s_deliveryTime = (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+	return AKD_SUCCESS;
+}
+
+/* The results are not sent anywhere. */
+void AKD_SetYPR(const int buf[AKM_YPR_DATA_SIZE])
+{
+	(void)buf;
+}
+
+/* The recording is always open. */
+int16_t AKD_GetOpenStatus(int* status)
+{
+	*status = (s_file != NULL);
+	return AKD_SUCCESS;
+}
+
+int16_t AKD_GetCloseStatus(int* status)
+{
+	*status = 0;
+	return AKD_SUCCESS;
+}
+
+int16_t AKD_SetMode(const BYTE mode)
+{
+	(void)mode;
+	return AKD_SUCCESS;
+}
+
+/*!
+ Get the recorded delays, shortened by the replay speed. See "AKMD_Driver.h"
+ */
+int16_t AKD_GetDelay(int64_t delay[AKM_NUM_SENSORS])
+{
+	int i;
+
+	for (i = 0; i < AKM_NUM_SENSORS; i++) {
+		delay[i] = s_header.delay[i];
+		if (delay[i] > 0) {
+			delay[i] /= s_speed;
+		}
+	}
+	return (s_file != NULL) ? AKD_SUCCESS : AKD_FAIL;
+}
+
+/* Delays don't change, they are polled rarely. */
+int AKD_GetDelayEventFd(void)
+{
+	return -1;
+}
+
+int16_t AKD_GetLayout(int16_t* layout)
+{
+	*layout = s_header.layout;
+	return (s_file != NULL) ? AKD_SUCCESS : AKD_FAIL;
+}
+
+int16_t AKD_AccSetEnable(int8_t enabled)
+{
+	(void)enabled;
+	return AKD_SUCCESS;
+}
+
+int16_t AKD_AccSetDelay(int64_t delay)
+{
+	(void)delay;
+	return AKD_SUCCESS;
+}
+
+/*!
+ Get the acceleration recorded with the latest magnetic sample. It was
+ recorded after the scale conversion of the backend.
+ */
+int16_t AKD_GetAccelerationData(int16_t data[3])
+{
+	memcpy(data, s_record.acc, sizeof(s_record.acc));
+	return AKD_SUCCESS;
+}
+
+int16_t AKD_GetAccelerationDataAt(int64_t time, int16_t data[3])
+{
+	(void)time;
+	return AKD_GetAccelerationData(data);
+}
+
+int16_t AKD_GetAccelerationOffset(int16_t offset[3])
+{
+	offset[0] = 0;
+	offset[1] = 0;
+	offset[2] = 0;
+	return AKD_SUCCESS;
+}
+
+/* Same as the AOT and HAL backends. */
+void AKD_GetAccelerationVector(
+	const int16_t data[3],
+	const int16_t offset[3],
+	int16_t vec[3])
+{
+	vec[0] = (int16_t)(data[0] - offset[0]);
+	vec[1] = (int16_t)(data[1] - offset[1]);
+	vec[2] = (int16_t)(data[2] - offset[2]);
+}
+
+int16_t AKD_WaitReady(void)
+{
+	return (s_file != NULL) ? AKD_SUCCESS : AKD_FAIL;
+}
+
+/* A replay is not recorded again. */
+int16_t AKD_StartRecord(const char* path)
+{
+	(void)path;
+	return AKD_FAIL;
+}
+
+void AKD_StopRecord(void)
+{
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2016 Motorola Mobility
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AKMD_INC_REPLAY_H
+#define AKMD_INC_REPLAY_H
+
+#include "AKMD_Driver.h"
+
+/*** Constant definition ******************************************************/
+
+/*
+ A recording is a #REPLAY_HEADER followed by one #REPLAY_RECORD per magnetic
+ sample. It is written by AKD_StartRecord() (akmd09912 -r <file>) and read
+ back by Replay.c, which implements AKMD_Driver.h on top of it. Structures
+ are written in native byte order and layout, so a recording is replayed on
+ the same ABI it was made on.
+ */
+#define REPLAY_MAGIC	"AKMR"
+#define REPLAY_VERSION	1
+
+/*** Type declaration *********************************************************/
+
+typedef struct _REPLAY_HEADER {
+	char	magic[4];	/*!< #REPLAY_MAGIC, not NUL terminated */
+	uint32_t	version;	/*!< #REPLAY_VERSION */
+	int64_t	delay[AKM_NUM_SENSORS];	/*!< AKD_GetDelay() at the first sample */
+	int16_t	layout;		/*!< AKD_GetLayout() */
+	BYTE	info[AKM_SENSOR_INFO_SIZE];	/*!< AKD_GetSensorInfo() */
+	BYTE	conf[AKM_SENSOR_CONF_SIZE];	/*!< AKD_GetSensorConf() */
+} REPLAY_HEADER;
+
+typedef struct _REPLAY_RECORD {
+	/*! AKD_GetMagneticData(), register values and timestamp */
+	BYTE	mag[AKM_SENSOR_DATA_SIZE + AKM_SENSOR_TIME_SIZE];
+	/*! Latest AKD_GetAccelerationData() before the next magnetic sample */
+	int16_t	acc[3];
+} REPLAY_RECORD;
+
+/*** Global variables *********************************************************/
+
+/*** Prototype of function ****************************************************/
+int16_t REPLAY_SetSource(const char* path, int speed);
+
+int16_t REPLAY_Rewind(void);
+
+int64_t REPLAY_GetDeliveryTime(void);
+
+#endif //AKMD_INC_REPLAY_H
@@ -49,6 +49,7 @@ int g_mainQuit = AKD_FALSE;
 
 /* Static variable. */
 static pthread_t s_thread;	/*!< Thread handle */
+static const char* s_recordPath = NULL;	/*!< -r, see Replay.h */
 static FORM_CLASS s_formClass = {
 	.open  = misc_openForm,
 	.close = misc_closeForm,
@@ -71,6 +72,7 @@ static void signal_handler(int sig)
 		AKMERROR;
 		g_stopRequest = 1;
 		g_mainQuit = AKD_TRUE;
+		WakeMeasureSNGLoop();
 	}
 }
 
@@ -104,41 +106,9 @@ static int startClone(AKSCPRMS* prms)
  */
 void Disp_MeasurementResultHook(AKSCPRMS* prms, const uint16 flag, uint8 *time)
 {
-	int rbuf[AKM_YPR_DATA_SIZE + (AKM_SENSOR_TIME_SIZE / sizeof(int))] = { 0 };
-	int16vec rawmag;
-
-	/* Coordinate system is already converted to Android */
-	rbuf[0] = flag;				/* Data flag */
-	rbuf[1] = prms->m_avec.u.x;	/* Ax */
-	rbuf[2] = prms->m_avec.u.y;	/* Ay */
-	rbuf[3] = prms->m_avec.u.z;	/* Az */
-	rbuf[4] = 3;				/* Acc status */
-	rbuf[5] = prms->m_hvec.u.x;	/* Mx */
-	rbuf[6] = prms->m_hvec.u.y;	/* My */
-	rbuf[7] = prms->m_hvec.u.z;	/* Mz */
-	rbuf[8] = prms->m_hdst;		/* Mag status */
-	/* Orientation (Q6 format)*/
-	rbuf[9] = prms->m_theta;	/* yaw	(deprecate) */
-	rbuf[10] = prms->m_phi180;	/* pitch (deprecate) */
-	rbuf[11] = prms->m_eta90;	/* roll  (deprecate) */
-	/* Axis conversion, from AKSC to Android is done here */
-	/* RotVec (AKSC Q4 format deg/sec ) */
-	rbuf[12] = prms->m_quat.u.y;
-	rbuf[13] = prms->m_quat.u.x * (-1);
-	rbuf[14] = prms->m_quat.u.z * (-1);
-	rbuf[15] = prms->m_quat.u.w;
-
-	/* Get the uncalibrated reading */
-	rawmag.u.x = prms->m_hdata[0].u.x;
-	rawmag.u.y = prms->m_hdata[0].u.y;
-	rawmag.u.z = prms->m_hdata[0].u.z;
-	ConvertCoordinate(prms->m_hlayout, &rawmag);
-	rbuf[16] = rawmag.u.x;
-	rbuf[17] = rawmag.u.y;
-	rbuf[18] = rawmag.u.z;
-
-	memcpy(&rbuf[AKM_YPR_DATA_SIZE], time, AKM_SENSOR_TIME_SIZE);
+	int rbuf[AKM_YPR_RECORD_SIZE];
 
+	Disp_MeasurementRecord(prms, flag, time, rbuf);
 	AKD_SetYPR(rbuf);
 
 	if (g_opmode & OPMODE_CONSOLE) {
@@ -165,7 +135,7 @@ int OptParse(
 	/* Initial value */
 	*hlayout_patno = PAT_INVALID;
 
-	while ((opt = getopt(argc, argv, "sm:z:")) != -1) {
+	while ((opt = getopt(argc, argv, "sm:r:z:")) != -1) {
 		switch(opt){
 			case 'm':
 				optVal = (char)(optarg[0] - '0');
@@ -173,6 +143,9 @@ int OptParse(
 					*hlayout_patno = (AKMD_PATNO)optVal;
 				}
 				break;
+			case 'r':
+				s_recordPath = optarg;
+				break;
 			case 'z':
 				/* If error detected, hopefully 0 is returned. */
 				g_dbgzone = (int)strtol(optarg, (char**)NULL, 0);
@@ -259,6 +232,11 @@ int main(int argc, char **argv)
 	/* PDC */
 	LoadPDC(&prms);
 
+	/* Record the raw data for replay. The daemon runs without it on error. */
+	if ((s_recordPath != NULL) && (AKD_StartRecord(s_recordPath) != AKD_SUCCESS)) {
+		ALOGE("Can't record to %s", s_recordPath);
+	}
+
 	/* Here is the Main Loop */
 	if (g_opmode & OPMODE_CONSOLE) {
 		/*** Console Mode *********************************************/
@@ -335,6 +313,7 @@ int main(int argc, char **argv)
 				}
 				/* Wait thread completion. */
 				g_stopRequest = 1;
+				WakeMeasureSNGLoop();
 				pthread_join(s_thread, NULL);
 				AKMDEBUG(AKMDBG_DEBUG, "Compass Closed.");
 
@@ -347,6 +326,7 @@ int main(int argc, char **argv)
 THE_END_OF_MAIN_FUNCTION:
 
 	/* Close device driver. */
+	AKD_StopRecord();
 	AKD_DeinitDevice();
 
 	/* Show the last message. */
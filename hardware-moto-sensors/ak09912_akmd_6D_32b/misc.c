@@ -32,20 +32,21 @@ static int s_fdForm = -1; /*!< FD to formation detect device */
 struct AKMD_INTERVAL {
 	long interval; /*!< Measurement interval, 32-bit is enough for HDOE */
 	int16 decimator; /*!< HDOE decimator */
+	BYTE mode; /*!< The slowest continuous mode which is fast enough */
 };
 
 static struct AKMD_INTERVAL s_interval[] = {
-	 { 10000000, 10 }, /* 100Hz SENSOR_DELAY_FASTEST */
-	 { 16666667,  6 }, /*  60Hz */
-	 { 20000000,  5 }, /*  50Hz SENSOR_DELAY_GAME */
-	 { 25000000,  4 }, /*  40Hz */
-	 { 40000000,  3 }, /*  25Hz */
-	 { 50000000,  2 }, /*  20Hz */
-	 { 66667000,  2 }, /*  15Hz SENSOR_DELAY_UI */
-	{ 100000000,  1 }, /*  10Hz */
-	{ 125000000,  1 }, /*   8Hz */
-	{ 200000000,  1 }, /*   5Hz SENSOR_DELAY_NORMAL */
-	{1000000000,  1 }  /*   1Hz */
+	 { 10000000, 10, AKM_MODE_CONT4_MEASURE }, /* 100Hz SENSOR_DELAY_FASTEST */
+	 { 16666667,  6, AKM_MODE_CONT4_MEASURE }, /*  60Hz */
+	 { 20000000,  5, AKM_MODE_CONT3_MEASURE }, /*  50Hz SENSOR_DELAY_GAME */
+	 { 25000000,  4, AKM_MODE_CONT3_MEASURE }, /*  40Hz */
+	 { 40000000,  3, AKM_MODE_CONT3_MEASURE }, /*  25Hz */
+	 { 50000000,  2, AKM_MODE_CONT2_MEASURE }, /*  20Hz */
+	 { 66667000,  2, AKM_MODE_CONT2_MEASURE }, /*  15Hz SENSOR_DELAY_UI */
+	{ 100000000,  1, AKM_MODE_CONT1_MEASURE }, /*  10Hz */
+	{ 125000000,  1, AKM_MODE_CONT1_MEASURE }, /*   8Hz */
+	{ 200000000,  1, AKM_MODE_CONT1_MEASURE }, /*   5Hz SENSOR_DELAY_NORMAL */
+	{1000000000,  1, AKM_MODE_CONT1_MEASURE }  /*   1Hz */
 };
 
 /*!
@@ -100,7 +101,7 @@ struct timespec int64_to_timespec(int64_t val)
 {
 	struct timespec ret;
 	ret.tv_sec = (long) (val / 1000000000);
-	ret.tv_nsec = val - ret.tv_sec;
+	ret.tv_nsec = (long) (val % 1000000000);
 
 	return ret;
 }
@@ -112,7 +113,7 @@ struct timespec int64_to_timespec(int64_t val)
  */
 int64_t timespec_to_int64(struct timespec* val)
 {
-	return ((int64_t)(val->tv_sec * 1000000000) + (int64_t)val->tv_nsec);
+	return ((int64_t)val->tv_sec * 1000000000) + (int64_t)val->tv_nsec;
 }
 
 /*!
@@ -178,14 +179,16 @@ int openInputDevice(const char* name)
 }
 
 /*!
- Get valid measurement interval and HDOE decimator.
+ Get valid measurement interval, HDOE decimator and measurement mode.
  @return If this function succeeds, the return value is 1. Otherwise 0.
  @param[in,out] time Input a requirement of sensor measurement interval.
  The closest interval will be returned as output.
  @param[out] hdoe_interval When the output interval value is set to looper,
  this decimation value should be used to decimate the HDOE.
+ @param[out] mode The continuous measurement mode which produces a sample
+ at least every output interval.
  */
-int16 GetHDOEDecimator(int64_t* time, int16* hdoe_interval)
+int16 GetHDOEDecimator(int64_t* time, int16* hdoe_interval, BYTE* mode)
 {
 	const int n = (sizeof(s_interval) / sizeof(s_interval[0]));
 	int i;
@@ -196,6 +199,7 @@ int16 GetHDOEDecimator(int64_t* time, int16* hdoe_interval)
 	for (i = 0; i < n; i++) {
 		*time = s_interval[i].interval;
 		*hdoe_interval = s_interval[i].decimator;
+		*mode = s_interval[i].mode;
 		if (org <= *time) {
 			break;
 		}
@@ -50,7 +50,7 @@ int64_t timespec_to_int64(struct timespec* val);
 int64_t CalcDuration(struct timespec* begin, struct timespec* end);
 
 int openInputDevice(const char* name);
-int16 GetHDOEDecimator(int64_t* time, int16* hdoe_interval);
+int16 GetHDOEDecimator(int64_t* time, int16* hdoe_interval, BYTE* mode);
 
 int16 ConvertCoordinate(
 	const	AKMD_PATNO	pat,/*!< [in]  Convert Pattern Number */
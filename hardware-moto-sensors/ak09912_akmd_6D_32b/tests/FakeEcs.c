@@ -0,0 +1,419 @@
+/*
+ * Copyright (C) 2016 Motorola Mobility
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ A fake /dev/akm09912 for the tests. Link it in place of AKMD_Driver.c and
+ the Acc_*.c backends, like Replay.c. See FakeEcs.h.
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <time.h>
+
+#include "AKCommon.h"
+#include "AKCompass.h"
+#include "AKMD_Driver.h"
+#include "FakeEcs.h"
+
+/* Static variable. */
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_cond = PTHREAD_COND_INITIALIZER;
+static int s_hold = AKD_FALSE;		/*!< Reads block while set */
+static int s_holdReady = AKD_FALSE;	/*!< AKD_WaitReady() blocks while set */
+static int s_blocked = 0;			/*!< Reads blocked right now */
+static int s_loopEnds = 0;			/*!< Measurement loops ended so far */
+static int s_calls[FAKEECS_NUM_CALLS];	/*!< See FakeEcs_GetCalls() */
+/*! The requested delays, see FakeEcs_SetDelay() */
+static int64_t s_delay[AKM_NUM_SENSORS] = { -1, FAKEECS_MAG_DELAY, -1 };
+static int s_fdDelay = -1;			/*!< See AKD_InitDelayEvent() */
+
+/*!
+ Get the time after \a ms milliseconds, for pthread_cond_timedwait().
+ */
+static struct timespec deadline(int ms)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += ms / 1000;
+	ts.tv_nsec += (long)(ms % 1000) * 1000000L;
+	if (ts.tv_nsec >= 1000000000L) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+	return ts;
+}
+
+/*!
+ Count a call to the device, see FakeEcs_GetCalls().
+ */
+static void countCall(FAKEECS_CALL call)
+{
+	pthread_mutex_lock(&s_lock);
+	s_calls[call]++;
+	pthread_cond_broadcast(&s_cond);
+	pthread_mutex_unlock(&s_lock);
+}
+
+/*!
+ Make AKD_GetMagneticData() block, like a measurement which doesn't complete,
+ or release the blocked reads.
+ @param[in] hold #AKD_TRUE to block the reads.
+ */
+void FakeEcs_HoldReads(int hold)
+{
+	pthread_mutex_lock(&s_lock);
+	s_hold = hold;
+	pthread_cond_broadcast(&s_cond);
+	pthread_mutex_unlock(&s_lock);
+}
+
+/*!
+ Make AKD_WaitReady() block, like a sensor hub which doesn't boot, or release
+ it.
+ @param[in] hold #AKD_TRUE to block AKD_WaitReady().
+ */
+void FakeEcs_HoldReady(int hold)
+{
+	pthread_mutex_lock(&s_lock);
+	s_holdReady = hold;
+	pthread_cond_broadcast(&s_cond);
+	pthread_mutex_unlock(&s_lock);
+}
+
+/*!
+ Wait until a read is blocked by FakeEcs_HoldReads().
+ @return #AKD_TRUE, or #AKD_FALSE on timeout.
+ @param[in] timeoutMs The longest wait in milli second.
+ */
+int FakeEcs_WaitBlockedRead(int timeoutMs)
+{
+	struct timespec ts = deadline(timeoutMs);
+	int ret = 0;
+
+	pthread_mutex_lock(&s_lock);
+	while ((s_blocked == 0) && (ret != ETIMEDOUT)) {
+		ret = pthread_cond_timedwait(&s_cond, &s_lock, &ts);
+	}
+	ret = (s_blocked > 0) ? AKD_TRUE : AKD_FALSE;
+	pthread_mutex_unlock(&s_lock);
+	return ret;
+}
+
+/*!
+ Wait until \a count measurement loops have ended since the start of the
+ process. A loop disables the accelerometer when it ends; with only the
+ magnetometer requested, nothing else does.
+ @return #AKD_TRUE, or #AKD_FALSE on timeout.
+ @param[in] count See FakeEcs_GetLoopEnds().
+ @param[in] timeoutMs The longest wait in milli second.
+ */
+int FakeEcs_WaitLoopEnds(int count, int timeoutMs)
+{
+	struct timespec ts = deadline(timeoutMs);
+	int ret = 0;
+
+	pthread_mutex_lock(&s_lock);
+	while ((s_loopEnds < count) && (ret != ETIMEDOUT)) {
+		ret = pthread_cond_timedwait(&s_cond, &s_lock, &ts);
+	}
+	ret = (s_loopEnds >= count) ? AKD_TRUE : AKD_FALSE;
+	pthread_mutex_unlock(&s_lock);
+	return ret;
+}
+
+/*!
+ @return The number of measurement loops ended so far.
+ */
+int FakeEcs_GetLoopEnds(void)
+{
+	int n;
+
+	pthread_mutex_lock(&s_lock);
+	n = s_loopEnds;
+	pthread_mutex_unlock(&s_lock);
+	return n;
+}
+
+/*!
+ Change the delays which AKD_GetDelay() returns, as a consumer would, and
+ notify the change with AKD_NotifyDelay().
+ @param[in] delay The delay of each sensor in nano second, negative when the
+ sensor is disabled.
+ */
+void FakeEcs_SetDelay(const int64_t delay[AKM_NUM_SENSORS])
+{
+	pthread_mutex_lock(&s_lock);
+	memcpy(s_delay, delay, sizeof(s_delay));
+	pthread_mutex_unlock(&s_lock);
+	AKD_NotifyDelay();
+}
+
+/*!
+ Request only the magnetometer again, every #FAKEECS_MAG_DELAY.
+ */
+void FakeEcs_ResetDelay(void)
+{
+	const int64_t delay[AKM_NUM_SENSORS] = { -1, FAKEECS_MAG_DELAY, -1 };
+
+	FakeEcs_SetDelay(delay);
+}
+
+/*!
+ @return The number of calls of a kind made since the start of the process.
+ @param[in] call The kind of call.
+ */
+int FakeEcs_GetCalls(FAKEECS_CALL call)
+{
+	int n;
+
+	pthread_mutex_lock(&s_lock);
+	n = s_calls[call];
+	pthread_mutex_unlock(&s_lock);
+	return n;
+}
+
+/*!
+ Wait until \a count calls of a kind have been made since the start of the
+ process.
+ @return #AKD_TRUE, or #AKD_FALSE on timeout.
+ @param[in] call The kind of call.
+ @param[in] count See FakeEcs_GetCalls().
+ @param[in] timeoutMs The longest wait in milli second.
+ */
+int FakeEcs_WaitCalls(FAKEECS_CALL call, int count, int timeoutMs)
+{
+	struct timespec ts = deadline(timeoutMs);
+	int ret = 0;
+
+	pthread_mutex_lock(&s_lock);
+	while ((s_calls[call] < count) && (ret != ETIMEDOUT)) {
+		ret = pthread_cond_timedwait(&s_cond, &s_lock, &ts);
+	}
+	ret = (s_calls[call] >= count) ? AKD_TRUE : AKD_FALSE;
+	pthread_mutex_unlock(&s_lock);
+	return ret;
+}
+
+int16_t AKD_InitDevice(void)
+{
+	return AKD_SUCCESS;
+}
+
+void AKD_DeinitDevice(void)
+{
+}
+
+int16_t AKD_TxData(
+		const BYTE address,
+		const BYTE * data,
+		const uint16_t numberOfBytesToWrite)
+{
+	(void)address;
+	(void)data;
+	(void)numberOfBytesToWrite;
+	return AKD_SUCCESS;
+}
+
+int16_t AKD_RxData(
+		const BYTE address,
+		BYTE * data,
+		const uint16_t numberOfBytesToRead)
+{
+	(void)address;
+	memset(data, 0, numberOfBytesToRead);
+	return AKD_SUCCESS;
+}
+
+int16_t AKD_Reset(void)
+{
+	return AKD_SUCCESS;
+}
+
+int16_t AKD_GetSensorInfo(BYTE data[AKM_SENSOR_INFO_SIZE])
+{
+	memset(data, 0, AKM_SENSOR_INFO_SIZE);
+	return AKD_SUCCESS;
+}
+
+/* The sensitivity adjustment values must not be 0. */
+int16_t AKD_GetSensorConf(BYTE data[AKM_SENSOR_CONF_SIZE])
+{
+	memset(data, 128, AKM_SENSOR_CONF_SIZE);
+	return AKD_SUCCESS;
+}
+
+/*!
+ Get a zero field, stamped with the current time. Blocks while the reads are
+ held. See "AKMD_Driver.h"
+ */
+int16_t AKD_GetMagneticData(BYTE data[AKM_SENSOR_DATA_SIZE])
+{
+	struct timespec now = { 0, 0 };
+	int64_t time;
+
+	pthread_mutex_lock(&s_lock);
+	s_calls[FAKEECS_GET_MAG]++;
+	s_blocked++;
+	pthread_cond_broadcast(&s_cond);
+	while (s_hold) {
+		pthread_cond_wait(&s_cond, &s_lock);
+	}
+	s_blocked--;
+	pthread_mutex_unlock(&s_lock);
+
+	memset(data, 0, AKM_SENSOR_DATA_SIZE);
+	clock_gettime(CLOCK_BOOTTIME, &now);
+	time = (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+	memcpy(&data[AKM_SENSOR_DATA_SIZE], &time, AKM_SENSOR_TIME_SIZE);
+	return AKD_SUCCESS;
+}
+
+void AKD_SetYPR(const int buf[AKM_YPR_DATA_SIZE])
+{
+	(void)buf;
+	countCall(FAKEECS_SET_YPR);
+}
+
+int16_t AKD_GetOpenStatus(int* status)
+{
+	*status = 1;
+	return AKD_SUCCESS;
+}
+
+int16_t AKD_GetCloseStatus(int* status)
+{
+	*status = 0;
+	return AKD_SUCCESS;
+}
+
+int16_t AKD_SetMode(const BYTE mode)
+{
+	if (mode == AKM_MODE_POWERDOWN) {
+		countCall(FAKEECS_POWERDOWN);
+	}
+	return AKD_SUCCESS;
+}
+
+/* See FakeEcs_SetDelay(). */
+int16_t AKD_GetDelay(int64_t delay[AKM_NUM_SENSORS])
+{
+	pthread_mutex_lock(&s_lock);
+	s_calls[FAKEECS_GET_DELAY]++;
+	memcpy(delay, s_delay, sizeof(s_delay));
+	pthread_cond_broadcast(&s_cond);
+	pthread_mutex_unlock(&s_lock);
+	return AKD_SUCCESS;
+}
+
+int16_t AKD_InitDelayEvent(void)
+{
+	if (s_fdDelay < 0) {
+		s_fdDelay = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	}
+	return (s_fdDelay >= 0) ? AKD_SUCCESS : AKD_FAIL;
+}
+
+int AKD_GetDelayEventFd(void)
+{
+	return s_fdDelay;
+}
+
+void AKD_NotifyDelay(void)
+{
+	uint64_t one = 1;
+
+	if (s_fdDelay >= 0) {
+		write(s_fdDelay, &one, sizeof(one));
+	}
+}
+
+int16_t AKD_GetLayout(int16_t* layout)
+{
+	*layout = PAT1;
+	return AKD_SUCCESS;
+}
+
+int16_t AKD_AccSetEnable(int8_t enabled)
+{
+	if (enabled == AKD_DISABLE) {
+		pthread_mutex_lock(&s_lock);
+		s_loopEnds++;
+		pthread_cond_broadcast(&s_cond);
+		pthread_mutex_unlock(&s_lock);
+	}
+	return AKD_SUCCESS;
+}
+
+int16_t AKD_AccSetDelay(int64_t delay)
+{
+	(void)delay;
+	return AKD_SUCCESS;
+}
+
+int16_t AKD_GetAccelerationData(int16_t data[3])
+{
+	countCall(FAKEECS_GET_ACC);
+	data[0] = 0;
+	data[1] = 0;
+	data[2] = 0;
+	return AKD_SUCCESS;
+}
+
+int16_t AKD_GetAccelerationDataAt(int64_t time, int16_t data[3])
+{
+	(void)time;
+	return AKD_GetAccelerationData(data);
+}
+
+int16_t AKD_GetAccelerationOffset(int16_t offset[3])
+{
+	offset[0] = 0;
+	offset[1] = 0;
+	offset[2] = 0;
+	return AKD_SUCCESS;
+}
+
+void AKD_GetAccelerationVector(
+	const int16_t data[3],
+	const int16_t offset[3],
+	int16_t vec[3])
+{
+	vec[0] = (int16_t)(data[0] - offset[0]);
+	vec[1] = (int16_t)(data[1] - offset[1]);
+	vec[2] = (int16_t)(data[2] - offset[2]);
+}
+
+/* Blocks while held, see FakeEcs_HoldReady(). */
+int16_t AKD_WaitReady(void)
+{
+	pthread_mutex_lock(&s_lock);
+	while (s_holdReady) {
+		pthread_cond_wait(&s_cond, &s_lock);
+	}
+	pthread_mutex_unlock(&s_lock);
+	return AKD_SUCCESS;
+}
+
+int16_t AKD_StartRecord(const char* path)
+{
+	(void)path;
+	return AKD_FAIL;
+}
+
+void AKD_StopRecord(void)
+{
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2016 Motorola Mobility
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AKMD_INC_FAKEECS_H
+#define AKMD_INC_FAKEECS_H
+
+#include "AKMD_Driver.h"
+
+/*** Constant definition ******************************************************/
+
+/*
+ FakeEcs.c implements AKMD_Driver.h without a device, for the tests. By
+ default only the magnetometer is requested, every #FAKEECS_MAG_DELAY; the
+ delays can be changed with FakeEcs_SetDelay(), which notifies the change
+ like the sensor HAL does. Like ECS_IOCTL_GET_DATA,
+ AKD_GetMagneticData() can be made to block until it is released, and so
+ can AKD_WaitReady(), like a sensor hub which is still booting. The calls
+ which reach the device are counted, see #FAKEECS_CALL.
+ */
+#define FAKEECS_MAG_DELAY	(10LL * 1000000LL)
+
+/*** Type declaration *********************************************************/
+/*! The calls counted by FakeEcs_GetCalls() */
+typedef enum _FAKEECS_CALL {
+	FAKEECS_GET_DELAY = 0,	/*!< AKD_GetDelay() */
+	FAKEECS_GET_MAG,		/*!< AKD_GetMagneticData() */
+	FAKEECS_GET_ACC,		/*!< AKD_GetAccelerationData(), with or without time */
+	FAKEECS_SET_YPR,		/*!< AKD_SetYPR() */
+	FAKEECS_POWERDOWN,		/*!< AKD_SetMode() with #AKM_MODE_POWERDOWN */
+	FAKEECS_NUM_CALLS
+} FAKEECS_CALL;
+
+/*** Global variables *********************************************************/
+
+/*** Prototype of function ****************************************************/
+void FakeEcs_HoldReads(int hold);
+
+void FakeEcs_HoldReady(int hold);
+
+int FakeEcs_WaitBlockedRead(int timeoutMs);
+
+int FakeEcs_WaitLoopEnds(int count, int timeoutMs);
+
+int FakeEcs_GetLoopEnds(void);
+
+void FakeEcs_SetDelay(const int64_t delay[AKM_NUM_SENSORS]);
+
+void FakeEcs_ResetDelay(void);
+
+int FakeEcs_GetCalls(FAKEECS_CALL call);
+
+int FakeEcs_WaitCalls(FAKEECS_CALL call, int count, int timeoutMs);
+
+#endif //AKMD_INC_FAKEECS_H
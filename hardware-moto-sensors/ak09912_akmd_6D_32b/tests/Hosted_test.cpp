@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2016 Motorola Mobility
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+
+extern "C" {
+#include "FakeEcs.h"
+#include "Hosted.h"
+}
+
+using namespace std;
+
+namespace {
+
+const int TimeoutMs = 2000;
+/** Far more than a start or a stop takes, far less than a blocked call. */
+const auto MaxStop = chrono::milliseconds(100);
+/** Longer than Measure.c would wait between two polls of the delays. */
+const int SettingPollUs = 600000;
+
+/** Counts the results for one host. */
+struct Host {
+    Host() : results(0) {}
+
+    static void result(const int *rbuf, void *ctx) {
+        (void)rbuf;
+        static_cast<Host *>(ctx)->results++;
+    }
+
+    /** Waits until at least count results have arrived. */
+    bool waitResults(int count) {
+        auto end = chrono::steady_clock::now() + chrono::milliseconds(TimeoutMs);
+        while (results < count) {
+            if (chrono::steady_clock::now() > end)
+                return false;
+            usleep(1000);
+        }
+        return true;
+    }
+
+    atomic<int> results;
+};
+
+/** Stops the compass and returns how long that took. */
+chrono::steady_clock::duration timedStop() {
+    auto start = chrono::steady_clock::now();
+    Hosted_Stop();
+    return chrono::steady_clock::now() - start;
+}
+
+class HostedTest : public ::testing::Test {
+    protected:
+        HostedTest() : loopEnds(0) {}
+
+        void SetUp() override {
+            FakeEcs_ResetDelay();
+            FakeEcs_HoldReads(AKD_FALSE);
+            loopEnds = FakeEcs_GetLoopEnds();
+        }
+
+        void TearDown() override {
+            // Leave the loop ended for the next test
+            Hosted_Stop();
+            FakeEcs_HoldReady(AKD_FALSE);
+            FakeEcs_HoldReads(AKD_FALSE);
+            FakeEcs_WaitLoopEnds(loopEnds + 1, TimeoutMs);
+        }
+
+        int loopEnds;
+};
+
+} // namespace
+
+// The device is opened once per process, so this must be the first test.
+TEST_F(HostedTest, StartDoesNotWaitForDevice) {
+    Host host;
+
+    FakeEcs_HoldReady(AKD_TRUE);
+    auto start = chrono::steady_clock::now();
+    ASSERT_EQ(AKD_SUCCESS, Hosted_Start(Host::result, &host));
+    EXPECT_LT(chrono::steady_clock::now() - start, MaxStop);
+
+    // Stopping and starting again while the hub boots doesn't wait either
+    EXPECT_LT(timedStop(), MaxStop);
+    start = chrono::steady_clock::now();
+    ASSERT_EQ(AKD_SUCCESS, Hosted_Start(Host::result, &host));
+    EXPECT_LT(chrono::steady_clock::now() - start, MaxStop);
+
+    usleep(50000);
+    EXPECT_EQ(0, host.results);
+    FakeEcs_HoldReady(AKD_FALSE);
+    EXPECT_TRUE(host.waitResults(3));
+}
+
+TEST_F(HostedTest, DeliversResults) {
+    Host host;
+
+    ASSERT_EQ(AKD_SUCCESS, Hosted_Start(Host::result, &host));
+    EXPECT_TRUE(host.waitResults(3));
+
+    EXPECT_LT(timedStop(), MaxStop);
+    EXPECT_TRUE(FakeEcs_WaitLoopEnds(loopEnds + 1, TimeoutMs));
+}
+
+TEST_F(HostedTest, StopDoesNotWaitForBlockedRead) {
+    Host host;
+
+    FakeEcs_HoldReads(AKD_TRUE);
+    ASSERT_EQ(AKD_SUCCESS, Hosted_Start(Host::result, &host));
+    ASSERT_TRUE(FakeEcs_WaitBlockedRead(TimeoutMs));
+
+    EXPECT_LT(timedStop(), MaxStop);
+    int results = host.results;
+
+    // The loop can only end once the read returns
+    usleep(50000);
+    EXPECT_EQ(loopEnds, FakeEcs_GetLoopEnds());
+    FakeEcs_HoldReads(AKD_FALSE);
+    EXPECT_TRUE(FakeEcs_WaitLoopEnds(loopEnds + 1, TimeoutMs));
+
+    // The read which completed after the stop is not reported
+    EXPECT_EQ(results, host.results);
+}
+
+TEST_F(HostedTest, RestartWhileReadBlocked) {
+    Host first;
+    Host second;
+
+    FakeEcs_HoldReads(AKD_TRUE);
+    ASSERT_EQ(AKD_SUCCESS, Hosted_Start(Host::result, &first));
+    ASSERT_TRUE(FakeEcs_WaitBlockedRead(TimeoutMs));
+    EXPECT_LT(timedStop(), MaxStop);
+
+    // The loop which is still running just goes on, for the new host
+    ASSERT_EQ(AKD_SUCCESS, Hosted_Start(Host::result, &second));
+    FakeEcs_HoldReads(AKD_FALSE);
+    EXPECT_TRUE(second.waitResults(3));
+    EXPECT_EQ(loopEnds, FakeEcs_GetLoopEnds());
+    EXPECT_EQ(0, first.results);
+
+    EXPECT_LT(timedStop(), MaxStop);
+    EXPECT_TRUE(FakeEcs_WaitLoopEnds(loopEnds + 1, TimeoutMs));
+}
+
+TEST_F(HostedTest, StartsAgainAfterLoopEnded) {
+    Host host;
+
+    for (int i = 0; i < 3; i++) {
+        ASSERT_EQ(AKD_SUCCESS, Hosted_Start(Host::result, &host));
+        EXPECT_TRUE(host.waitResults(host.results + 1));
+        EXPECT_LT(timedStop(), MaxStop);
+        EXPECT_TRUE(FakeEcs_WaitLoopEnds(loopEnds + i + 1, TimeoutMs));
+    }
+    // The last loop already ended
+    loopEnds += 2;
+}
+
+TEST_F(HostedTest, IdleWithoutOutputs) {
+    Host host;
+    const int64_t disabled[AKM_NUM_SENSORS] = { -1, -1, -1 };
+    int magReads = FakeEcs_GetCalls(FAKEECS_GET_MAG);
+    int accReads = FakeEcs_GetCalls(FAKEECS_GET_ACC);
+    int yprs = FakeEcs_GetCalls(FAKEECS_SET_YPR);
+    int powerDowns = FakeEcs_GetCalls(FAKEECS_POWERDOWN);
+
+    FakeEcs_SetDelay(disabled);
+    ASSERT_EQ(AKD_SUCCESS, Hosted_Start(Host::result, &host));
+    ASSERT_TRUE(FakeEcs_WaitCalls(FAKEECS_POWERDOWN, powerDowns + 1, TimeoutMs));
+
+    // Nothing touches the device for several would-be periods
+    usleep(10 * FAKEECS_MAG_DELAY / 1000);
+    EXPECT_EQ(magReads, FakeEcs_GetCalls(FAKEECS_GET_MAG));
+    EXPECT_EQ(accReads, FakeEcs_GetCalls(FAKEECS_GET_ACC));
+    EXPECT_EQ(yprs, FakeEcs_GetCalls(FAKEECS_SET_YPR));
+    EXPECT_EQ(powerDowns + 1, FakeEcs_GetCalls(FAKEECS_POWERDOWN));
+    EXPECT_EQ(0, host.results);
+}
+
+TEST_F(HostedTest, DelayChangeTakesEffectWithoutPolling) {
+    Host host;
+    const int64_t disabled[AKM_NUM_SENSORS] = { -1, -1, -1 };
+    int delayReads = FakeEcs_GetCalls(FAKEECS_GET_DELAY);
+    int powerDowns = FakeEcs_GetCalls(FAKEECS_POWERDOWN);
+
+    ASSERT_EQ(AKD_SUCCESS, Hosted_Start(Host::result, &host));
+    ASSERT_TRUE(host.waitResults(3));
+
+    // The delays are read once when the loop starts, then only on changes
+    usleep(SettingPollUs);
+    EXPECT_EQ(delayReads + 1, FakeEcs_GetCalls(FAKEECS_GET_DELAY));
+
+    // Disabling the magnetometer disarms it right away
+    auto start = chrono::steady_clock::now();
+    FakeEcs_SetDelay(disabled);
+    ASSERT_TRUE(FakeEcs_WaitCalls(FAKEECS_POWERDOWN, powerDowns + 1, TimeoutMs));
+    EXPECT_LT(chrono::steady_clock::now() - start, MaxStop);
+    EXPECT_EQ(delayReads + 2, FakeEcs_GetCalls(FAKEECS_GET_DELAY));
+    int magReads = FakeEcs_GetCalls(FAKEECS_GET_MAG);
+    usleep(10 * FAKEECS_MAG_DELAY / 1000);
+    EXPECT_EQ(magReads, FakeEcs_GetCalls(FAKEECS_GET_MAG));
+
+    // And enabling it again re-arms it right away
+    int results = host.results;
+    start = chrono::steady_clock::now();
+    FakeEcs_ResetDelay();
+    EXPECT_TRUE(host.waitResults(results + 1));
+    EXPECT_LT(chrono::steady_clock::now() - start, MaxStop);
+    EXPECT_EQ(delayReads + 3, FakeEcs_GetCalls(FAKEECS_GET_DELAY));
+}
@@ -31,7 +31,7 @@ ifneq (,$(filter userdebug eng,$(TARGET_BUILD_VARIANT)))
 endif
 
 LOCAL_SRC_FILES :=              \
-    SensorHub.cpp Endian.cpp
+    SensorHub.cpp SensorHubQueue.cpp
 
 LOCAL_C_INCLUDES += $(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr/include
 # Need the UAPI output directory to be populated with motosh.h/stml0xx.h
@@ -46,3 +46,5 @@ LOCAL_PROPRIETARY_MODULE := true
 
 include $(BUILD_SHARED_LIBRARY)
 
+
+include $(call all-makefiles-under,$(LOCAL_PATH))
@@ -7,6 +7,10 @@
 /** \file
  *  \brief Defines a class to handle type-safe endian conversion methods.
  *
+ *  This header is shared by libsensorhub, the motosh tool and the sensor
+ *  HALs. Everything is inline so that users don't need to link against
+ *  libsensorhub.
+ *
  *                           Motorola Confidential Restricted
  *                    (c) Copyright Motorola 2015, All Rights Reserved
  *
@@ -15,68 +19,75 @@
 #ifndef _ENDIAN_HPP
 #define _ENDIAN_HPP
 
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <type_traits>
-#include <assert.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define ENDIAN_USE_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define ENDIAN_USE_SSE2
+#endif
 
 #undef BYTE_SWAP_16
 #undef BYTE_SWAP_32
 #undef BYTE_SWAP_64
 
-/** Non-optimized way to swap two bytes. */
-#define BYTE_SWAP_16(x) \
-    ((((x) >> 8) & 0xff) | (((x) & 0xff) << 8))
+/** Swaps two bytes. Compiles to a single instruction (rev16/rol). */
+#define BYTE_SWAP_16(x) __builtin_bswap16(x)
 
-/** Non-optimized way to swap four bytes. */
-#define BYTE_SWAP_32(x) \
-    ((((x) & 0xff000000) >> 24) | (((x) & 0x00ff0000) >>  8) | \
-     (((x) & 0x0000ff00) <<  8) | (((x) & 0x000000ff) << 24))
+/** Swaps four bytes. Compiles to a single instruction (rev/bswap). */
+#define BYTE_SWAP_32(x) __builtin_bswap32(x)
 
-/** Non-optimized way to swap eight bytes. */
-#define BYTE_SWAP_64(x) \
-    ((((x) & 0xff00000000000000ull) >> 56) | (((x) & 0x00ff000000000000ull) >> 40) | \
-     (((x) & 0x0000ff0000000000ull) >> 24) | (((x) & 0x000000ff00000000ull) >>  8) | \
-     (((x) & 0x00000000ff000000ull) <<  8) | (((x) & 0x0000000000ff0000ull) << 24) | \
-     (((x) & 0x000000000000ff00ull) << 40) | (((x) & 0x00000000000000ffull) << 56))
+/** Swaps eight bytes. Compiles to a single instruction on 64-bit targets. */
+#define BYTE_SWAP_64(x) __builtin_bswap64(x)
 
 
 class Endian {
 public:
     /** Type-safe way to swap the byte order for standard int types. */
     template<typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type >
-    T static inline swap(T val) {
-        switch (sizeof(T)) {
-            case 2: return BYTE_SWAP_16(val);
-            case 4: return BYTE_SWAP_32(val);
-            case 8: return BYTE_SWAP_64(val);
-            default: return val;
-        }
+    static constexpr inline T swap(T val) {
+        return sizeof(T) == 2 ? static_cast<T>(BYTE_SWAP_16(static_cast<uint16_t>(val))) :
+               sizeof(T) == 4 ? static_cast<T>(BYTE_SWAP_32(static_cast<uint32_t>(val))) :
+               sizeof(T) == 8 ? static_cast<T>(BYTE_SWAP_64(static_cast<uint64_t>(val))) :
+               val;
     }
 
     /** Converts from network to host byte order (or vice versa). */
     template<typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type >
-    T static inline ntoh(T val) {
-        return bigEndian ? val : swap(val);
+    static constexpr inline T ntoh(T val) {
+        return isBigEndian() ? val : swap(val);
     }
 
-    /** Checks the platform byte-order at run-time.
+    /** Converts from little endian to host byte order (or vice versa). */
+    template<typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type >
+    static constexpr inline T ltoh(T val) {
+        return isBigEndian() ? swap(val) : val;
+    }
+
+    /** Checks the platform byte-order at compile-time.
      *
      * @return True if the platform is big-endian (network byte order).
      * */
-    static bool isBigEndian() { return bigEndian; }
+    static constexpr bool isBigEndian() {
+        return __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__;
+    }
 
     /** Extracts a standard integer type out of a byte array in a type-safe
      * manner. The byte array must store the value in network byte order. The
      * value is converted to the host byte order upon extraction.
      *
-     * This base function should only be called if a better member function
-     * template specialization doesn't exist (specializations are below).
-     * Notice this function doesn't return anything even though it declares a
-     * return type, so that a compiler warning is generated in case it is used.
+     * The array does not need to be aligned.
      */
     template<typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type >
-    static inline T extract(uint8_t* a) {
-        assert(false);
+    static inline T extract(const uint8_t* a) {
+        T val;
+        memcpy(&val, a, sizeof(val));
+        return ntoh(val);
     }
 
     /** Extracts a standard integer type out of a byte array in a type-safe
@@ -84,75 +95,95 @@ public:
      * The value is converted to the host byte order upon extraction.
      */
     template<typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type >
-    static inline T extractLittleEndian(uint8_t* a) {
-        return swap(extract<T>(a));
+    static inline T extractLittleEndian(const uint8_t* a) {
+        T val;
+        memcpy(&val, a, sizeof(val));
+        return ltoh(val);
+    }
+
+    /** Converts packed big-endian int16 (x, y, z) triplets to scaled floats.
+     *
+     * This is the layout of every vector record sent by the SensorHub.
+     *
+     * @param src count * 3 big-endian int16 values. Need not be aligned.
+     * @param count The number of triplets.
+     * @param scale Per-axis scale factors.
+     * @param dst Receives count * 3 floats.
+     */
+    static inline void be16x3ToFloat(const uint8_t* src, size_t count,
+            const float scale[3], float* dst) {
+        size_t i = 0;
+
+#if defined(ENDIAN_USE_NEON)
+        // Four triplets are twelve values, so the scale pattern repeats
+        // every three vectors.
+        const float32x4_t s0 = { scale[0], scale[1], scale[2], scale[0] };
+        const float32x4_t s1 = { scale[1], scale[2], scale[0], scale[1] };
+        const float32x4_t s2 = { scale[2], scale[0], scale[1], scale[2] };
+        for (; i + 4 <= count; i += 4, src += 24, dst += 12) {
+            int16x4_t v0 = vreinterpret_s16_u8(vrev16_u8(vld1_u8(src)));
+            int16x4_t v1 = vreinterpret_s16_u8(vrev16_u8(vld1_u8(src + 8)));
+            int16x4_t v2 = vreinterpret_s16_u8(vrev16_u8(vld1_u8(src + 16)));
+            vst1q_f32(dst,     vmulq_f32(vcvtq_f32_s32(vmovl_s16(v0)), s0));
+            vst1q_f32(dst + 4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(v1)), s1));
+            vst1q_f32(dst + 8, vmulq_f32(vcvtq_f32_s32(vmovl_s16(v2)), s2));
+        }
+#elif defined(ENDIAN_USE_SSE2)
+        const __m128 s0 = _mm_setr_ps(scale[0], scale[1], scale[2], scale[0]);
+        const __m128 s1 = _mm_setr_ps(scale[1], scale[2], scale[0], scale[1]);
+        const __m128 s2 = _mm_setr_ps(scale[2], scale[0], scale[1], scale[2]);
+        for (; i + 4 <= count; i += 4, src += 24, dst += 12) {
+            _mm_storeu_ps(dst,     _mm_mul_ps(be16x4ToPs(src), s0));
+            _mm_storeu_ps(dst + 4, _mm_mul_ps(be16x4ToPs(src + 8), s1));
+            _mm_storeu_ps(dst + 8, _mm_mul_ps(be16x4ToPs(src + 16), s2));
+        }
+#endif
+
+        for (; i < count; i++, src += 6, dst += 3) {
+            dst[0] = extract<int16_t>(src)     * scale[0];
+            dst[1] = extract<int16_t>(src + 2) * scale[1];
+            dst[2] = extract<int16_t>(src + 4) * scale[2];
+        }
+    }
+
+    /** Converts big-endian uint16 values to host order.
+     *
+     * @param src count big-endian values. Need not be aligned.
+     * @param count The number of values.
+     * @param dst Receives count host-order values. May alias src.
+     */
+    static inline void be16ToHost(const uint8_t* src, size_t count, uint16_t* dst) {
+        size_t i = 0;
+
+#if defined(ENDIAN_USE_NEON)
+        for (; i + 8 <= count; i += 8) {
+            vst1q_u8(reinterpret_cast<uint8_t*>(dst + i),
+                    vrev16q_u8(vld1q_u8(src + i * 2)));
+        }
+#elif defined(ENDIAN_USE_SSE2)
+        for (; i + 8 <= count; i += 8) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2));
+            v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), v);
+        }
+#endif
+
+        for (; i < count; i++) {
+            dst[i] = extract<uint16_t>(src + i * 2);
+        }
     }
 
 private:
-    typedef union {
-        uint32_t val;
-        uint8_t v[4];
-    } TestUnion;
-    static const TestUnion test;
-    static const bool bigEndian;
+#if defined(ENDIAN_USE_SSE2)
+    /** Loads four big-endian int16 values and converts them to floats. */
+    static inline __m128 be16x4ToPs(const uint8_t* src) {
+        __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src));
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        // Sign-extend to 32 bits by placing each value in the high half.
+        v = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        return _mm_cvtepi32_ps(v);
+    }
+#endif
 };
 
-//@{
-/** Member function template specializations for Endian::extract().
- */
-template<> inline int8_t Endian::extract<int8_t>(uint8_t* a) {
-    return static_cast<int8_t>(a[0]);
-}
-
-template<> inline uint8_t Endian::extract<uint8_t>(uint8_t* a) {
-    return a[0];
-}
-
-template<> inline int16_t Endian::extract<int16_t>(uint8_t* a) {
-    return  static_cast<int16_t>(a[0]) << 8 |
-            static_cast<int16_t>(a[1]);
-}
-
-template<> inline uint16_t Endian::extract<uint16_t>(uint8_t* a) {
-    return  static_cast<uint16_t>(a[0]) << 8 |
-            static_cast<uint16_t>(a[1]);
-}
-
-template<> inline int32_t Endian::extract<int32_t>(uint8_t* a) {
-    return  static_cast<int32_t>(a[0]) << 24 |
-            static_cast<int32_t>(a[1]) << 16 |
-            static_cast<int32_t>(a[2]) << 8 |
-            static_cast<int32_t>(a[3]);
-}
-
-template<> inline uint32_t Endian::extract<uint32_t>(uint8_t* a) {
-    return  static_cast<uint32_t>(a[0]) << 24 |
-            static_cast<uint32_t>(a[1]) << 16 |
-            static_cast<uint32_t>(a[2]) << 8 |
-            static_cast<uint32_t>(a[3]);
-}
-
-template<> inline int64_t Endian::extract<int64_t>(uint8_t* a) {
-    return  static_cast<int64_t>(a[0]) << 56 |
-            static_cast<int64_t>(a[1]) << 48 |
-            static_cast<int64_t>(a[2]) << 40 |
-            static_cast<int64_t>(a[3]) << 32 |
-            static_cast<int64_t>(a[4]) << 24 |
-            static_cast<int64_t>(a[5]) << 16 |
-            static_cast<int64_t>(a[6]) << 8 |
-            static_cast<int64_t>(a[7]);
-}
-
-template<> inline uint64_t Endian::extract<uint64_t>(uint8_t* a) {
-    return  static_cast<uint64_t>(a[0]) << 56 |
-            static_cast<uint64_t>(a[1]) << 48 |
-            static_cast<uint64_t>(a[2]) << 40 |
-            static_cast<uint64_t>(a[3]) << 32 |
-            static_cast<uint64_t>(a[4]) << 24 |
-            static_cast<uint64_t>(a[5]) << 16 |
-            static_cast<uint64_t>(a[6]) << 8 |
-            static_cast<uint64_t>(a[7]);
-}
-//@}
-
 #endif // _ENDIAN_HPP
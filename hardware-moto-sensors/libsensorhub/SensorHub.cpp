@@ -33,7 +33,7 @@ int SensorHub::retryIoctl (int fd, int ioctl_number, ...) {
     do {
         status = ioctl(fd, ioctl_number, arg);
         error = errno;
-    } while ((status != 0) && (error == -EINTR));
+    } while ((status < 0) && (error == EINTR));
     return status;
 }
 
@@ -124,13 +124,8 @@ uint32_t SensorHub::getFlashCrc(void) {
     unique_ptr<uint8_t[]> buff = readReg(VmmID::FW_CRC, 4);
     if (!buff) return 0;
 
-    uint32_t hwCrc = Endian::extract<uint32_t>(&buff[0]);
-    if (! isBigEndian) {
-        // Extraction was done assuming data was BE, so we must swap.
-        hwCrc = Endian::swap(hwCrc);
-    }
-
-    return hwCrc;
+    return isBigEndian ? Endian::extract<uint32_t>(&buff[0]) :
+                         Endian::extractLittleEndian<uint32_t>(&buff[0]);
 }
 
 bool SensorHub::triggerProxRecal(void) {
@@ -0,0 +1,258 @@
+#include "SensorHubQueue.hpp"
+
+using namespace std;
+
+namespace mot {
+
+const SensorHubQueue::Clock::time_point SensorHubQueue::NoDeadline =
+        SensorHubQueue::Clock::time_point::max();
+
+SensorHubQueue::SensorHubQueue() : SensorHubQueue(Executor()) {
+}
+
+SensorHubQueue::SensorHubQueue(Executor exec) :
+    hub(), exec(std::move(exec)), lock(), cv(), expiryCv(), queue(),
+    nextId(1), stopping(false), thread(), expiryThread()
+{
+    // Start the threads last, once every member they touch is constructed.
+    thread = std::thread(&SensorHubQueue::worker, this);
+    expiryThread = std::thread(&SensorHubQueue::expirer, this);
+}
+
+SensorHubQueue::~SensorHubQueue() {
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    cv.notify_one();
+    expiryCv.notify_one();
+    thread.join();
+    expiryThread.join();
+
+    // Anything still queued will never run.
+    for (auto &cmd : queue) {
+        complete(*cmd, Result{Status::SHUTDOWN, {}, 0});
+    }
+}
+
+SensorHubQueue::Ticket SensorHubQueue::enqueue(Kind kind,
+        SensorHub::VmmID vmmId, uint16_t size, const uint8_t * const data,
+        Clock::time_point deadline, Callback cb) {
+
+    unique_ptr<Command> cmd(new Command{0, kind, vmmId, size, {}, deadline,
+            std::move(cb), promise<Result>()});
+    if (data) {
+        cmd->payload.assign(data, data + size);
+    }
+
+    Ticket ticket{0, cmd->promise.get_future()};
+    bool shutdown;
+    {
+        lock_guard<mutex> guard(lock);
+        ticket.id = cmd->id = nextId++;
+        shutdown = stopping;
+        if (!shutdown) {
+            queue.push_back(std::move(cmd));
+        }
+    }
+
+    // The callback may queue again, so it must not run under the lock.
+    if (shutdown) {
+        complete(*cmd, Result{Status::SHUTDOWN, {}, 0});
+        return ticket;
+    }
+    cv.notify_one();
+    expiryCv.notify_one();
+
+    return ticket;
+}
+
+SensorHubQueue::Ticket SensorHubQueue::readReg(SensorHub::VmmID vmmId,
+        uint16_t size, Clock::time_point deadline, Callback cb) {
+    return enqueue(Kind::READ_REG, vmmId, size, nullptr, deadline, std::move(cb));
+}
+
+SensorHubQueue::Ticket SensorHubQueue::writeReg(SensorHub::VmmID vmmId,
+        uint16_t size, const uint8_t * const data,
+        Clock::time_point deadline, Callback cb) {
+    return enqueue(Kind::WRITE_REG, vmmId, size, data, deadline, std::move(cb));
+}
+
+SensorHubQueue::Ticket SensorHubQueue::getVersionStr(
+        Clock::time_point deadline, Callback cb) {
+    return enqueue(Kind::VERSION_STR, SensorHub::VmmID::FW_VERSION_STR, 0,
+            nullptr, deadline, std::move(cb));
+}
+
+SensorHubQueue::Ticket SensorHubQueue::getFlashCrc(
+        Clock::time_point deadline, Callback cb) {
+    return enqueue(Kind::FLASH_CRC, SensorHub::VmmID::FW_CRC, 4,
+            nullptr, deadline, std::move(cb));
+}
+
+SensorHubQueue::Ticket SensorHubQueue::triggerProxRecal(
+        Clock::time_point deadline, Callback cb) {
+    return enqueue(Kind::PROX_RECAL, SensorHub::VmmID::BYPASS_MODE, 0,
+            nullptr, deadline, std::move(cb));
+}
+
+bool SensorHubQueue::cancel(RequestId id) {
+    unique_ptr<Command> cmd;
+    {
+        lock_guard<mutex> guard(lock);
+        auto it = find_if(queue.begin(), queue.end(),
+                [id](const unique_ptr<Command> &c) { return c->id == id; });
+        if (it == queue.end()) return false;
+        cmd = std::move(*it);
+        queue.erase(it);
+    }
+
+    complete(*cmd, Result{Status::CANCELLED, {}, 0});
+    return true;
+}
+
+bool SensorHubQueue::compatible(const Command &a, const Command &b) {
+    if (a.kind != b.kind) return false;
+
+    switch (a.kind) {
+        case Kind::READ_REG:
+            return a.vmmId == b.vmmId && a.size == b.size;
+        case Kind::VERSION_STR:
+        case Kind::FLASH_CRC:
+            return true;
+        default:
+            // Writes and recalibration have side effects, each request
+            // must reach the hub.
+            return false;
+    }
+}
+
+SensorHubQueue::Result SensorHubQueue::execute(const Command &cmd) {
+    if (exec) {
+        return exec(cmd.kind, cmd.vmmId, cmd.size, cmd.payload);
+    }
+
+    Result res{Status::FAILED, {}, 0};
+
+    switch (cmd.kind) {
+        case Kind::READ_REG: {
+            unique_ptr<uint8_t[]> buff = hub->readReg(cmd.vmmId, cmd.size);
+            if (buff) {
+                res.data.assign(buff.get(), buff.get() + cmd.size);
+                res.status = Status::OK;
+            }
+            break;
+        }
+        case Kind::WRITE_REG:
+            if (hub->writeReg(cmd.vmmId, cmd.size, cmd.payload.data())) {
+                res.status = Status::OK;
+            }
+            break;
+        case Kind::VERSION_STR: {
+            string ver = hub->getVersionStr();
+            if (!ver.empty()) {
+                res.data.assign(ver.begin(), ver.end());
+                res.status = Status::OK;
+            }
+            break;
+        }
+        case Kind::FLASH_CRC:
+            res.value = hub->getFlashCrc();
+            if (res.value) res.status = Status::OK;
+            break;
+        case Kind::PROX_RECAL:
+            if (hub->triggerProxRecal()) res.status = Status::OK;
+            break;
+    }
+
+    return res;
+}
+
+void SensorHubQueue::complete(Command &cmd, const Result &res) {
+    if (cmd.cb) cmd.cb(res);
+    cmd.promise.set_value(res);
+}
+
+void SensorHubQueue::worker() {
+    vector<unique_ptr<Command>> batch;
+
+    if (!exec) {
+        hub.reset(new SensorHub());
+    }
+
+    while (true) {
+        {
+            unique_lock<mutex> guard(lock);
+            cv.wait(guard, [this]() { return stopping || !queue.empty(); });
+            if (stopping) return;
+
+            // Take the head of the queue plus every adjacent command that can
+            // ride on the same transaction.
+            batch.push_back(std::move(queue.front()));
+            queue.pop_front();
+            while (!queue.empty() && compatible(*batch.front(), *queue.front())) {
+                batch.push_back(std::move(queue.front()));
+                queue.pop_front();
+            }
+        }
+
+        // Requests whose deadline passed while the batch was being taken are
+        // not worth a bus transaction.
+        Clock::time_point now = Clock::now();
+        auto expired = stable_partition(batch.begin(), batch.end(),
+                [now](const unique_ptr<Command> &c) { return c->deadline >= now; });
+        for (auto it = expired; it != batch.end(); ++it) {
+            complete(**it, Result{Status::TIMED_OUT, {}, 0});
+        }
+        batch.erase(expired, batch.end());
+
+        if (!batch.empty()) {
+            Result res = execute(*batch.front());
+            for (auto &cmd : batch) {
+                complete(*cmd, res);
+            }
+        }
+        batch.clear();
+    }
+}
+
+void SensorHubQueue::expirer() {
+    vector<unique_ptr<Command>> expired;
+    unique_lock<mutex> guard(lock);
+
+    while (!stopping) {
+        Clock::time_point next = NoDeadline;
+        for (auto &cmd : queue) {
+            next = min(next, cmd->deadline);
+        }
+
+        // Re-evaluated whenever the queue grows, since a new command may
+        // have an earlier deadline.
+        if (next == NoDeadline) {
+            expiryCv.wait(guard);
+            continue;
+        }
+        if (expiryCv.wait_until(guard, next) == cv_status::no_timeout) {
+            continue;
+        }
+
+        Clock::time_point now = Clock::now();
+        for (auto it = queue.begin(); it != queue.end(); ) {
+            if ((*it)->deadline <= now) {
+                expired.push_back(std::move(*it));
+                it = queue.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        guard.unlock();
+        for (auto &cmd : expired) {
+            complete(*cmd, Result{Status::TIMED_OUT, {}, 0});
+        }
+        expired.clear();
+        guard.lock();
+    }
+}
+
+} // namespace mot
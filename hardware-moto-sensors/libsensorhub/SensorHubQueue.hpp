@@ -0,0 +1,176 @@
+#ifndef SENSOR_HUB_QUEUE_HPP
+#define SENSOR_HUB_QUEUE_HPP
+
+#include <stdint.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SensorHub.hpp"
+
+namespace mot {
+
+/** Asynchronous front-end for SensorHub.
+ *
+ * A single worker thread owns the SensorHub object (and therefore the driver
+ * file descriptor, which it opens when it starts). Callers enqueue commands
+ * and get back a future, and optionally a callback, which completes once the
+ * command has been executed, cancelled, or has missed its deadline.
+ *
+ * Adjacent queued reads of the same kind (same register and size for
+ * register reads) are merged into a single driver transaction, and its result
+ * is delivered to every merged request. Writes and commands with side effects
+ * always get a transaction of their own.
+ *
+ * Deadlines are enforced by a second thread, so a command queued behind a
+ * slow transaction still times out on time.
+ */
+class SensorHubQueue {
+    public:
+        typedef std::chrono::steady_clock Clock;
+        typedef uint32_t RequestId;
+
+        /** Deadline value meaning "never expires". */
+        static const Clock::time_point NoDeadline;
+
+        enum struct Status {
+            OK,         //< The command was executed successfully
+            FAILED,     //< The driver returned an error
+            CANCELLED,  //< cancel() was called before the command was executed
+            TIMED_OUT,  //< The deadline passed before the command was executed
+            SHUTDOWN    //< The queue was destroyed before the command was executed
+        };
+
+        struct Result {
+            Status status;
+            /** Register contents for readReg(), string bytes for
+             * getVersionStr(). Empty otherwise. */
+            std::vector<uint8_t> data;
+            /** The CRC for getFlashCrc(). 0 otherwise. */
+            uint32_t value;
+        };
+
+        typedef std::function<void(const Result &)> Callback;
+
+        enum struct Kind { READ_REG, WRITE_REG, VERSION_STR, FLASH_CRC, PROX_RECAL };
+
+        /** Issues one driver transaction. Lets tests run the queue without a
+         * hub.
+         *
+         * @param payload The data to write for Kind::WRITE_REG, empty
+         * otherwise.
+         */
+        typedef std::function<Result(Kind kind, SensorHub::VmmID vmmId,
+                uint16_t size, const std::vector<uint8_t> &payload)> Executor;
+
+        /** Handle to a queued command. */
+        struct Ticket {
+            RequestId id;
+            std::future<Result> result;
+        };
+
+        SensorHubQueue();
+        /** Runs the commands through exec instead of the SensorHub driver. */
+        explicit SensorHubQueue(Executor exec);
+        ~SensorHubQueue();
+
+        SensorHubQueue(const SensorHubQueue &) = delete;
+        SensorHubQueue & operator=(const SensorHubQueue &) = delete;
+
+        /** Queues a register read.
+         *
+         * @param vmmId The register to read from.
+         * @param size The number of bytes to read. Must be <= SensorHub::getMaxRx().
+         * @param deadline The command fails with Status::TIMED_OUT if it has
+         * not been started by this time.
+         * @param cb Optional callback, invoked right before the future is
+         * completed. It runs on the worker thread for executed commands, on
+         * the deadline thread for expired ones and on the calling thread
+         * otherwise, and may queue further commands.
+         */
+        Ticket readReg(SensorHub::VmmID vmmId, uint16_t size,
+                Clock::time_point deadline = NoDeadline, Callback cb = Callback());
+
+        /** Queues a register write. The data is copied.
+         *
+         * @see readReg() for the meaning of deadline and cb.
+         */
+        Ticket writeReg(SensorHub::VmmID vmmId, uint16_t size,
+                const uint8_t * const data,
+                Clock::time_point deadline = NoDeadline, Callback cb = Callback());
+
+        /** Asynchronous SensorHub::getVersionStr(). */
+        Ticket getVersionStr(Clock::time_point deadline = NoDeadline,
+                Callback cb = Callback());
+
+        /** Asynchronous SensorHub::getFlashCrc(). */
+        Ticket getFlashCrc(Clock::time_point deadline = NoDeadline,
+                Callback cb = Callback());
+
+        /** Asynchronous SensorHub::triggerProxRecal(). */
+        Ticket triggerProxRecal(Clock::time_point deadline = NoDeadline,
+                Callback cb = Callback());
+
+        /** Cancels a queued command.
+         *
+         * @return True if the command was still queued and has been completed
+         * with Status::CANCELLED. False if it is already executing, has
+         * already completed, or the id is unknown.
+         */
+        bool cancel(RequestId id);
+
+    private:
+        struct Command {
+            RequestId id;
+            Kind kind;
+            SensorHub::VmmID vmmId;
+            uint16_t size;
+            std::vector<uint8_t> payload;
+            Clock::time_point deadline;
+            Callback cb;
+            std::promise<Result> promise;
+        };
+
+        Ticket enqueue(Kind kind, SensorHub::VmmID vmmId, uint16_t size,
+                const uint8_t * const data, Clock::time_point deadline, Callback cb);
+
+        /** True if b can share the driver transaction issued for a. Only
+         * reads which are safe to repeat are merged. */
+        static bool compatible(const Command &a, const Command &b);
+
+        /** Issues a single driver transaction on behalf of cmd. */
+        Result execute(const Command &cmd);
+
+        static void complete(Command &cmd, const Result &res);
+
+        void worker();
+
+        /** Completes queued commands with Status::TIMED_OUT as their
+         * deadlines pass. */
+        void expirer();
+
+        /** Unused if exec is set. Otherwise created by the worker. */
+        std::unique_ptr<SensorHub> hub;
+        Executor exec;
+        std::mutex lock;
+        std::condition_variable cv;
+        /** Signalled when a command is queued or the queue stops. */
+        std::condition_variable expiryCv;
+        std::deque<std::unique_ptr<Command>> queue;
+        RequestId nextId;
+        bool stopping;
+        std::thread thread;
+        std::thread expiryThread;
+};
+
+} // namespace mot
+
+#endif // SENSOR_HUB_QUEUE_HPP
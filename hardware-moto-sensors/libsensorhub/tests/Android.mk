@@ -0,0 +1,59 @@
+# Copyright (C) 2016 Motorola Mobility
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+LOCAL_PATH := $(call my-dir)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := libsensorhub_tests
+LOCAL_MODULE_TAGS := optional
+
+ifeq ($(MOT_SENSOR_HUB_HW_TYPE_L4), true)
+    LOCAL_CFLAGS += -DMOTOSH
+else ifeq ($(MOT_SENSOR_HUB_HW_TYPE_L0), true)
+    LOCAL_CFLAGS += -DSTML0XX
+endif
+
+LOCAL_SRC_FILES :=              \
+    Endian_test.cpp             \
+    SensorHubQueue_test.cpp
+
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/.. \
+    $(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr/include
+LOCAL_ADDITIONAL_DEPENDENCIES := $(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr
+
+LOCAL_SHARED_LIBRARIES := libsensorhub
+LOCAL_CFLAGS += -Wall -Wextra
+LOCAL_CXXFLAGS += -std=c++14
+
+LOCAL_PROPRIETARY_MODULE := true
+
+include $(BUILD_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := libsensorhub_benchmarks
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_SRC_FILES :=              \
+    Endian_benchmark.cpp
+
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/..
+
+LOCAL_CFLAGS += -Wall -Wextra
+LOCAL_CXXFLAGS += -std=c++14
+
+LOCAL_PROPRIETARY_MODULE := true
+
+include $(BUILD_NATIVE_BENCHMARK)
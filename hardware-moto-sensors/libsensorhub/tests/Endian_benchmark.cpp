@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2016 Motorola Mobility
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Compares the bulk conversions of Endian.hpp with the per-value loops they
+ * replace. Count 1 is what the HALs do for each record today; the larger
+ * counts are batched buffers.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "Endian.hpp"
+
+using namespace std;
+
+namespace {
+
+const float Scale[3] = { 1.f / 16, -0.5f, 9.80665f / 2048 };
+
+/** The odd start keeps the source unaligned, like a record payload. */
+vector<uint8_t> source(size_t bytes) {
+    vector<uint8_t> buf(bytes + 1);
+
+    for (size_t i = 0; i < buf.size(); i++) {
+        buf[i] = static_cast<uint8_t>(i * 37);
+    }
+    return buf;
+}
+
+void BM_be16x3ToFloat(benchmark::State &state) {
+    const size_t count = state.range(0);
+    vector<uint8_t> src = source(count * 6);
+    vector<float> dst(count * 3);
+
+    while (state.KeepRunning()) {
+        Endian::be16x3ToFloat(src.data() + 1, count, Scale, dst.data());
+        benchmark::DoNotOptimize(dst.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+
+void BM_be16x3ToFloatPerValue(benchmark::State &state) {
+    const size_t count = state.range(0);
+    vector<uint8_t> src = source(count * 6);
+    vector<float> dst(count * 3);
+
+    while (state.KeepRunning()) {
+        const uint8_t *s = src.data() + 1;
+        for (size_t i = 0; i < count * 3; i++, s += 2) {
+            dst[i] = Endian::extract<int16_t>(s) * Scale[i % 3];
+        }
+        benchmark::DoNotOptimize(dst.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+
+void BM_be16ToHost(benchmark::State &state) {
+    const size_t count = state.range(0);
+    vector<uint8_t> src = source(count * 2);
+    vector<uint16_t> dst(count);
+
+    while (state.KeepRunning()) {
+        Endian::be16ToHost(src.data() + 1, count, dst.data());
+        benchmark::DoNotOptimize(dst.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+
+void BM_be16ToHostPerValue(benchmark::State &state) {
+    const size_t count = state.range(0);
+    vector<uint8_t> src = source(count * 2);
+    vector<uint16_t> dst(count);
+
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < count; i++) {
+            dst[i] = Endian::extract<uint16_t>(src.data() + 1 + i * 2);
+        }
+        benchmark::DoNotOptimize(dst.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+
+} // namespace
+
+BENCHMARK(BM_be16x3ToFloat)->Arg(1)->Arg(4)->Arg(16)->Arg(64)->Arg(256);
+BENCHMARK(BM_be16x3ToFloatPerValue)->Arg(1)->Arg(4)->Arg(16)->Arg(64)->Arg(256);
+BENCHMARK(BM_be16ToHost)->Arg(1)->Arg(8)->Arg(64)->Arg(512);
+BENCHMARK(BM_be16ToHostPerValue)->Arg(1)->Arg(8)->Arg(64)->Arg(512);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2016 Motorola Mobility
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "Endian.hpp"
+
+using namespace std;
+
+namespace {
+
+/** Every uint16 value once, big-endian, in a rotated order so that each value
+ * lands on axis (value + rotation) % 3 of a triplet. */
+vector<uint8_t> allValuesBigEndian(unsigned rotation) {
+    vector<uint8_t> buf;
+
+    buf.reserve(0x10000 * 2);
+    for (uint32_t i = 0; i < 0x10000; i++) {
+        uint16_t v = static_cast<uint16_t>(i + 0x10000 - rotation);
+        buf.push_back(static_cast<uint8_t>(v >> 8));
+        buf.push_back(static_cast<uint8_t>(v));
+    }
+    return buf;
+}
+
+/** The byte-at-a-time decode which the SIMD paths must match. */
+int16_t referenceBe16(const uint8_t *p) {
+    return static_cast<int16_t>((p[0] << 8) | p[1]);
+}
+
+/** Shifts buf by offset bytes, so the conversions see an unaligned source. */
+vector<uint8_t> misalign(const vector<uint8_t> &buf, size_t offset) {
+    vector<uint8_t> out(offset, 0xa5);
+    out.insert(out.end(), buf.begin(), buf.end());
+    return out;
+}
+
+const float Scale[3] = { 1.f / 16, -0.5f, 9.80665f / 2048 };
+
+} // namespace
+
+TEST(EndianTest, ByteOrder) {
+    const uint8_t be[] = { 0x12, 0x34, 0x56, 0x78 };
+
+    EXPECT_EQ(0x1234, Endian::extract<uint16_t>(be));
+    EXPECT_EQ(0x12345678u, Endian::extract<uint32_t>(be));
+    EXPECT_EQ(0x3412, Endian::extractLittleEndian<uint16_t>(be));
+    EXPECT_EQ(0x78563412u, Endian::extractLittleEndian<uint32_t>(be));
+    EXPECT_EQ(0x3412, Endian::swap<uint16_t>(0x1234));
+    EXPECT_EQ(0x0807060504030201ull, Endian::swap<uint64_t>(0x0102030405060708ull));
+}
+
+TEST(EndianTest, Be16ToHostAllValues) {
+    // One call covers every value through the vector loop, and the shorter
+    // ones below cover the scalar tail and every source alignment.
+    for (size_t offset = 0; offset < 2; offset++) {
+        vector<uint8_t> src = misalign(allValuesBigEndian(0), offset);
+        vector<uint16_t> dst(0x10000);
+
+        Endian::be16ToHost(src.data() + offset, dst.size(), dst.data());
+        for (uint32_t i = 0; i < 0x10000; i++) {
+            ASSERT_EQ(i, dst[i]) << "offset " << offset;
+        }
+    }
+}
+
+TEST(EndianTest, Be16ToHostEveryLength) {
+    vector<uint8_t> src = allValuesBigEndian(0);
+
+    // Below, at and past each multiple of the vector width.
+    for (size_t count = 0; count <= 33; count++) {
+        for (size_t start = 0; start < 8; start++) {
+            vector<uint16_t> dst(count + 1, 0xdead);
+            const uint8_t *s = src.data() + start * 2 + 0x7ff0 * 2;
+
+            Endian::be16ToHost(s, count, dst.data());
+            for (size_t i = 0; i < count; i++) {
+                ASSERT_EQ(static_cast<uint16_t>(referenceBe16(s + i * 2)), dst[i])
+                        << "count " << count << " start " << start;
+            }
+            EXPECT_EQ(0xdead, dst[count]) << "count " << count;
+        }
+    }
+}
+
+TEST(EndianTest, Be16ToHostInPlace) {
+    vector<uint8_t> src = allValuesBigEndian(0);
+    vector<uint16_t> buf(0x10000);
+
+    memcpy(buf.data(), src.data(), src.size());
+    Endian::be16ToHost(reinterpret_cast<const uint8_t *>(buf.data()), buf.size(),
+            buf.data());
+    for (uint32_t i = 0; i < 0x10000; i++) {
+        ASSERT_EQ(i, buf[i]);
+    }
+}
+
+TEST(EndianTest, Be16x3ToFloatAllValuesOnEveryAxis) {
+    // 0x10000 values are 21845 whole triplets and one spare value. Three
+    // rotations put every value on every axis, except the three which are
+    // spare once and checked at the end.
+    const size_t count = 0x10000 / 3;
+
+    for (unsigned rotation = 0; rotation < 3; rotation++) {
+        for (size_t offset = 0; offset < 2; offset++) {
+            vector<uint8_t> src = misalign(allValuesBigEndian(rotation), offset);
+            const uint8_t *s = src.data() + offset;
+            vector<float> dst(count * 3);
+
+            Endian::be16x3ToFloat(s, count, Scale, dst.data());
+            for (size_t i = 0; i < count * 3; i++) {
+                // Both paths convert exactly to float and do one multiply.
+                ASSERT_EQ(static_cast<float>(referenceBe16(s + i * 2)) * Scale[i % 3],
+                        dst[i]) << "value " << i << " rotation " << rotation;
+            }
+        }
+    }
+
+    // The spare value of each rotation is the one which misses an axis.
+    const uint8_t last[] = { 0xff, 0xfd, 0xff, 0xfe, 0xff, 0xff };
+    float out[3];
+    Endian::be16x3ToFloat(last, 1, Scale, out);
+    EXPECT_EQ(-3 * Scale[0], out[0]);
+    EXPECT_EQ(-2 * Scale[1], out[1]);
+    EXPECT_EQ(-1 * Scale[2], out[2]);
+}
+
+TEST(EndianTest, Be16x3ToFloatEveryLength) {
+    vector<uint8_t> src = allValuesBigEndian(0);
+
+    for (size_t count = 0; count <= 13; count++) {
+        for (size_t start = 0; start < 6; start++) {
+            vector<float> dst(count * 3 + 1, 1234.f);
+            const uint8_t *s = src.data() + start * 2 + 0x7ff0 * 2;
+
+            Endian::be16x3ToFloat(s, count, Scale, dst.data());
+            for (size_t i = 0; i < count * 3; i++) {
+                ASSERT_EQ(static_cast<float>(referenceBe16(s + i * 2)) * Scale[i % 3],
+                        dst[i]) << "count " << count << " start " << start;
+            }
+            EXPECT_EQ(1234.f, dst[count * 3]) << "count " << count;
+        }
+    }
+}
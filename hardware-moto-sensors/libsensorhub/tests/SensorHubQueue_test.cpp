@@ -0,0 +1,281 @@
+/*
+ * Copyright (C) 2016 Motorola Mobility
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "SensorHubQueue.hpp"
+
+using namespace std;
+using namespace mot;
+
+typedef SensorHubQueue::Kind Kind;
+typedef SensorHubQueue::Result Result;
+typedef SensorHubQueue::Status Status;
+
+namespace {
+
+const chrono::seconds LongWait(5);
+
+/** Stands in for the driver. Counts the transactions and can hold the worker
+ * inside one until released. */
+class FakeHub {
+    public:
+        FakeHub() : lock(), cv(), held(false), busy(false), calls(0) {}
+
+        SensorHubQueue::Executor executor() {
+            return [this](Kind kind, SensorHub::VmmID, uint16_t size,
+                    const vector<uint8_t> &payload) {
+                unique_lock<mutex> guard(lock);
+                calls++;
+                busy = true;
+                cv.notify_all();
+                cv.wait(guard, [this]() { return !held; });
+                busy = false;
+
+                Result res{Status::OK, {}, 0};
+                if (kind == Kind::READ_REG) {
+                    res.data.assign(size, static_cast<uint8_t>(calls));
+                } else if (kind == Kind::WRITE_REG) {
+                    res.data = payload;
+                } else if (kind == Kind::FLASH_CRC) {
+                    res.value = calls;
+                }
+                return res;
+            };
+        }
+
+        /** The next transaction blocks until release(). */
+        void hold() {
+            lock_guard<mutex> guard(lock);
+            held = true;
+        }
+
+        void release() {
+            lock_guard<mutex> guard(lock);
+            held = false;
+            cv.notify_all();
+        }
+
+        /** Waits until the worker is blocked in a held transaction. */
+        bool waitBusy() {
+            unique_lock<mutex> guard(lock);
+            return cv.wait_for(guard, LongWait, [this]() { return busy; });
+        }
+
+        int getCalls() {
+            lock_guard<mutex> guard(lock);
+            return calls;
+        }
+
+    private:
+        mutex lock;
+        condition_variable cv;
+        bool held;
+        bool busy;
+        int calls;
+};
+
+SensorHub::VmmID anyReg() {
+    return SensorHub::VmmID::FW_CRC;
+}
+
+} // namespace
+
+TEST(SensorHubQueueTest, MergesAdjacentReads) {
+    FakeHub fake;
+    SensorHubQueue queue(fake.executor());
+
+    fake.hold();
+    auto blocker = queue.getFlashCrc();
+    ASSERT_TRUE(fake.waitBusy());
+
+    auto a = queue.readReg(anyReg(), 4);
+    auto b = queue.readReg(anyReg(), 4);
+    auto c = queue.getVersionStr();
+    auto d = queue.getVersionStr();
+    fake.release();
+
+    Result ra = a.result.get();
+    Result rb = b.result.get();
+    EXPECT_EQ(Status::OK, ra.status);
+    EXPECT_EQ(ra.data, rb.data);
+    EXPECT_EQ(Status::OK, c.result.get().status);
+    EXPECT_EQ(Status::OK, d.result.get().status);
+    EXPECT_EQ(Status::OK, blocker.result.get().status);
+
+    // The blocker, one read and one version string.
+    EXPECT_EQ(3, fake.getCalls());
+}
+
+TEST(SensorHubQueueTest, DoesNotMergeReadsOfDifferentSize) {
+    FakeHub fake;
+    SensorHubQueue queue(fake.executor());
+
+    fake.hold();
+    auto blocker = queue.getFlashCrc();
+    ASSERT_TRUE(fake.waitBusy());
+
+    auto a = queue.readReg(anyReg(), 4);
+    auto b = queue.readReg(anyReg(), 2);
+    fake.release();
+
+    EXPECT_EQ(4u, a.result.get().data.size());
+    EXPECT_EQ(2u, b.result.get().data.size());
+    EXPECT_EQ(3, fake.getCalls());
+}
+
+TEST(SensorHubQueueTest, NeverMergesWrites) {
+    FakeHub fake;
+    SensorHubQueue queue(fake.executor());
+    const uint8_t data[] = { 1, 2 };
+
+    fake.hold();
+    auto blocker = queue.getFlashCrc();
+    ASSERT_TRUE(fake.waitBusy());
+
+    auto a = queue.writeReg(anyReg(), sizeof(data), data);
+    auto b = queue.writeReg(anyReg(), sizeof(data), data);
+    fake.release();
+
+    EXPECT_EQ(Status::OK, a.result.get().status);
+    EXPECT_EQ(Status::OK, b.result.get().status);
+    EXPECT_EQ(3, fake.getCalls());
+}
+
+TEST(SensorHubQueueTest, NeverMergesProxRecal) {
+    FakeHub fake;
+    SensorHubQueue queue(fake.executor());
+
+    fake.hold();
+    auto blocker = queue.getFlashCrc();
+    ASSERT_TRUE(fake.waitBusy());
+
+    auto a = queue.triggerProxRecal();
+    auto b = queue.triggerProxRecal();
+    fake.release();
+
+    EXPECT_EQ(Status::OK, a.result.get().status);
+    EXPECT_EQ(Status::OK, b.result.get().status);
+    EXPECT_EQ(3, fake.getCalls());
+}
+
+TEST(SensorHubQueueTest, TimesOutBehindSlowCommand) {
+    FakeHub fake;
+    SensorHubQueue queue(fake.executor());
+
+    fake.hold();
+    auto blocker = queue.getFlashCrc();
+    ASSERT_TRUE(fake.waitBusy());
+
+    auto late = queue.readReg(anyReg(), 4,
+            SensorHubQueue::Clock::now() + chrono::milliseconds(20));
+
+    // Expires while the worker is still stuck in the first transaction.
+    ASSERT_EQ(future_status::ready, late.result.wait_for(LongWait));
+    EXPECT_EQ(Status::TIMED_OUT, late.result.get().status);
+
+    fake.release();
+    EXPECT_EQ(Status::OK, blocker.result.get().status);
+    EXPECT_EQ(1, fake.getCalls());
+}
+
+TEST(SensorHubQueueTest, EarlierDeadlineQueuedLater) {
+    FakeHub fake;
+    SensorHubQueue queue(fake.executor());
+
+    fake.hold();
+    auto blocker = queue.getFlashCrc();
+    ASSERT_TRUE(fake.waitBusy());
+
+    auto slow = queue.readReg(anyReg(), 4,
+            SensorHubQueue::Clock::now() + chrono::hours(1));
+    auto fast = queue.readReg(anyReg(), 2,
+            SensorHubQueue::Clock::now() + chrono::milliseconds(20));
+
+    ASSERT_EQ(future_status::ready, fast.result.wait_for(LongWait));
+    EXPECT_EQ(Status::TIMED_OUT, fast.result.get().status);
+
+    fake.release();
+    EXPECT_EQ(Status::OK, slow.result.get().status);
+}
+
+TEST(SensorHubQueueTest, Cancel) {
+    FakeHub fake;
+    SensorHubQueue queue(fake.executor());
+
+    fake.hold();
+    auto blocker = queue.getFlashCrc();
+    ASSERT_TRUE(fake.waitBusy());
+
+    auto a = queue.readReg(anyReg(), 4);
+    EXPECT_TRUE(queue.cancel(a.id));
+    EXPECT_FALSE(queue.cancel(a.id));
+    EXPECT_FALSE(queue.cancel(blocker.id));
+    fake.release();
+
+    EXPECT_EQ(Status::CANCELLED, a.result.get().status);
+    EXPECT_EQ(1, fake.getCalls());
+}
+
+TEST(SensorHubQueueTest, CallbackCanQueue) {
+    FakeHub fake;
+    SensorHubQueue queue(fake.executor());
+    promise<Result> chained;
+
+    auto a = queue.readReg(anyReg(), 4, SensorHubQueue::NoDeadline,
+            [&](const Result &) {
+                queue.getVersionStr(SensorHubQueue::NoDeadline,
+                        [&](const Result &res) { chained.set_value(res); });
+            });
+
+    auto f = chained.get_future();
+    ASSERT_EQ(future_status::ready, f.wait_for(LongWait));
+    EXPECT_EQ(Status::OK, f.get().status);
+}
+
+TEST(SensorHubQueueTest, CallbackCanQueueDuringShutdown) {
+    FakeHub fake;
+    unique_ptr<SensorHubQueue> owner(new SensorHubQueue(fake.executor()));
+    SensorHubQueue *queue = owner.get();
+    promise<Result> chained;
+
+    fake.hold();
+    auto blocker = queue->getFlashCrc();
+    ASSERT_TRUE(fake.waitBusy());
+
+    // Completed by the destructor, and the command it queues is refused
+    // on the spot. Its callback queues once more.
+    auto a = queue->readReg(anyReg(), 4, SensorHubQueue::NoDeadline,
+            [&](const Result &) {
+                queue->getVersionStr(SensorHubQueue::NoDeadline,
+                        [&](const Result &) {
+                            queue->getVersionStr(SensorHubQueue::NoDeadline,
+                                    [&](const Result &res) { chained.set_value(res); });
+                        });
+            });
+
+    thread releaser([&fake]() {
+        this_thread::sleep_for(chrono::milliseconds(100));
+        fake.release();
+    });
+    owner.reset();
+    releaser.join();
+
+    EXPECT_EQ(Status::SHUTDOWN, a.result.get().status);
+    auto f = chained.get_future();
+    ASSERT_EQ(future_status::ready, f.wait_for(LongWait));
+    EXPECT_EQ(Status::SHUTDOWN, f.get().status);
+}
@@ -0,0 +1,22 @@
+#ifndef BLACKLIST_H
+#define BLACKLIST_H
+
+#include <stdint.h>
+
+/* The compiled firmware blacklist, generated at build time from
+ * sensorhub-blacklist.txt by blacklist_gen.c.
+ *
+ * The file is a BlackListHeader followed by count CRCs. The CRCs are sorted
+ * in ascending order with no duplicates, so they can be binary searched
+ * straight from a mapping. All fields are little endian. */
+
+#define BLACKLIST_MAGIC "SHBL"
+#define BLACKLIST_VERSION 1
+
+struct BlackListHeader {
+    char magic[4];      /* BLACKLIST_MAGIC, not NUL terminated */
+    uint32_t version;   /* BLACKLIST_VERSION */
+    uint32_t count;     /* Number of CRCs following the header */
+};
+
+#endif
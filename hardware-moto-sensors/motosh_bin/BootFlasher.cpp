@@ -0,0 +1,214 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <cutils/log.h>
+
+#include "BootFlasher.hpp"
+#include "CRC32.h"
+#include "WaitReady.hpp"
+
+BootFlasher::BootFlasher(FlashTarget &target, BootReport &report,
+        size_t flashSize, uint8_t fill) :
+    target(target), report(report), flashSize(flashSize), fill(fill),
+    tries(3), retryDelayMs(250), resetTimeoutMs(3000)
+{
+}
+
+/** Erases and programs only the sectors that differ from the image. The
+ * bootloader must already be running. Sectors past the end of the image are
+ * expected to be blank.
+ *
+ * @param flashCrc Set to the flash CRC the hub should report once it is
+ * back in normal mode.
+ * @return A negative value on error, or 1 if the part should be mass erased
+ * and fully programmed instead. Nothing has been erased in that case.
+ */
+int BootFlasher::downloadChangedSectors(FirmwareImage &image,
+        uint32_t &flashCrc) {
+    size_t sectorSize = target.getSectorSize();
+    if (!sectorSize)
+        return 1;
+
+    size_t sectors = (flashSize + sectorSize - 1) / sectorSize;
+    uint32_t blankCrc = padCrc32(0, fill, sectorSize);
+    std::vector<bool> changed(sectors);
+    size_t nChanged = 0, nBlank = 0, sector, first;
+    uint32_t crc = 0;
+    int ret = 0;
+
+    report.begin(BootReport::SECTOR_CHECK);
+    for (sector = 0; sector < sectors && ret >= 0; sector++) {
+        ret = target.sectorCrc(sector * sectorSize, crc);
+        changed[sector] = crc != image.getSectorCrc(sector * sectorSize,
+                sectorSize, fill);
+        nChanged += changed[sector];
+        nBlank += crc == blankCrc;
+    }
+    report.end(BootReport::SECTOR_CHECK);
+    if (ret < 0) {
+        ALOGI("Sector CRC not available, using mass erase");
+        return 1;
+    }
+
+    ALOGI("%zu of %zu flash sectors changed", nChanged, sectors);
+    // A blank part, or one that differs nearly everywhere, is quicker to
+    // mass erase than to erase sector by sector.
+    if (nBlank == sectors || nChanged > sectors / 2)
+        return 1;
+
+    report.begin(BootReport::ERASE);
+    for (sector = 0; sector < sectors && ret >= 0; sector++) {
+        if (changed[sector])
+            ret = target.eraseSector(sector * sectorSize);
+    }
+    report.end(BootReport::ERASE);
+    if (ret < 0) {
+        ALOGE("Failed to erase STM sector: %s", strerror(errno));
+        return ret;
+    }
+
+    // Program each run of consecutive changed sectors as one range. Sectors
+    // past the end of the image only needed erasing.
+    report.begin(BootReport::PROGRAM);
+    for (sector = 0; sector < sectors && ret >= 0; ) {
+        if (!changed[sector]) {
+            sector++;
+            continue;
+        }
+        for (first = sector; sector < sectors && changed[sector]; sector++)
+            ;
+        if (first * sectorSize >= image.getSize())
+            break;
+        ret = target.program(image, first * sectorSize,
+                std::min(sector * sectorSize, image.getSize()), crc);
+        if (ret >= 0)
+            report.addBytes(ret);
+    }
+    report.end(BootReport::PROGRAM);
+    if (ret < 0) {
+        ALOGE("Failed to program STM: %s", strerror(errno));
+        return ret;
+    }
+
+    // Usually already computed by the version check
+    flashCrc = image.getFlashCrc(flashSize, fill);
+    return 0;
+}
+
+/** Erases the part and programs the image.
+ *
+ * @param changedOnly Try downloadChangedSectors() first.
+ * @param flashCrc Set to the flash CRC the hub should report once it is
+ * back in normal mode.
+ * @return A negative value on error.
+ */
+int BootFlasher::download(FirmwareImage &image, bool changedOnly,
+        uint32_t &flashCrc) {
+    uint32_t crc = 0;
+    int ret;
+
+    report.addDownload();
+
+    report.begin(BootReport::BOOTLOADER);
+    ret = target.enterBootloader();
+    report.end(BootReport::BOOTLOADER);
+    if (ret < 0) {
+        ALOGE("Failed to switch STM to bootloader mode: %s", strerror(errno));
+        return ret;
+    }
+
+    if (changedOnly) {
+        ret = downloadChangedSectors(image, flashCrc);
+        if (ret <= 0)
+            return ret;
+    }
+
+    report.begin(BootReport::ERASE);
+    ret = target.massErase();
+    report.end(BootReport::ERASE);
+    if (ret < 0) {
+        ALOGE("Failed to erase STM: %s", strerror(errno));
+        return ret;
+    }
+
+    report.begin(BootReport::PROGRAM);
+    ret = target.program(image, 0, image.getSize(), crc);
+    report.end(BootReport::PROGRAM);
+    if (ret < 0) {
+        ALOGE("Failed to program STM: %s", strerror(errno));
+        return ret;
+    }
+    report.addBytes(ret);
+
+    // The rest of the flash holds the fill value
+    flashCrc = image.getSize() < flashSize ?
+        padCrc32(crc, fill, flashSize - image.getSize()) : crc;
+    return 0;
+}
+
+/** Checks the flash CRC reported by the hub after a download.
+ *
+ * @return 0 if it matches, -1 if it differs, or 1 if the hub did not report
+ * a CRC.
+ */
+int BootFlasher::verify(uint32_t flashCrc) {
+    uint32_t hwCrc = target.getFlashCrc();
+    if (!hwCrc)
+        return 1;
+
+    ALOGI("FW CRC value: downloaded    = 0x%08X", flashCrc);
+    ALOGI("FW CRC value: in hardware   = 0x%08X", hwCrc);
+    printf("FW CRC value: downloaded    = 0x%08X\n", flashCrc);
+    printf("FW CRC value: in hardware   = 0x%08X\n", hwCrc);
+    return hwCrc == flashCrc ? 0 : -1;
+}
+
+int BootFlasher::flash(FirmwareImage &image) {
+    uint32_t flashCrc = 0;
+    int ret;
+
+    for (int i = 0; i < tries; i++) {
+        if (i > 0)
+            usleep(retryDelayMs * 1000);
+        if (download(image, i == 0, flashCrc) < 0)
+            continue;
+
+        report.begin(BootReport::RESET);
+        target.enterNormalMode();
+        printf("\n");
+        report.end(BootReport::RESET);
+
+        // IOCTLS will be briefly blocked during part reset, so poll until
+        // the new CRC shows up (or we give up).
+        report.begin(BootReport::VERIFY);
+        stm_waitReady([this, flashCrc]() {
+            report.addCrcPoll();
+            return target.getFlashCrc() == flashCrc;
+        }, resetTimeoutMs);
+        ret = verify(flashCrc);
+        report.end(BootReport::VERIFY);
+
+        if (ret == 0) {
+            ALOGI("Firmware download completed successfully");
+            printf("Firmware download completed successfully\n");
+            report.setOutcome("flashed");
+            return 0;
+        } else if (ret > 0) {
+            // No answer from the hub; nothing to gain by flashing it again.
+            ALOGE("Firmware download error");
+            printf("Firmware download error\n");
+            report.setOutcome("flashed_unverified");
+            return 0;
+        }
+        ALOGE("Firmware verify failed, retrying");
+        printf("Firmware verify failed, retrying\n");
+    }
+
+    report.setOutcome("flash_failed");
+    return -1;
+}
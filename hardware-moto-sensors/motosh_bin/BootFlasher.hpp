@@ -0,0 +1,114 @@
+#ifndef BOOT_FLASHER_HPP
+#define BOOT_FLASHER_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "BootReport.hpp"
+#include "FirmwareImage.hpp"
+
+/** The hub operations a firmware download is made of.
+ *
+ * motosh implements them with the driver ioctls; the tests use a fake hub.
+ * Every call returns a negative value on error.
+ */
+class FlashTarget {
+    public:
+        virtual ~FlashTarget() {}
+
+        virtual int enterBootloader() = 0;
+        virtual int massErase() = 0;
+
+        /** Programs [offset, end) of the image into erased flash.
+         *
+         * @param crc Set to the CRC (see updateCrc32()) of the image bytes
+         * in the range.
+         * @return The number of bytes written, padding included.
+         */
+        virtual int program(FirmwareImage &image, size_t offset, size_t end,
+                uint32_t &crc) = 0;
+
+        /** The optional sector hooks. Without them every download is a
+         * mass erase and a full program.
+         *
+         * @return The size of the flash sectors which sectorCrc() and
+         * eraseSector() work on, or 0 if the bootloader has no sector
+         * commands.
+         */
+        virtual size_t getSectorSize() { return 0; }
+
+        /** Reads back the CRC (see updateCrc32()) of one flash sector, in
+         * bootloader mode.
+         *
+         * @param offset The flash offset of the sector.
+         */
+        virtual int sectorCrc(size_t /* offset */, uint32_t & /* crc */) {
+            return -1;
+        }
+
+        /** Erases one flash sector, in bootloader mode. */
+        virtual int eraseSector(size_t /* offset */) { return -1; }
+
+        /** Resets the hub into the firmware. */
+        virtual int enterNormalMode() = 0;
+
+        /** @return The flash CRC reported by the running firmware, or 0 if
+         * it does not answer. */
+        virtual uint32_t getFlashCrc() = 0;
+};
+
+/** Downloads a firmware image at boot and checks that the hub runs it.
+ *
+ * Every phase is timed in the BootReport, which also gets the outcome.
+ */
+class BootFlasher {
+    public:
+        /**
+         * @param flashSize The size of the hub flash.
+         * @param fill The value of unused flash.
+         */
+        BootFlasher(FlashTarget &target, BootReport &report, size_t flashSize,
+                uint8_t fill);
+
+        BootFlasher(const BootFlasher &) = delete;
+        BootFlasher & operator=(const BootFlasher &) = delete;
+
+        /** Sets how many downloads are tried and the pause between them. */
+        void setRetries(int tries, int delayMs) {
+            this->tries = tries;
+            retryDelayMs = delayMs;
+        }
+
+        /** Sets how long a freshly flashed hub may take to report its CRC. */
+        void setResetTimeout(int ms) { resetTimeoutMs = ms; }
+
+        /** Writes the image, resets the hub and waits for it to report the
+         * CRC of the new flash contents. A mismatch is retried; a hub that
+         * does not answer at all is not.
+         *
+         * The first try erases and programs only the sectors whose CRC
+         * differs from the image. It falls back to a mass erase and a full
+         * program if the target has no sector hooks, if the part is blank or
+         * if most sectors changed. Retries always mass erase, since a failed
+         * try may have left the part half written.
+         *
+         * @return 0 on success, or a negative value once every try failed.
+         */
+        int flash(FirmwareImage &image);
+
+    private:
+        int download(FirmwareImage &image, bool changedOnly,
+                uint32_t &flashCrc);
+        int downloadChangedSectors(FirmwareImage &image, uint32_t &flashCrc);
+        int verify(uint32_t flashCrc);
+
+        FlashTarget &target;
+        BootReport &report;
+        const size_t flashSize;
+        const uint8_t fill;
+        int tries;
+        int retryDelayMs;
+        int resetTimeoutMs;
+};
+
+#endif // BOOT_FLASHER_HPP
@@ -0,0 +1,88 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "BootReport.hpp"
+
+using namespace std;
+
+const char * const BootReport::PhaseNames[PHASE_COUNT] = {
+    "blacklist",
+    "hub_wait",
+    "version_check",
+    "bootloader",
+    "sector_check",
+    "erase",
+    "program",
+    "reset",
+    "verify",
+    "capsense",
+};
+
+BootReport::BootReport() :
+    startUs(nowUs()), phaseStartUs(), phaseUs(), phaseCount(),
+    bytes(0), crcPolls(0), downloads(0), outcome("error")
+{
+}
+
+uint64_t BootReport::nowUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void BootReport::begin(Phase phase) {
+    phaseStartUs[phase] = nowUs();
+    phaseCount[phase]++;
+}
+
+void BootReport::end(Phase phase) {
+    phaseUs[phase] += nowUs() - phaseStartUs[phase];
+}
+
+string BootReport::summary() const {
+    char buf[64];
+    string s = outcome;
+
+    snprintf(buf, sizeof(buf), " in %" PRIu64 " ms", (nowUs() - startUs) / 1000);
+    s += buf;
+    const char *sep = ": ";
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        if (!phaseCount[i]) continue;
+        snprintf(buf, sizeof(buf), "%s%s %" PRIu64 " ms", sep, PhaseNames[i],
+                phaseUs[i] / 1000);
+        sep = ", ";
+        s += buf;
+        if (phaseCount[i] > 1) {
+            snprintf(buf, sizeof(buf), " (x%u)", phaseCount[i]);
+            s += buf;
+        }
+    }
+    if (downloads) {
+        snprintf(buf, sizeof(buf), ", %u download(s), %zu bytes", downloads, bytes);
+        s += buf;
+    }
+    if (crcPolls) {
+        snprintf(buf, sizeof(buf), ", %u CRC poll(s)", crcPolls);
+        s += buf;
+    }
+    return s;
+}
+
+bool BootReport::write(const char *path) const {
+    FILE *f = fopen(path, "w");
+    if (!f) return false;
+
+    fprintf(f, "outcome=%s\n", outcome.c_str());
+    fprintf(f, "total_us=%" PRIu64 "\n", nowUs() - startUs);
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        fprintf(f, "%s_us=%" PRIu64 "\n", PhaseNames[i], phaseUs[i]);
+        fprintf(f, "%s_count=%u\n", PhaseNames[i], phaseCount[i]);
+    }
+    fprintf(f, "downloads=%u\n", downloads);
+    fprintf(f, "bytes=%zu\n", bytes);
+    fprintf(f, "crc_polls=%u\n", crcPolls);
+
+    bool ok = !ferror(f);
+    return (fclose(f) == 0) && ok;
+}
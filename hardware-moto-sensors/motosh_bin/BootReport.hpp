@@ -0,0 +1,71 @@
+#ifndef BOOT_REPORT_HPP
+#define BOOT_REPORT_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+
+/** Collects where the time goes during "motosh boot".
+ *
+ * Each phase accumulates its time over every time it is entered, so retried
+ * phases show their total cost and their count. The report can be saved as
+ * key=value lines for tools, and summarized as a single log line.
+ */
+class BootReport {
+    public:
+        enum Phase {
+            BLACKLIST,      //< Blacklist check of the APK firmware
+            HUB_WAIT,       //< Waiting for the hub to report its CRC
+            VERSION_CHECK,  //< Comparing the file and hub firmware
+            BOOTLOADER,     //< Switching to bootloader mode
+            SECTOR_CHECK,   //< Reading the hub sector CRCs
+            ERASE,          //< Mass erase, or erase of the changed sectors
+            PROGRAM,        //< Writing the packets
+            RESET,          //< Switching back to normal mode
+            VERIFY,         //< Waiting for the hub flash CRC to match the download
+            CAPSENSE,       //< Capsense firmware check (concurrent with the above)
+            PHASE_COUNT
+        };
+
+        BootReport();
+
+        /** Marks the start of a phase. */
+        void begin(Phase phase);
+        /** Marks the end of a phase started with begin(). */
+        void end(Phase phase);
+        /** @return The total time spent in a phase, in microseconds. */
+        uint64_t getUs(Phase phase) const { return phaseUs[phase]; }
+
+        void addBytes(size_t n) { bytes += n; }
+        void addCrcPoll() { crcPolls++; }
+        void addDownload() { downloads++; }
+
+        /** Sets a short, space-free description of how the boot ended. */
+        void setOutcome(const char *desc) { outcome = desc; }
+
+        /** @return A one line, human readable summary. */
+        std::string summary() const;
+
+        /** Saves the report as key=value lines, replacing the file.
+         *
+         * @return True on success.
+         */
+        bool write(const char *path) const;
+
+    private:
+        static uint64_t nowUs();
+
+        static const char * const PhaseNames[PHASE_COUNT];
+
+        uint64_t startUs;
+        uint64_t phaseStartUs[PHASE_COUNT];
+        uint64_t phaseUs[PHASE_COUNT];
+        unsigned phaseCount[PHASE_COUNT];
+        size_t bytes;
+        unsigned crcPolls;
+        unsigned downloads;
+        std::string outcome;
+};
+
+#endif // BOOT_REPORT_HPP
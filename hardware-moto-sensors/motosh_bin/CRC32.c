@@ -1,4 +1,14 @@
-#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
 #include "CRC32.h"
 
 /*****************************************************************/
@@ -21,7 +31,7 @@
 /*                                                               */
 /*****************************************************************/
 
-static uint32_t CrcTableRev[256] = {
+static const uint32_t CrcTableRev[256] = {
     0x00000000L, 0x77073096L, 0xEE0E612CL, 0x990951BAL,
     0x076DC419L, 0x706AF48FL, 0xE963A535L, 0x9E6495A3L,
     0x0EDB8832L, 0x79DCB8A4L, 0xE0D5E91EL, 0x97D2D988L,
@@ -95,21 +105,150 @@ static uint32_t CrcTableRev[256] = {
 static const uint32_t CrcInit = 0xffFFffFFL;
 static const uint32_t XoRot   = 0xffFFffFFL;
 
+/** Size of the blocks read from the firmware file. */
+#define CRC_FILE_BLOCK (64 * 1024)
+
+#if !defined(__ARM_FEATURE_CRC32) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define CRC_SLICE_BY_8
+
+/** CrcTableSlice[k][n] is the CRC register contribution of byte n followed by
+ * k zero bytes. CrcTableSlice[0] is CrcTableRev. Built on first use; the
+ * flash pipeline computes CRCs on its own thread, hence the pthread_once. */
+static uint32_t CrcTableSlice[8][256];
+static pthread_once_t CrcTableSliceOnce = PTHREAD_ONCE_INIT;
+
+static void initSliceTables(void) {
+    int n, k;
+
+    for (n = 0; n < 256; n++) {
+        CrcTableSlice[0][n] = CrcTableRev[n];
+    }
+    for (k = 1; k < 8; k++) {
+        for (n = 0; n < 256; n++) {
+            uint32_t prev = CrcTableSlice[k - 1][n];
+            CrcTableSlice[k][n] = CrcTableRev[prev & 0xFF] ^ (prev >> 8);
+        }
+    }
+}
+#endif
+
+/** Runs the raw (non-inverted) CRC register over a block of data. */
+static uint32_t crcBlock(uint32_t crc, const uint8_t *data, size_t dataLen) {
+#if defined(__ARM_FEATURE_CRC32)
+    // ARMv8 CRC32 instructions use the same reflected polynomial.
+    while (dataLen && ((uintptr_t)data & 7)) {
+        crc = __crc32b(crc, *data++);
+        dataLen--;
+    }
+    while (dataLen >= 8) {
+        crc = __crc32d(crc, *(const uint64_t *)data);
+        data += 8;
+        dataLen -= 8;
+    }
+#elif defined(CRC_SLICE_BY_8)
+    pthread_once(&CrcTableSliceOnce, initSliceTables);
+
+    // Slice-by-8: eight table lookups per 8 bytes instead of a dependent
+    // lookup per byte.
+    while (dataLen >= 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, data, sizeof(lo));
+        memcpy(&hi, data + 4, sizeof(hi));
+        lo ^= crc;
+        crc = CrcTableSlice[7][lo & 0xFF] ^ CrcTableSlice[6][(lo >> 8) & 0xFF] ^
+              CrcTableSlice[5][(lo >> 16) & 0xFF] ^ CrcTableSlice[4][lo >> 24] ^
+              CrcTableSlice[3][hi & 0xFF] ^ CrcTableSlice[2][(hi >> 8) & 0xFF] ^
+              CrcTableSlice[1][(hi >> 16) & 0xFF] ^ CrcTableSlice[0][hi >> 24];
+        data += 8;
+        dataLen -= 8;
+    }
+#endif
+
+    // Reflected form (matches the table)
+    while (dataLen--) {
+        crc = CrcTableRev[(crc ^ *data++) & 0xFFL] ^ (crc >> 8);
+    }
+
+    return crc;
+}
+
+/** Multiplies a GF(2) 32x32 matrix (one column per word) by a vector. */
+static uint32_t gf2MatrixTimes(const uint32_t *mat, uint32_t vec) {
+    uint32_t sum = 0;
+
+    while (vec) {
+        if (vec & 1) sum ^= *mat;
+        vec >>= 1;
+        mat++;
+    }
+    return sum;
+}
+
+/** square = mat * mat */
+static void gf2MatrixSquare(uint32_t *square, const uint32_t *mat) {
+    int n;
+
+    for (n = 0; n < 32; n++) {
+        square[n] = gf2MatrixTimes(mat, mat[n]);
+    }
+}
+
+/** Advances the raw CRC register over fillLen copies of the fill byte.
+ *
+ * Feeding one byte b maps the register r to L(r) ^ T[b], where L is linear.
+ * Feeding 2^k fill bytes is therefore r -> L^(2^k)(r) ^ S_k, with
+ * S_(k+1) = L^(2^k)(S_k) ^ S_k. Walking the bits of fillLen takes O(log n)
+ * matrix squarings instead of one table lookup per byte.
+ */
+static uint32_t crcFill(uint32_t crc, uint8_t fill, size_t fillLen) {
+    uint32_t mat[32], square[32];
+    uint32_t sum;
+    int n;
+
+    if (fillLen < 64) {
+        while (fillLen--) {
+            crc = CrcTableRev[(crc ^ fill) & 0xFFL] ^ (crc >> 8);
+        }
+        return crc;
+    }
+
+    // L^1 and S_0
+    for (n = 0; n < 32; n++) {
+        uint32_t bit = 1UL << n;
+        mat[n] = CrcTableRev[bit & 0xFF] ^ (bit >> 8);
+    }
+    sum = CrcTableRev[fill];
+
+    while (1) {
+        if (fillLen & 1) {
+            crc = gf2MatrixTimes(mat, crc) ^ sum;
+        }
+        fillLen >>= 1;
+        if (!fillLen) break;
+
+        sum = gf2MatrixTimes(mat, sum) ^ sum;
+        gf2MatrixSquare(square, mat);
+        memcpy(mat, square, sizeof(mat));
+    }
+
+    return crc;
+}
+
 /** Computes a 32-bit CRC using the Ethernet polynomial.
  *
  * @param data Pointer to data block to compute CRC over.
  * @param dataLen Length of the data block.
  * @return A 32-bit CRC value. */
 uint32_t calculateCrc32(uint8_t *data, size_t dataLen) {
+    return updateCrc32(0, data, dataLen);
+}
 
-    uint32_t crc = CrcInit;
-
-    // Reflected form (matches the table)
-    while (dataLen--) {
-        crc = CrcTableRev[(crc ^ *data++) & 0xFFL] ^ (crc >> 8);
-    }
+uint32_t updateCrc32(uint32_t crc, const uint8_t *data, size_t dataLen) {
+    return crcBlock(crc ^ CrcInit, data, dataLen) ^ XoRot;
+}
 
-    return crc ^ XoRot;
+uint32_t padCrc32(uint32_t crc, uint8_t fill, size_t fillLen) {
+    return crcFill(crc ^ CrcInit, fill, fillLen) ^ XoRot;
 }
 
 /** Computes a 32-bit CRC using the Ethernet polynomial.
@@ -130,23 +269,34 @@ uint32_t calculateCrc32(uint8_t *data, size_t dataLen) {
  * @return Returns 0 on success or a negative value on error.
  */
 int calculateFileCrc32(char *filePath, size_t dataLen, uint8_t fill, uint32_t *outCrc) {
-    FILE *f = fopen(filePath, "r");
-    if (!f) return -1;
+    uint8_t *buff = malloc(CRC_FILE_BLOCK);
+    if (!buff) return -1;
+    int fd = open(filePath, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        free(buff);
+        return -1;
+    }
 
-    int c;
+    ssize_t n;
     size_t sz = 0;
     uint32_t crc = CrcInit;
-    while ((c = fgetc(f)) != EOF) {
-        crc = CrcTableRev[(crc ^ (uint8_t)c) & 0xFFL] ^ (crc >> 8);
-        sz++;
+    while ((n = read(fd, buff, CRC_FILE_BLOCK)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            close(fd);
+            free(buff);
+            return -1;
+        }
+        crc = crcBlock(crc, buff, n);
+        sz += n;
     }
-    fclose(f);
+    close(fd);
+    free(buff);
 
-    while (sz++ < dataLen) {
-        crc = CrcTableRev[(crc ^ (uint8_t)fill) & 0xFFL] ^ (crc >> 8);
+    if (sz < dataLen) {
+        crc = crcFill(crc, fill, dataLen - sz);
     }
 
     *outCrc = crc ^ XoRot;
     return 0;
 }
-
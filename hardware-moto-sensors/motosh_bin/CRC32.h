@@ -9,6 +9,18 @@ extern "C" {
 #include <stddef.h>
 
 uint32_t calculateCrc32(uint8_t *data, size_t dataLen);
+
+/** Continues a CRC over another block of data.
+ *
+ * @param crc The CRC of the preceding data, or 0 to start a new CRC.
+ * @return The CRC of the preceding data followed by this block. */
+uint32_t updateCrc32(uint32_t crc, const uint8_t *data, size_t dataLen);
+
+/** Continues a CRC over fillLen copies of the fill byte, in O(log fillLen).
+ *
+ * @see updateCrc32() */
+uint32_t padCrc32(uint32_t crc, uint8_t fill, size_t fillLen);
+
 int calculateFileCrc32(char *filePath, size_t dataLen, uint8_t fill, uint32_t *outCrc);
 
 #ifdef __cplusplus
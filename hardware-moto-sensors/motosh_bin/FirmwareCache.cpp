@@ -0,0 +1,118 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cutils/log.h>
+
+#include "FirmwareCache.hpp"
+
+using namespace std;
+
+/** First line of the cache file. Bump the number if the format changes. */
+static const char CacheHeader[] = "motosh-fwcache 1\n";
+
+FirmwareCache::FirmwareCache(const char *cachePath) :
+    cachePath(cachePath), loaded(false), entries()
+{
+}
+
+bool FirmwareCache::Entry::matches(const struct stat &st) const {
+    return dev == (uint64_t)st.st_dev && ino == (uint64_t)st.st_ino &&
+        size == (uint64_t)st.st_size &&
+        mtimeSec == (int64_t)st.st_mtim.tv_sec &&
+        mtimeNsec == (int64_t)st.st_mtim.tv_nsec;
+}
+
+bool FirmwareCache::lookup(const string &path, const struct stat &st,
+        uint32_t &crc, string &version) {
+    load();
+
+    auto it = entries.find(path);
+    if (it == entries.end() || !it->second.matches(st)) return false;
+
+    crc = it->second.crc;
+    version = it->second.version;
+    return true;
+}
+
+void FirmwareCache::store(const string &path, const struct stat &st,
+        uint32_t crc, const string &version) {
+    load();
+
+    Entry &e = entries[path];
+    e.dev = st.st_dev;
+    e.ino = st.st_ino;
+    e.size = st.st_size;
+    e.mtimeSec = st.st_mtim.tv_sec;
+    e.mtimeNsec = st.st_mtim.tv_nsec;
+    e.crc = crc;
+    e.version = version;
+
+    save();
+}
+
+void FirmwareCache::load() {
+    if (loaded) return;
+    loaded = true;
+
+    FILE *f = fopen(cachePath.c_str(), "r");
+    if (!f) return; // First boot, or the cache was wiped
+
+    char *line = NULL;
+    size_t len = 0;
+    ssize_t read = getline(&line, &len, f);
+    if (read < 0 || strcmp(line, CacheHeader) != 0) goto EXIT;
+
+    // <path> <dev> <ino> <size> <mtime sec> <mtime nsec> <crc> <version>
+    while ((read = getline(&line, &len, f)) != -1) {
+        char path[256];
+        Entry e;
+        int versionStart = 0;
+
+        if (read > 0 && line[read - 1] == '\n') line[read - 1] = '\0';
+        if (sscanf(line, "%255s %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNd64
+                    " %" SCNd64 " %" SCNx32 " %n",
+                    path, &e.dev, &e.ino, &e.size, &e.mtimeSec, &e.mtimeNsec,
+                    &e.crc, &versionStart) != 7 || versionStart == 0) {
+            ALOGW("Ignoring corrupt firmware cache entry in %s", cachePath.c_str());
+            continue;
+        }
+        e.version = line + versionStart;
+        entries[path] = e;
+    }
+
+EXIT:
+    fclose(f);
+    free(line);
+}
+
+void FirmwareCache::save() const {
+    string tmpPath = cachePath + ".tmp";
+    FILE *f = fopen(tmpPath.c_str(), "w");
+    if (!f) {
+        ALOGW("Unable to write firmware cache %s: %s", tmpPath.c_str(),
+                strerror(errno));
+        return;
+    }
+
+    bool ok = fputs(CacheHeader, f) >= 0;
+    for (const auto &it : entries) {
+        const Entry &e = it.second;
+        ok = ok && fprintf(f, "%s %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRId64
+                " %" PRId64 " %08" PRIx32 " %s\n",
+                it.first.c_str(), e.dev, e.ino, e.size, e.mtimeSec,
+                e.mtimeNsec, e.crc, e.version.c_str()) >= 0;
+    }
+    ok = (fflush(f) == 0) && ok;
+    ok = (fsync(fileno(f)) == 0) && ok;
+    ok = (fclose(f) == 0) && ok;
+
+    // Replace the old cache in one step so a crash never leaves it torn
+    if (!ok || rename(tmpPath.c_str(), cachePath.c_str()) != 0) {
+        ALOGW("Unable to save firmware cache %s", cachePath.c_str());
+        unlink(tmpPath.c_str());
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef FIRMWARE_CACHE_HPP
+#define FIRMWARE_CACHE_HPP
+
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include <map>
+#include <string>
+
+/** A persistent cache of the flash CRC and version string of firmware files.
+ *
+ * Entries are keyed by path and validated against the device, inode, size
+ * and modification time of the file, so an unchanged firmware file is never
+ * read again. The cache file is small plain text, rewritten atomically
+ * whenever an entry changes.
+ */
+class FirmwareCache {
+    public:
+        /**
+         * @param cachePath The cache file. It is read on first use.
+         */
+        explicit FirmwareCache(const char *cachePath);
+
+        /** Looks up a firmware file.
+         *
+         * @param path The firmware file path.
+         * @param st The current fstat() of the file.
+         * @param crc Set to the cached flash CRC on a hit.
+         * @param version Set to the cached version string on a hit.
+         * @return True on a hit.
+         */
+        bool lookup(const std::string &path, const struct stat &st,
+                uint32_t &crc, std::string &version);
+
+        /** Records the metadata of a firmware file and saves the cache. */
+        void store(const std::string &path, const struct stat &st,
+                uint32_t crc, const std::string &version);
+
+    private:
+        struct Entry {
+            Entry() : dev(0), ino(0), size(0), mtimeSec(0), mtimeNsec(0),
+                crc(0), version() {}
+
+            uint64_t dev;
+            uint64_t ino;
+            uint64_t size;
+            int64_t mtimeSec;
+            int64_t mtimeNsec;
+            uint32_t crc;
+            std::string version;
+
+            bool matches(const struct stat &st) const;
+        };
+
+        void load();
+        void save() const;
+
+        const std::string cachePath;
+        bool loaded;
+        std::map<std::string, Entry> entries;
+};
+
+#endif // FIRMWARE_CACHE_HPP
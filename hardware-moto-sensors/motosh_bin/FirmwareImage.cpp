@@ -0,0 +1,142 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <cutils/log.h>
+
+#include "CRC32.h"
+#include "FirmwareImage.hpp"
+
+using namespace std;
+
+/** Length of the version address trailer: 8 hex digits and '\n'. */
+static const size_t VersionTrailerLen = 9;
+
+FirmwareImage::FirmwareImage() :
+    path(), image(nullptr), size(0), st(),
+    crcValid(false), crcFlashSize(0), crcFill(0), crc(0), tail()
+{
+}
+
+FirmwareImage::~FirmwareImage() {
+    close();
+}
+
+bool FirmwareImage::open(const char *filePath) {
+    void *map;
+    int fd;
+
+    close();
+
+    fd = ::open(filePath, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        ALOGE("Unable to open firmware %s: %s", filePath, strerror(errno));
+        return false;
+    }
+
+    if (fstat(fd, &st) < 0 || st.st_size <= 0) {
+        ALOGE("Invalid firmware %s", filePath);
+        ::close(fd);
+        return false;
+    }
+
+    map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        ALOGE("Unable to map firmware %s: %s", filePath, strerror(errno));
+        return false;
+    }
+
+    // The whole image is read front to back for the CRC and the download.
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    image = static_cast<uint8_t *>(map);
+    size = st.st_size;
+    path = filePath;
+    return true;
+}
+
+void FirmwareImage::close() {
+    if (image) {
+        munmap(image, size);
+    }
+    image = nullptr;
+    size = 0;
+    path.clear();
+    crcValid = false;
+    tail.clear();
+}
+
+string FirmwareImage::getVersion(size_t maxLen) const {
+    if (!image || size < VersionTrailerLen) return string();
+
+    char offsetStr[VersionTrailerLen];
+    memcpy(offsetStr, image + size - VersionTrailerLen, VersionTrailerLen - 1);
+    offsetStr[VersionTrailerLen - 1] = '\0';
+
+    char *end;
+    unsigned long address = strtoul(offsetStr, &end, 16);
+    if (end != offsetStr + VersionTrailerLen - 1) {
+        ALOGE("Bad firmware version address \"%s\"", offsetStr);
+        return string();
+    }
+
+    // Drop the MSB, which is the flash base (typically 0x08000000). We want
+    // the file offset, which is relative to the start of the flash.
+    size_t offset = address & 0x00FFFFFF;
+    if (offset >= size) return string();
+
+    // The string must be terminated within the image and fit the hub buffer
+    const uint8_t *start = image + offset;
+    const uint8_t *nul = static_cast<const uint8_t *>(
+            memchr(start, '\0', min(size - offset, maxLen - 1)));
+    if (!nul) return string();
+
+    return string(reinterpret_cast<const char *>(start), nul - start);
+}
+
+uint32_t FirmwareImage::getFlashCrc(size_t flashSize, uint8_t fill) {
+    if (!image) return 0;
+
+    if (!crcValid || crcFlashSize != flashSize || crcFill != fill) {
+        crc = updateCrc32(0, image, size);
+        if (size < flashSize) {
+            crc = padCrc32(crc, fill, flashSize - size);
+        }
+        crcFlashSize = flashSize;
+        crcFill = fill;
+        crcValid = true;
+    }
+
+    return crc;
+}
+
+uint32_t FirmwareImage::getSectorCrc(size_t offset, size_t sectorSize,
+        uint8_t fill) const {
+    size_t len = offset < size ? min(size - offset, sectorSize) : 0;
+    uint32_t sectorCrc = len ? updateCrc32(0, image + offset, len) : 0;
+    return padCrc32(sectorCrc, fill, sectorSize - len);
+}
+
+size_t FirmwareImage::getPacket(size_t offset, size_t maxLen, uint8_t fill,
+        const uint8_t **packet) {
+    if (!image || offset >= size) return 0;
+
+    size_t len = min(size - offset, maxLen);
+
+    /* packet size needs to be a multiple of 8 bytes (64 bits) */
+    if (len == maxLen || len % 8 == 0) {
+        *packet = image + offset;
+        return len;
+    }
+
+    size_t padded = min((len + 7) & ~(size_t)7, maxLen);
+    tail.assign(image + offset, image + offset + len);
+    tail.resize(padded, fill);
+    *packet = tail.data();
+    return padded;
+}
@@ -0,0 +1,98 @@
+#ifndef FIRMWARE_IMAGE_HPP
+#define FIRMWARE_IMAGE_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+
+/** A read-only memory mapping of a SensorHub firmware binary.
+ *
+ * A single mapping serves the version string lookup, the flash CRC and the
+ * download packets, so the file is only opened and read once per boot.
+ */
+class FirmwareImage {
+    public:
+        FirmwareImage();
+        ~FirmwareImage();
+
+        FirmwareImage(const FirmwareImage &) = delete;
+        FirmwareImage & operator=(const FirmwareImage &) = delete;
+
+        /** Maps a firmware file, replacing any previous mapping.
+         *
+         * @return True on success.
+         */
+        bool open(const char *filePath);
+
+        /** Unmaps the file. */
+        void close();
+
+        bool isOpen() const { return image != nullptr; }
+        const std::string & getPath() const { return path; }
+        const uint8_t * getData() const { return image; }
+        size_t getSize() const { return size; }
+        /** The fstat() of the file when it was mapped. */
+        const struct stat & getStat() const { return st; }
+
+        /** Extracts the firmware version string.
+         *
+         * The build system appends the flash address of the version string
+         * as 8 ASCII hex digits and a '\n' to the end of the binary.
+         *
+         * @param maxLen The size of the hub's version string buffer,
+         * including the terminator.
+         * @return The version, or an empty string on error.
+         */
+        std::string getVersion(size_t maxLen) const;
+
+        /** Computes the CRC the SensorHub would report for this image once
+         * flashed, i.e. over flashSize bytes with the unused part of the
+         * flash holding the fill value. The result is cached.
+         */
+        uint32_t getFlashCrc(size_t flashSize, uint8_t fill);
+
+        /** Computes the CRC of one flash sector as it would be programmed
+         * from this image. Sectors at or past the end of the image hold only
+         * the fill value.
+         *
+         * @param offset The file offset of the sector.
+         * @param sectorSize The sector size in bytes.
+         * @param fill The value of erased/unused flash.
+         */
+        uint32_t getSectorCrc(size_t offset, size_t sectorSize,
+                uint8_t fill) const;
+
+        /** Gets the download packet that starts at the given file offset.
+         *
+         * Full packets point straight into the mapping. Only the last packet
+         * is copied, to pad it to a multiple of 8 bytes with the fill value.
+         *
+         * @param offset The file offset of the packet.
+         * @param maxLen The maximum packet length.
+         * @param fill The padding value.
+         * @param packet Set to the packet data. Valid until the next call or
+         * until the image is closed.
+         * @return The packet length, or 0 past the end of the image.
+         */
+        size_t getPacket(size_t offset, size_t maxLen, uint8_t fill,
+                const uint8_t **packet);
+
+    private:
+        std::string path;
+        uint8_t *image;
+        size_t size;
+        struct stat st;
+
+        bool crcValid;
+        size_t crcFlashSize;
+        uint8_t crcFill;
+        uint32_t crc;
+
+        /** Holds the padded last packet. */
+        std::vector<uint8_t> tail;
+};
+
+#endif // FIRMWARE_IMAGE_HPP
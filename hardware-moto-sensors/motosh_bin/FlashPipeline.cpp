@@ -0,0 +1,82 @@
+#include <algorithm>
+
+#include "CRC32.h"
+#include "FlashPipeline.hpp"
+
+using namespace std;
+
+FlashPipeline::FlashPipeline(FirmwareImage &image, size_t begin, size_t end,
+        size_t maxLen, uint8_t fill) :
+    image(image), begin(begin), end(min(end, image.getSize())),
+    maxLen(maxLen), fill(fill), lock(), cond(), ring(),
+    produced(0), consumed(0), done(false), stop(false), crc(0),
+    producer(&FlashPipeline::produce, this)
+{
+}
+
+FlashPipeline::~FlashPipeline() {
+    {
+        lock_guard<mutex> guard(lock);
+        stop = true;
+    }
+    cond.notify_all();
+    producer.join();
+}
+
+void FlashPipeline::produce() {
+    uint32_t runningCrc = 0;
+    size_t offset = begin;
+
+    while (offset < end) {
+        Packet pkt;
+        // Range ends are 8-byte aligned unless they are the end of the image,
+        // where getPacket() pads the short packet.
+        size_t limit = min(maxLen, (end - offset + 7) & ~(size_t)7);
+        size_t dataLen = min(limit, end - offset);
+
+        pkt.len = image.getPacket(offset, limit, fill, &pkt.data);
+        if (pkt.len == 0)
+            break;
+        // This also faults the next pages of the mapping in, off the bus
+        // writer's critical path.
+        runningCrc = updateCrc32(runningCrc, pkt.data, dataLen);
+        offset += limit;
+
+        unique_lock<mutex> guard(lock);
+        cond.wait(guard, [this] { return stop || produced - consumed < Depth; });
+        if (stop)
+            return;
+        ring[produced % Depth] = pkt;
+        produced++;
+        guard.unlock();
+        cond.notify_all();
+    }
+
+    {
+        lock_guard<mutex> guard(lock);
+        crc = runningCrc;
+        done = true;
+    }
+    cond.notify_all();
+}
+
+size_t FlashPipeline::next(const uint8_t **packet) {
+    unique_lock<mutex> guard(lock);
+    cond.wait(guard, [this] { return done || consumed < produced; });
+    if (consumed == produced)
+        return 0;
+
+    const Packet &pkt = ring[consumed % Depth];
+    *packet = pkt.data;
+    size_t len = pkt.len;
+    consumed++;
+    guard.unlock();
+    cond.notify_all();
+    return len;
+}
+
+uint32_t FlashPipeline::getCrc() {
+    unique_lock<mutex> guard(lock);
+    cond.wait(guard, [this] { return done; });
+    return crc;
+}
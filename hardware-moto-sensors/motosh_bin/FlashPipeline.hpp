@@ -0,0 +1,82 @@
+#ifndef FLASH_PIPELINE_HPP
+#define FLASH_PIPELINE_HPP
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "FirmwareImage.hpp"
+
+/** Streams the download packets of a firmware image range.
+ *
+ * A producer thread walks the range ahead of the caller. It faults the
+ * mapped pages in and keeps a running CRC of the image bytes, while the
+ * caller writes the previous packets to the driver. The producer stays at
+ * most Depth packets ahead.
+ */
+class FlashPipeline {
+    public:
+        /**
+         * @param image The mapped image. Must stay open while the pipeline
+         * exists.
+         * @param begin The file offset of the first packet.
+         * @param end The file offset past the last packet. Clamped to the
+         * image size.
+         * @param maxLen The maximum packet length. Must be a multiple of 8.
+         * @param fill The value used to pad the last packet.
+         */
+        FlashPipeline(FirmwareImage &image, size_t begin, size_t end,
+                size_t maxLen, uint8_t fill);
+        ~FlashPipeline();
+
+        FlashPipeline(const FlashPipeline &) = delete;
+        FlashPipeline & operator=(const FlashPipeline &) = delete;
+
+        /** Waits for the next packet.
+         *
+         * @param packet Set to the packet data. Valid until the pipeline is
+         * destroyed.
+         * @return The packet length, or 0 once the range is done.
+         */
+        size_t next(const uint8_t **packet);
+
+        /** Returns the CRC (as in updateCrc32()) of the image bytes in the
+         * range, without the padding. Waits for the producer to finish.
+         */
+        uint32_t getCrc();
+
+    private:
+        static const size_t Depth = 8;
+
+        struct Packet {
+            const uint8_t *data;
+            size_t len;
+        };
+
+        void produce();
+
+        FirmwareImage &image;
+        const size_t begin;
+        const size_t end;
+        const size_t maxLen;
+        const uint8_t fill;
+
+        std::mutex lock;
+        std::condition_variable cond;
+        Packet ring[Depth];
+        /** Packets produced and consumed so far. Guarded by lock. */
+        size_t produced;
+        size_t consumed;
+        /** Set by the producer once the range is done. Guarded by lock. */
+        bool done;
+        /** Set by the destructor to stop the producer early. Guarded by lock. */
+        bool stop;
+        uint32_t crc;
+
+        std::thread producer;
+};
+
+#endif // FLASH_PIPELINE_HPP
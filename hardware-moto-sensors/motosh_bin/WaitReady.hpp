@@ -0,0 +1,43 @@
+#ifndef WAIT_READY_HPP
+#define WAIT_READY_HPP
+
+#include <stdint.h>
+#include <poll.h>
+#include <time.h>
+
+#include <algorithm>
+
+/** @return The CLOCK_MONOTONIC time in milliseconds. */
+static inline int64_t stm_nowMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/** Waits until ready() returns true, or until timeoutMs has elapsed.
+ *
+ * ready() is checked right away, then again after 5, 10, 20... ms (capped at
+ * 250 ms). If notifyFd is a sysfs attribute, a sysfs_notify() on it triggers
+ * an early check.
+ *
+ * @return True if ready() returned true.
+ */
+template<typename F>
+static bool stm_waitReady(F ready, int timeoutMs, int notifyFd = -1) {
+    const int64_t deadline = stm_nowMs() + timeoutMs;
+    int delayMs = 5;
+
+    while (!ready()) {
+        int64_t left = deadline - stm_nowMs();
+        if (left <= 0)
+            return false;
+
+        // A negative fd is ignored by poll(), which then just sleeps.
+        struct pollfd pfd = { notifyFd, POLLPRI | POLLERR, 0 };
+        poll(&pfd, 1, (int)std::min<int64_t>(delayMs, left));
+        delayMs = std::min(delayMs * 2, 250);
+    }
+    return true;
+}
+
+#endif // WAIT_READY_HPP
@@ -0,0 +1,91 @@
+/* Compiles sensorhub-blacklist.txt into the sorted binary table read by
+ * motosh. See BlackList.h for the format.
+ *
+ * Usage: sensorhub-blacklist-gen <input.txt> <output.bin>
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "BlackList.h"
+
+static int compareCrc(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static int writeLe32(FILE *f, uint32_t v) {
+    uint8_t b[4] = { v, v >> 8, v >> 16, v >> 24 };
+    return fwrite(b, sizeof(b), 1, f) == 1 ? 0 : -1;
+}
+
+int main(int argc, char *argv[]) {
+    FILE *in, *out;
+    char *line = NULL;
+    size_t len = 0;
+    uint32_t *crcs = NULL, crc;
+    size_t count = 0, cap = 0, unique = 0, i;
+    int err = 0;
+
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s <input.txt> <output.bin>\n", argv[0]);
+        return 1;
+    }
+
+    in = fopen(argv[1], "r");
+    if (!in) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    /* Same rules as the old runtime parser: skip comments and lines that
+     * don't start with a hex number. */
+    while (getline(&line, &len, in) != -1) {
+        if (line[0] == '#') continue;
+        if (sscanf(line, "%" SCNx32, &crc) != 1) continue;
+
+        if (count == cap) {
+            cap = cap ? cap * 2 : 64;
+            crcs = realloc(crcs, cap * sizeof(*crcs));
+            if (!crcs) {
+                fprintf(stderr, "Out of memory\n");
+                return 1;
+            }
+        }
+        crcs[count++] = crc;
+    }
+    free(line);
+    fclose(in);
+
+    if (count) {
+        qsort(crcs, count, sizeof(*crcs), compareCrc);
+        for (i = 0; i < count; i++) {
+            if (unique == 0 || crcs[i] != crcs[unique - 1])
+                crcs[unique++] = crcs[i];
+        }
+    }
+
+    out = fopen(argv[2], "wb");
+    if (!out) {
+        perror(argv[2]);
+        return 1;
+    }
+
+    if (fwrite(BLACKLIST_MAGIC, 4, 1, out) != 1) err = -1;
+    if (writeLe32(out, BLACKLIST_VERSION) < 0) err = -1;
+    if (writeLe32(out, unique) < 0) err = -1;
+    for (i = 0; i < unique; i++) {
+        if (writeLe32(out, crcs[i]) < 0) err = -1;
+    }
+    if (fclose(out) != 0) err = -1;
+    free(crcs);
+
+    if (err) {
+        fprintf(stderr, "Failed to write %s\n", argv[2]);
+        remove(argv[2]);
+        return 1;
+    }
+    return 0;
+}
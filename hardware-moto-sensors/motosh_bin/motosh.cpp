@@ -12,14 +12,26 @@
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <cutils/log.h>
 #include <cutils/properties.h>
 #include <inttypes.h>
+#include <poll.h>
+#include <time.h>
 #include <unistd.h>
 
+#include <thread>
+
+#include "BlackList.h"
+#include "BootFlasher.hpp"
+#include "BootReport.hpp"
 #include "CRC32.h"
+#include "FirmwareCache.hpp"
+#include "FirmwareImage.hpp"
+#include "FlashPipeline.hpp"
 #include "SensorHub.hpp"
+#include "WaitReady.hpp"
 
 #ifdef MODULE_stml0xx
     #include <linux/stml0xx.h>
@@ -28,6 +40,8 @@
     // The value used to fill unused buffer space / flash.
     #define FLASH_FILL (0x00)
     #define STM_MAX_PACKET_LENGTH 256
+    // Granularity of the changed-sector download (32 flash pages)
+    #define FLASH_SECTOR_SIZE (0x1000)
     #define MOTOSH_PASSTHROUGH_SIZE STML0XX_PASSTHROUGH_SIZE
 
     // IOCTL mappings
@@ -45,6 +59,10 @@
     #define MOTOSH_IOCTL_READ_REG           STML0XX_IOCTL_READ_REG
     #define MOTOSH_IOCTL_SET_LOWPOWER_MODE  STML0XX_IOCTL_SET_LOWPOWER_MODE
     #define MOTOSH_IOCTL_PASSTHROUGH        STML0XX_IOCTL_PASSTHROUGH
+    #ifdef STML0XX_IOCTL_GETSECTORCRC
+    #define MOTOSH_IOCTL_GETSECTORCRC       STML0XX_IOCTL_GETSECTORCRC
+    #define MOTOSH_IOCTL_SECTORERASE        STML0XX_IOCTL_SECTORERASE
+    #endif
 #else // MODULE_motosh
     #include <linux/motosh.h>
     #define STM_DRIVER "/dev/motosh"
@@ -52,14 +70,29 @@
     // The value used to fill unused buffer space / flash.
     #define FLASH_FILL (0xff)
     #define STM_MAX_PACKET_LENGTH 248
+    // Granularity of the changed-sector download (one flash page)
+    #define FLASH_SECTOR_SIZE (0x800)
+#endif
+
+/* The changed-sector download needs a bootloader that can report the CRC
+ * of, and erase, a single sector. Otherwise BootFlasher mass erases. */
+#if defined(MOTOSH_IOCTL_GETSECTORCRC) && defined(MOTOSH_IOCTL_SECTORERASE)
+    #define STM_SECTOR_DOWNLOAD
 #endif
 
 /******************************* # defines **************************************/
 #define CAPSENSE_FW_UPDATE  "/sys/class/capsense/fw_update"
 #define CS_MAX_LEN 8
 
-/** The firmware blacklist that this flasher will ignore */
-#define STM_FIRMWARE_BLACKLIST "/system/etc/firmware/sensorhub-blacklist.txt"
+/** The firmware blacklist that this flasher will ignore, compiled from
+ * sensorhub-blacklist.txt at build time. See BlackList.h. */
+#define STM_FIRMWARE_BLACKLIST "/system/etc/firmware/sensorhub-blacklist.bin"
+/** Where the CRC and version of the firmware files are cached across boots */
+#define STM_FIRMWARE_CACHE "/data/misc/sensorhub/fwcache.txt"
+/** Where "motosh boot -p" saves its timing report */
+#define STM_BOOT_REPORT "/data/misc/sensorhub/bootreport.txt"
+/** Set to 1 to save the boot report without the -p option */
+#define STM_BOOT_REPORT_PROP "persist.mot.sensors.bootreport"
 /** Maximum filesystem path length */
 #define STM_MAX_PATH 256
 #define STM_SUCCESS 0
@@ -67,10 +100,22 @@
 #define STM_VERSION_MISMATCH -1
 #define STM_VERSION_MATCH 1
 #define STM_DOWNLOADRETRIES 3
+/** Pause between two download attempts */
+#define STM_RETRY_DELAY_MS 250
+/** How long the hub may take to answer after leaving reset */
+#define STM_BOOT_TIMEOUT_MS 2000
+/** How long a freshly flashed hub may take to report the new flash CRC */
+#define STM_RESET_TIMEOUT_MS 3000
+/** How long capsense may take to report its checksum after an update check */
+#define CS_CHECKSUM_TIMEOUT_MS 5000
+/** How long capsense may take to settle once it has been updated */
+#define CS_SETTLE_TIMEOUT_MS 2000
 /* 512 matches the read buffer in kernel */
 #define STM_MAX_GENERIC_DATA 512
 #define STM_MAX_GENERIC_HEADER 4
 #define STM_MAX_GENERIC_COMMAND_LEN 3
+/* Most values a batch operation can take: a full size write plus header */
+#define STM_MAX_BATCH_ARGS (STM_MAX_GENERIC_DATA + 8)
 #define STM_FORCE_DOWNLOAD_MSG  "Use -f option to ignore version check eg: motosh boot -f\n"
 #define FLASH_START_ADDRESS (0x08000000)
 
@@ -120,6 +165,7 @@ typedef enum tag_stmmode
     PASSTHROUGH,
     LOWPOWER_MODE,
     MASS_ERASE_PART,
+    BATCH,
     INVALID
 } eStm_Mode;
 
@@ -138,9 +184,19 @@ using namespace mot;
 
 SensorHub sensorHub;
 
+/** The mapped firmware binary. See stm_getFwImage(). */
+FirmwareImage fwImage;
+
+/** Firmware file metadata. See stm_getFwInfo(). */
+FirmwareCache fwCache(STM_FIRMWARE_CACHE);
+
+/** Timing of the boot command. */
+BootReport bootReport;
+
 /****************************** functions **************************************/
 
 int stm_convertAsciiToHex(char * input, unsigned char * output, int inlen);
+void stm_getFwInfo(FirmwareImage &image, uint32_t &crc, string &version);
 
 static inline int motosh_ioctl (int fd, int ioctl_number, ...) {
     va_list ap;
@@ -155,7 +211,7 @@ static inline int motosh_ioctl (int fd, int ioctl_number, ...) {
     do {
         status = ioctl(fd, ioctl_number, arg);
         error = errno;
-    } while ((status != 0) && (error == -EINTR));
+    } while ((status < 0) && (error == EINTR));
     return status;
 }
 
@@ -223,20 +279,40 @@ void configure_capsense() {
     }
 }
 
-/* force a check and flash of capsense if needed */
-void flash_capsense(void) {
-
+/* read the capsense firmware checksum, 0 if it is not available yet */
+static int capsense_checksum(int fd) {
     char checksum[CS_MAX_LEN];
-    int cs = 0;
-    int checks = 5;
-    char *end;
-    int c;
+    ssize_t len = pread(fd, checksum, CS_MAX_LEN - 1, 0);
+    if (len <= 0)
+        return 0;
+    checksum[len] = '\0';
+    return (int)strtol(checksum, NULL, 16);
+}
+
+/* force a check and flash of capsense if needed
+
+   This only uses the capsense sysfs interface, so it can run concurrently
+   with the hub firmware check/download.
+
+   returns STM_SUCCESS, or STM_FAILURE if capsense did not report a
+   checksum */
+int flash_capsense(void) {
+
+    int cs = 0, before = 0;
+    int fd;
     FILE *fp;
     struct stat buf;
 
     /* exit if there is no capsense flash control path available */
     if (stat(CAPSENSE_FW_UPDATE, &buf) < 0)
-        return;
+        return STM_SUCCESS;
+
+    bootReport.begin(BootReport::CAPSENSE);
+    fd = open(CAPSENSE_FW_UPDATE, O_RDONLY);
+    if (fd < 0)
+        LOGERROR("Failed to read capsense flash status\n")
+    else
+        before = capsense_checksum(fd);
 
     fp = fopen(CAPSENSE_FW_UPDATE, "w");
     if(fp){
@@ -246,29 +322,32 @@ void flash_capsense(void) {
     } else
          LOGERROR("Failed to open capsense flash control\n")
 
-    /* look for a non-zero checksum on the same fd */
-    while(checks--) {
-        sleep(1);
-        fp = fopen(CAPSENSE_FW_UPDATE, "r");
-        if (fp) {
-            int i = 0;
-            while ((c = fgetc(fp)) != '\0' &&
-                   c != EOF &&
-                   i < CS_MAX_LEN-1) {
-                checksum[i++] = c;
-            }
-            checksum[i] = '\0';
-
-            cs = (int)strtol(checksum, &end, 16);
-            if (cs != 0)
-                checks = 0;
-
-            fclose(fp);
-        } else
-            LOGERROR("Failed to read capsense flash status\n")
+    /* look for a non-zero checksum, re-reading the attribute as soon as
+       the driver notifies it changed */
+    if (fd >= 0) {
+        stm_waitReady([fd, &cs]() {
+            cs = capsense_checksum(fd);
+            return cs != 0;
+        }, CS_CHECKSUM_TIMEOUT_MS, fd);
+
+        /* a new checksum means the part was just flashed: let it settle
+           until it reports the same checksum twice in a row */
+        if (cs != 0 && cs != before) {
+            LOGINFO("Capsense updated from 0x%X\n", before)
+            int last = cs;
+            stm_waitReady([fd, &last]() {
+                int now = capsense_checksum(fd);
+                bool stable = now != 0 && now == last;
+                last = now;
+                return stable;
+            }, CS_SETTLE_TIMEOUT_MS, fd);
+        }
+        close(fd);
     }
     LOGINFO("Capsense checksum 0x%X\n", cs)
-    sleep(2);
+    bootReport.end(BootReport::CAPSENSE);
+
+    return cs != 0 ? STM_SUCCESS : STM_FAILURE;
 }
 #endif
 
@@ -334,6 +413,56 @@ int stm_getFwFile(char *fileName) {
     return ret;
 }
 
+/** Checks whether a firmware CRC is in the compiled blacklist.
+ *
+ * The table is mapped and binary searched, so the cost doesn't grow with
+ * the number of blacklisted releases.
+ */
+bool stm_isBlackListed(uint32_t crc) {
+    struct stat st;
+    const uint8_t *map;
+    BlackListHeader hdr;
+    bool found = false;
+
+    int fd = open(STM_FIRMWARE_BLACKLIST, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false; // We don't have a blacklist
+
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(hdr)) {
+        close(fd);
+        return false;
+    }
+    map = (const uint8_t *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return false;
+
+    memcpy(&hdr, map, sizeof(hdr));
+    uint32_t count = Endian::ltoh(hdr.version) == BLACKLIST_VERSION ?
+            Endian::ltoh(hdr.count) : 0;
+    if (memcmp(hdr.magic, BLACKLIST_MAGIC, sizeof(hdr.magic)) != 0 ||
+            (size_t)st.st_size != sizeof(hdr) + (size_t)count * sizeof(uint32_t)) {
+        LOGERROR("Ignoring invalid firmware blacklist %s\n", STM_FIRMWARE_BLACKLIST);
+        count = 0;
+    }
+
+    const uint8_t *crcs = map + sizeof(hdr);
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        uint32_t val = Endian::extractLittleEndian<uint32_t>(crcs + mid * sizeof(uint32_t));
+        if (val == crc) {
+            found = true;
+            break;
+        } else if (val < crc) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    munmap((void *)map, st.st_size);
+    return found;
+}
+
 /**
  * Processes the firmware black list and deletes any APK installed firmware
  * that is in the list.
@@ -348,33 +477,61 @@ void stm_processBlackList() {
         return; // No APK firmware to check/delete
     }
 
-    uint32_t fileCrc, blCrc;
-    res = calculateFileCrc32(path, FLASH_SIZE, FLASH_FILL, &fileCrc);
-
-    if (res < 0) return; // No CRC to check against
+    uint32_t fileCrc;
+    string fileVersion;
+    FirmwareImage apkImage;
+    if (!apkImage.open(path)) return; // No CRC to check against
+    stm_getFwInfo(apkImage, fileCrc, fileVersion);
+    apkImage.close();
 
-    FILE *blackListFp = fopen(STM_FIRMWARE_BLACKLIST, "r");
-    if (blackListFp == NULL) return; // Huh?
+    if (stm_isBlackListed(fileCrc)) {
+        LOGINFO("Deleting blacklist firmware: %08x %s\n", fileCrc, path);
+        unlink(path);
+    }
+}
 
-    char *line = NULL;
-    size_t len = 0;
-    ssize_t read;
-    while ((read = getline(&line, &len, blackListFp)) != -1) {
-        if (len > 0 && line[0] == '#') continue;    // Skip comments
+/** Maps the firmware binary that should be loaded on the SensorHub.
+ *
+ * The mapping is shared by the version check, the CRC and the download, and
+ * is only redone if the selected firmware file changes.
+ *
+ * @return The image, or NULL on error.
+ */
+FirmwareImage *stm_getFwImage() {
+    char path[STM_MAX_PATH];
+    int res;
 
-        res = sscanf(line, "%" SCNx32, &blCrc);
-        if (res == EOF || res != 1) continue;
+    if ((res = stm_getFwFile(path)) < 0) {
+        LOGERROR("Error: getFwFile = %i\n", res);
+        return NULL;
+    }
 
-        if (fileCrc == blCrc) {
-            LOGINFO("Deleting blacklist firmware: %08x %s\n", blCrc, path);
-            res = unlink(path);
-            goto EXIT;
+    if (!fwImage.isOpen() || fwImage.getPath() != path) {
+        if (!fwImage.open(path)) {
+            LOGERROR("Unable to map firmware %s\n", path);
+            return NULL;
         }
     }
 
-EXIT:
-    fclose(blackListFp);
-    if (line) free(line);
+    return &fwImage;
+}
+
+/** Gets the flash CRC and the version string of a firmware image.
+ *
+ * These come from the persistent cache when the file is unchanged since they
+ * were last computed, in which case the image is not read at all.
+ *
+ * @param crc Set to the pseudo-CRC, see stm_calcFwFileCrc().
+ * @param version Set to the version string, or an empty string if the image
+ * has none.
+ */
+void stm_getFwInfo(FirmwareImage &image, uint32_t &crc, string &version) {
+    if (fwCache.lookup(image.getPath(), image.getStat(), crc, version))
+        return;
+
+    crc = image.getFlashCrc(FLASH_SIZE, FLASH_FILL);
+    version = image.getVersion(FW_VERSION_STR_MAX_LEN);
+    fwCache.store(image.getPath(), image.getStat(), crc, version);
 }
 
 /** Extract the firmware version from the filesystem binary containing the firmware.
@@ -382,66 +539,17 @@ EXIT:
  * @return A string containing the version, or an empty string.
  * */
 string stm_getFwVersionFromFile() {
-    char path[STM_MAX_PATH];
-    if (int res = stm_getFwFile(path) < 0) {
-        LOGERROR("stm_getFwVersionFromFile: getFwFile = %i\n", res);
-        return string();
-    }
-    FILE *f = fopen(path, "r");
-    if (!f) return string();
-
-    // The build system appends a 32 bit address as ASCII HEX (8 bytes),
-    // followed by \n, at the end of the file. This is the address of the
-    // version string in flash, so it's something like "080177d4".
-    const int OffsetLen = 9;
-    int seek = fseek(f, -OffsetLen, SEEK_END);
-    if (seek == -1) {
-        fclose(f);
-        LOGERROR("stm_getFwVersionFromFile: SEEK_END failed\n");
-        return string();
-    }
-
-    char offsetStr[OffsetLen];
-    size_t sz = fread(offsetStr, 1, OffsetLen - 1, f);
-    if (sz != OffsetLen - 1) {
-        fclose(f);
-        LOGERROR("stm_getFwVersionFromFile: offset read failed\n");
-        return string();
-    }
-
-    unsigned char offsetHex[OffsetLen / 2];
-    stm_convertAsciiToHex(offsetStr, offsetHex, OffsetLen - 1);
-    uint32_t offset = 0;
-    // We ignore the MSB byte because that's the flash offset (typically
-    // 0x08000000) and we want instead the file offset which is relative to the
-    // start of the flash.
-    //offset += ((uint32_t)offsetHex[0]) << 24;
-    offset += ((uint32_t)offsetHex[1]) << 16;
-    offset += ((uint32_t)offsetHex[2]) <<  8;
-    offset += ((uint32_t)offsetHex[3]);
-
-    seek = fseek(f, offset, SEEK_SET);
-    if (seek == -1) {
-        fclose(f);
-        LOGERROR("stm_getFwVersionFromFile: seek failed\n");
-        return string();
+    FirmwareImage *image = stm_getFwImage();
+    if (!image) return string();
+
+    uint32_t crc;
+    string version;
+    stm_getFwInfo(*image, crc, version);
+    if (version.empty()) {
+        LOGERROR("stm_getFwVersionFromFile: no version string in %s\n",
+                image->getPath().c_str());
     }
-
-    // Read the null-terminated string
-    char fwVersionStr[FW_VERSION_STR_MAX_LEN];
-    int c;
-    unsigned i = 0;
-    fwVersionStr[0] = '\0'; // In case we don't read anything.
-    while ((c = fgetc(f)) != '\0' && c != EOF && i < FW_VERSION_STR_MAX_LEN) {
-        fwVersionStr[i++] = c;
-    }
-
-    fclose(f);
-
-    if (c == EOF || i >= FW_VERSION_STR_MAX_LEN - 1) return string();
-
-    fwVersionStr[i] = '\0'; // Since we didn't copy the null
-    return fwVersionStr;
+    return version;
 }
 
 /** Computes the pseudo-CRC of a firmware binary file. This is not a simplistic
@@ -453,15 +561,12 @@ string stm_getFwVersionFromFile() {
  * @return Returns 0 on success or a negative value on error.
  */
 int stm_calcFwFileCrc(uint32_t &crc) {
-    int res;
-    char path[STM_MAX_PATH];
-    if ((res = stm_getFwFile(path)) < 0) {
-        LOGERROR("Error: getFwFile = %i\n", res);
-        return -1;
-    }
+    FirmwareImage *image = stm_getFwImage();
+    if (!image) return -1;
 
-    res = calculateFileCrc32(path, FLASH_SIZE, FLASH_FILL, &crc);
-    return res;
+    string version;
+    stm_getFwInfo(*image, crc, version);
+    return 0;
 }
 
 /**
@@ -535,81 +640,262 @@ int stm_convertAsciiToHex(char * input, unsigned char * output, int inlen)
     return outlen;
 }
 
-int stm_getpacket( FILE ** filepointer, unsigned char * databuff)
-{
-    FILE * fp = *filepointer;
-    int len = 0;
-    unsigned char c;
-
-    while(1){
-        c = fgetc(fp);
-        if (feof(fp))
-            break;
-        databuff[len] = c;
-        len++;
-        if( len >= STM_MAX_PACKET_LENGTH) {
-            break;
-        }
-    }
-
-    /* packet size needs to be a multiple of 8 bytes (64 bits) */
-    while(len < STM_MAX_PACKET_LENGTH &&
-          len % 8 > 0){
-        databuff[len] = FLASH_FILL;
-        len++;
-    }
-    return len;
-
-}
-
-int stm_downloadFirmware(FILE *filep)
+/** Programs [offset, end) of the image, which must already be erased.
+ *
+ * @param crc Set to the CRC (see updateCrc32()) of the programmed image
+ * bytes.
+ * @return The number of bytes written, or a negative value on error.
+ */
+int stm_programRange(FirmwareImage &image, size_t offset, size_t end,
+        uint32_t &crc)
 {
-
     unsigned int address;
     int ret = STM_SUCCESS;
-    int packetlength;
+    size_t packetlength, written = 0;
 #ifdef _DEBUG
     int packetno = 0;
 #endif
-    unsigned char packet[STM_MAX_PACKET_LENGTH];
-    int temp = 100; // this is only a dummy variable for the 3rd parameter of ioctl call
-
-    LOGDEBUG("Ioctl call to switch to bootloader mode\n");
-    ret = motosh_ioctl(devFd, MOTOSH_IOCTL_BOOTLOADERMODE, &temp);
-    CHECK_RETURN_VALUE(ret,"Failed to switch STM to bootloader mode\n");
-
-    LOGDEBUG("Ioctl call to erase flash on STM\n");
-    ret = motosh_ioctl(devFd, MOTOSH_IOCTL_MASSERASE, &temp);
-    CHECK_RETURN_VALUE(ret,"Failed to erase STM \n");
+    const unsigned char *packet;
 
-    address = FLASH_START_ADDRESS;
+    address = FLASH_START_ADDRESS + offset;
     ret = motosh_ioctl(devFd, MOTOSH_IOCTL_SETSTARTADDR, &address);
     CHECK_RETURN_VALUE(ret,"Failed to set address\n");
 
     LOGDEBUG("Start sending firmware packets to the driver\n");
-    // Move the file pointer to the beginning of the file in case this is a re-try
-    fseek(filep, 0, SEEK_SET);
-    do {
-        packetlength = stm_getpacket (&filep, packet);
-        if( packetlength == 0)
-            break;
+    {
+        // Packets are written straight from the mapping while the pipeline
+        // reads ahead and computes the CRC.
+        FlashPipeline pipeline(image, offset, end, STM_MAX_PACKET_LENGTH,
+                FLASH_FILL);
+        while ((packetlength = pipeline.next(&packet)) != 0) {
 #ifdef _DEBUG
-        LOGDEBUG("Sending packet %d  of length %d:\n", packetno++, packetlength);
-        int i;
-        for( i=0; i<packetlength; i++)
-            LOGDEBUG("%02x ",packet[i]);
+            LOGDEBUG("Sending packet %d  of length %zu:\n", packetno++, packetlength);
+            size_t i;
+            for( i=0; i<packetlength; i++)
+                LOGDEBUG("%02x ",packet[i]);
 #endif
-        printf(".");
-        fflush(stdout);
+            printf(".");
+            fflush(stdout);
 
-        ret = write(devFd, packet, packetlength);
-        CHECK_RETURN_VALUE(ret,"Packet download failed\n");
-    } while(packetlength != 0);
+            ret = write(devFd, packet, packetlength);
+            if (ret < 0)
+                break;
+            written += packetlength;
+        }
+        if (ret >= 0)
+            crc = pipeline.getCrc();
+    }
+    CHECK_RETURN_VALUE(ret,"Packet download failed\n");
+    ret = written;
 
 EXIT:
     return ret;
 }
 
+/** The boot download through the driver. */
+class DriverFlashTarget : public FlashTarget {
+    public:
+        int enterBootloader() override {
+            int temp = 100; // dummy 3rd parameter of the ioctl
+            LOGDEBUG("Ioctl call to switch to bootloader mode\n");
+            return motosh_ioctl(devFd, MOTOSH_IOCTL_BOOTLOADERMODE, &temp);
+        }
+
+        int massErase() override {
+            int temp = 100;
+            LOGDEBUG("Ioctl call to erase flash on STM\n");
+            return motosh_ioctl(devFd, MOTOSH_IOCTL_MASSERASE, &temp);
+        }
+
+        int program(FirmwareImage &image, size_t offset, size_t end,
+                uint32_t &crc) override {
+            return stm_programRange(image, offset, end, crc);
+        }
+
+#ifdef STM_SECTOR_DOWNLOAD
+        size_t getSectorSize() override {
+            return FLASH_SECTOR_SIZE;
+        }
+
+        int sectorCrc(size_t offset, uint32_t &crc) override {
+            // In: the sector address. Out: the CRC of the sector.
+            uint32_t arg = FLASH_START_ADDRESS + offset;
+            int ret = motosh_ioctl(devFd, MOTOSH_IOCTL_GETSECTORCRC, &arg);
+            crc = arg;
+            return ret;
+        }
+
+        int eraseSector(size_t offset) override {
+            uint32_t arg = FLASH_START_ADDRESS + offset;
+            return motosh_ioctl(devFd, MOTOSH_IOCTL_SECTORERASE, &arg);
+        }
+#endif
+
+        int enterNormalMode() override {
+            int temp = 100;
+            return motosh_ioctl(devFd, MOTOSH_IOCTL_NORMALMODE, &temp);
+        }
+
+        uint32_t getFlashCrc() override {
+            return sensorHub.getFlashCrc();
+        }
+};
+
+/** Runs one batch operation.
+ *
+ * @param op The operation letter.
+ * @param args The operation arguments.
+ * @param nargs The number of arguments.
+ * @param buf Work buffer, also receives the data read.
+ * @param outLen Set to the number of bytes read into buf.
+ * @return 0 on success, or a positive errno value.
+ */
+static int stm_batchOp(char op, const unsigned long *args, int nargs,
+        unsigned char *buf, int *outLen)
+{
+    int i, size;
+
+    *outLen = 0;
+
+    switch (op) {
+        case 'r': // r <register> <size>
+            if (nargs != 2 || args[0] > 0xffff || args[1] == 0 ||
+                    args[1] > STM_MAX_GENERIC_DATA - 1)
+                return EINVAL;
+            size = args[1];
+            buf[0] = args[0] >> 8;
+            buf[1] = args[0];
+            buf[2] = size >> 8;
+            buf[3] = size;
+            if (motosh_ioctl(devFd, MOTOSH_IOCTL_READ_REG, buf) < 0)
+                return errno;
+            *outLen = size;
+            return 0;
+
+        case 'w': // w <register> <byte>...
+            size = nargs - 1;
+            if (nargs < 2 || args[0] > 0xffff || size > STM_MAX_GENERIC_DATA - 1)
+                return EINVAL;
+            buf[0] = args[0] >> 8;
+            buf[1] = args[0];
+            buf[2] = size >> 8;
+            buf[3] = size;
+            for (i = 0; i < size; i++) {
+                if (args[i + 1] > 0xff)
+                    return EINVAL;
+                buf[STM_MAX_GENERIC_HEADER + i] = args[i + 1];
+            }
+            if (motosh_ioctl(devFd, MOTOSH_IOCTL_WRITE_REG, buf) < 0)
+                return errno;
+            return 0;
+
+        case 'p': // p <bus> <I2C addr> <reg hi> <reg lo> <r/w> <size> <data>...
+            if (nargs < 6 || nargs > MOTOSH_PASSTHROUGH_SIZE ||
+                    args[5] > (args[4] ? MOTOSH_PASSTHROUGH_SIZE - 6u :
+                                         MOTOSH_PASSTHROUGH_SIZE - 1u))
+                return EINVAL;
+            memset(buf, 0, MOTOSH_PASSTHROUGH_SIZE);
+            for (i = 0; i < nargs; i++) {
+                if (args[i] > 0xff)
+                    return EINVAL;
+                buf[i] = args[i];
+            }
+            if (motosh_ioctl(devFd, MOTOSH_IOCTL_PASSTHROUGH, buf) != 0)
+                return errno ? errno : EIO;
+            *outLen = args[4] ? 0 : args[5];
+            return 0;
+
+        case 's': // s <milliseconds>
+            if (nargs != 1)
+                return EINVAL;
+            usleep(args[0] * 1000);
+            return 0;
+
+        default:
+            return EINVAL;
+    }
+}
+
+/** Runs hub operations read from a stream, one per line, over the already
+ * open device, so scripts don't need one motosh process per access.
+ *
+ * Each line is an operation letter followed by hex values (see help()).
+ * Blank lines and lines starting with '#' are skipped. For each operation,
+ * one line is printed: the input line number, then "ok" and the bytes read
+ * as a single hex string, or "err" and the errno value.
+ *
+ * The operations go straight to the driver, not through SensorHubQueue:
+ * they run strictly one after the other anyway, and the queue has no
+ * passthrough command.
+ *
+ * @return STM_SUCCESS if every operation succeeded.
+ */
+int stm_runBatch(FILE *in)
+{
+    char *line = NULL;
+    size_t len = 0;
+    unsigned lineNo = 0, failures = 0;
+    unsigned long args[STM_MAX_BATCH_ARGS];
+    unsigned char buf[STM_MAX_GENERIC_HEADER + STM_MAX_GENERIC_DATA];
+    int nargs, outLen, err, i;
+
+    // Results can be consumed while the script is still being written
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    while (getline(&line, &len, in) != -1) {
+        char *save, *tok, *end;
+
+        lineNo++;
+        tok = strtok_r(line, " \t\r\n", &save);
+        if (!tok || tok[0] == '#')
+            continue;
+
+        char op = tok[0];
+        err = tok[1] != '\0' ? EINVAL : 0;
+        for (nargs = 0; !err && (tok = strtok_r(NULL, " \t\r\n", &save)); nargs++) {
+            if (nargs == STM_MAX_BATCH_ARGS)
+                err = E2BIG;
+            else if (op == 's')
+                args[nargs] = strtoul(tok, &end, 10);
+            else
+                args[nargs] = strtoul(tok, &end, 16);
+            if (!err && (*end != '\0' || end == tok))
+                err = EINVAL;
+        }
+
+        if (!err)
+            err = stm_batchOp(op, args, nargs, buf, &outLen);
+
+        if (err) {
+            failures++;
+            printf("%u err %d\n", lineNo, err);
+            continue;
+        }
+
+        printf("%u ok%s", lineNo, outLen ? " " : "");
+        for (i = 0; i < outLen; i++)
+            printf("%02x", buf[i]);
+        printf("\n");
+    }
+
+    free(line);
+    LOGDEBUG("Batch: %u lines, %u failed\n", lineNo, failures);
+    return failures ? STM_FAILURE : STM_SUCCESS;
+}
+
+/** Logs a summary of the boot timing and, if requested, saves the full report.
+ *
+ * @param save True to also write STM_BOOT_REPORT.
+ */
+void stm_finishBootReport(bool save)
+{
+    LOGINFO("Boot report: %s\n", bootReport.summary().c_str());
+
+    if (save && !bootReport.write(STM_BOOT_REPORT)) {
+        LOGERROR("Unable to write %s: %s\n", STM_BOOT_REPORT, strerror(errno));
+    }
+}
+
 /*!
  * \brief Print help info
  *
@@ -625,6 +911,7 @@ void help(int terminate)
     printf("    boot - download new firmware to hub\n");
     printf("      options:\n");
     printf("        -f disables version check\n");
+    printf("        -p saves a timing report to %s\n", STM_BOOT_REPORT);
     printf("    normal - reset hub into normal mode\n");
     printf("    tboot - send hub into bootloader mode\n");
     printf("    tread - read a hub register\n");
@@ -666,6 +953,16 @@ void help(int terminate)
     printf("      options: <state>\n");
     printf("        state - 1 for enable, 0 for disable\n");
     printf("    masserase - erase the firmware\n");
+    printf("    batch - run one operation per line from a file or stdin\n");
+    printf("      options: [file]\n");
+    printf("        r <register> <size>          - register read\n");
+    printf("        w <register> <data>...       - register write\n");
+    printf("        p <bus> <I2C addr> <reg hi> <reg lo> <r/w> <size> <data>...\n");
+    printf("                                     - passthrough, as above\n");
+    printf("        s <ms>                       - sleep (decimal)\n");
+    printf("      values are hex; prints \"<line> ok <hex data>\" or \"<line> err <errno>\"\n");
+    printf("      ex. -- the readwrite examples above, in one process\n");
+    printf("        printf 'r 0 1\\nw d cc dd\\n' | ./motosh batch\n");
     printf("\n");
     if( terminate )
         exit(0);
@@ -674,8 +971,8 @@ void help(int terminate)
 int  main(int argc, char *argv[])
 {
 
-    int tries, ret = STM_SUCCESS;
-    FILE * filep = NULL;
+    int ret = STM_SUCCESS;
+    FirmwareImage *image = NULL;
     eStm_Mode emode = INVALID;
     int temp = 100; // this is only a dummy variable for the 3rd parameter of ioctl call
     unsigned char hexinput[250];
@@ -683,6 +980,10 @@ int  main(int argc, char *argv[])
     short delay = 0;
     int enabledints = 0;
     bool forceBoot = false;
+    bool saveReport = false;
+    bool needDownload = false;
+    thread capsenseThread;
+    int capsenseRet = STM_SUCCESS;
     char ver_string[FW_VERSION_SIZE];
     char fw_file_name[STM_MAX_PATH];
 
@@ -719,12 +1020,21 @@ int  main(int argc, char *argv[])
         emode = LOWPOWER_MODE;
     else if(!strcmp(argv[1], "masserase"))
         emode = MASS_ERASE_PART;
+    else if(!strcmp(argv[1], "batch"))
+        emode = BATCH;
 
-    /* check if its a force download */
-    if (emode == BOOTLOADER && (argc == 3)) {
-        if (!strcmp(argv[2], "-f")) {
-            forceBoot = true;
+    /* check if its a force download and/or a profiling run */
+    if (emode == BOOTLOADER) {
+        char propVal[PROPERTY_VALUE_MAX];
+        for (i = 2; i < argc; i++) {
+            if (!strcmp(argv[i], "-f"))
+                forceBoot = true;
+            else if (!strcmp(argv[i], "-p"))
+                saveReport = true;
         }
+        property_get(STM_BOOT_REPORT_PROP, propVal, "0");
+        if (!strcmp(propVal, "1"))
+            saveReport = true;
     }
 
     /* open the device */
@@ -740,16 +1050,23 @@ int  main(int argc, char *argv[])
 
         #ifdef MODULE_motosh
             /* trigger capsense check and flash if this is a normal
-               boot up check (no -f option applied) */
+               boot up check (no -f option applied). It is independent of
+               the hub, so it runs while the hub firmware is checked. */
             if (!forceBoot)
-                flash_capsense();
+                capsenseThread = thread([&capsenseRet]() {
+                    capsenseRet = flash_capsense();
+                });
         #endif
 
+        bootReport.begin(BootReport::BLACKLIST);
         stm_processBlackList();
+        bootReport.end(BootReport::BLACKLIST);
 
         // Verify we have FW before taking the part out of reset/boot mode
         ret = stm_getFwFile(fw_file_name);
 
+        if (ret < 0)
+            bootReport.setOutcome("no_firmware");
         CHECK_RETURN_VALUE(ret, "STM valid firmware not found");
 
         // Take the part out of reset
@@ -757,58 +1074,45 @@ int  main(int argc, char *argv[])
         CHECK_RETURN_VALUE(ret, "STM boot -> normal mode failed");
 
         // Wait until the SensorHub boots
-        tries = 0;
-        ret = STM_FAILURE;
-        while (tries++ < 20) {
-            uint32_t hwCrc = sensorHub.getFlashCrc();
-            if (hwCrc) {
-                ret = STM_SUCCESS;
-                break;
-            }
-            usleep(100000); // Wait for a total of 2s
-        }
+        bootReport.begin(BootReport::HUB_WAIT);
+        ret = stm_waitReady([]() {
+            bootReport.addCrcPoll();
+            return sensorHub.getFlashCrc() != 0;
+        }, STM_BOOT_TIMEOUT_MS) ? STM_SUCCESS : STM_FAILURE;
+        bootReport.end(BootReport::HUB_WAIT);
         if (ret != STM_SUCCESS) {
             LOGINFO("STM getFlashCrc() after normal mode failed. Blank part? (%d)", ret);
         }
 
         /* check if new firmware available for download */
-        if (forceBoot || stm_versionCheck() == STM_VERSION_MISMATCH) {
-            filep = fopen(fw_file_name, "r");
-            CHECK_RETURN_VALUE(ret = filep ? 0 : -1, "STM could not open FW file");
-
-            tries = 0;
-            while((tries < STM_DOWNLOADRETRIES )) {
-                if( (stm_downloadFirmware(filep)) >= STM_SUCCESS) {
-                    fclose(filep);
-                    filep = NULL;
-                    /* reset STM */
-                    ret = motosh_ioctl(devFd, MOTOSH_IOCTL_NORMALMODE, &temp);
-                    printf("\n");
-                    // IOCTLS will be briefly blocked during part reset
-                    usleep(1000000);
-                    if (stm_versionCheck() != STM_VERSION_MATCH) {
-                        /* try once more */
-                        usleep(2000000);
-                        if (stm_versionCheck() == STM_VERSION_MATCH)
-                            LOGINFO("Firmware download completed successfully\n")
-                        else
-                            LOGERROR("Firmware download error\n")
-                    } else
-                        LOGINFO("Firmware download completed successfully\n")
-
-                    break;
-                }
-                tries++;
-                usleep(250000);
+        needDownload = forceBoot;
+        if (!forceBoot) {
+            bootReport.begin(BootReport::VERSION_CHECK);
+            needDownload = stm_versionCheck() == STM_VERSION_MISMATCH;
+            bootReport.end(BootReport::VERSION_CHECK);
+        }
+        if (needDownload) {
+            image = stm_getFwImage();
+            CHECK_RETURN_VALUE(ret = image ? 0 : -1, "STM could not open FW file");
+
+            {
+                DriverFlashTarget target;
+                BootFlasher flasher(target, bootReport, FLASH_SIZE, FLASH_FILL);
+                flasher.setRetries(STM_DOWNLOADRETRIES, STM_RETRY_DELAY_MS);
+                flasher.setResetTimeout(STM_RESET_TIMEOUT_MS);
+                ret = flasher.flash(*image);
             }
-
-            CHECK_RETURN_VALUE(ret = (tries >= STM_DOWNLOADRETRIES ? -1 : 0),
-                    "Firmware download failed")
+            CHECK_RETURN_VALUE(ret, "Firmware download failed")
         } else {
             LOGDEBUG("No new firmware to download \n");
+            bootReport.setOutcome("up_to_date");
         }
 
         #ifdef MODULE_motosh
+        if (capsenseThread.joinable())
+            capsenseThread.join();
+        if (capsenseRet < 0)
+            LOGERROR("Capsense firmware check failed\n")
         if (!forceBoot)
             configure_capsense();
         #endif
@@ -1104,13 +1408,30 @@ int  main(int argc, char *argv[])
         LOGINFO("Erased.\n");
 
     }
+    if (emode == BATCH) {
+        FILE *in = stdin;
+        if (argc > 2 && strcmp(argv[2], "-")) {
+            in = fopen(argv[2], "r");
+            CHECK_RETURN_VALUE(ret = in ? 0 : -1, "Unable to open batch file");
+        }
+        ret = stm_runBatch(in);
+        if (in != stdin)
+            fclose(in);
+    }
 
 EXIT:
     if( ret < STM_SUCCESS)
         LOGERROR("Command execution error\n")
+    // Never leave capsense half way through, even if the hub failed
+    if (capsenseThread.joinable()) {
+        capsenseThread.join();
+        if (capsenseRet < 0)
+            LOGERROR("Capsense firmware check failed\n")
+    }
+    if (emode == BOOTLOADER)
+        stm_finishBootReport(saveReport);
     close(devFd);
-    if( filep != NULL)
-        fclose(filep);
+    fwImage.close();
     return ret;
 }
 
@@ -0,0 +1,395 @@
+/*
+ * Copyright (C) 2016 Motorola Mobility
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "BootFlasher.hpp"
+#include "BootReport.hpp"
+#include "CRC32.h"
+#include "FirmwareImage.hpp"
+
+using namespace std;
+
+namespace {
+
+const size_t FlashSize = 0x10000;
+const uint8_t Fill = 0xff;
+/** Not a multiple of the 8 byte packet alignment. */
+const size_t ImageSize = 5001;
+const size_t SectorSize = 0x400;
+const size_t PaddedImageSize = (ImageSize + 7) & ~7;
+const int ResetTimeoutMs = 100;
+/** The wait is timed in whole milliseconds, the report in microseconds. */
+const uint64_t MinTimeoutUs = (ResetTimeoutMs - 1) * 1000ULL;
+
+/** Stands in for the hub and its bootloader. Holds the flash contents, and
+ * can fail or corrupt chosen downloads. */
+class FakeHub : public FlashTarget {
+    public:
+        FakeHub() : downloads(0), failEraseOn(0), corruptOn(0), silent(false),
+            bootPolls(2), sectorSize(SectorSize), massErases(0),
+            sectorErases(0), programmed(0), unerasedWrites(0),
+            flash(FlashSize, Fill), corrupt(false), pollsLeft(0) {}
+
+        /** Puts an image in the flash, as if it had been downloaded before. */
+        void load(const FirmwareImage &image) {
+            std::fill(flash.begin(), flash.end(), Fill);
+            copy(image.getData(), image.getData() + image.getSize(),
+                    flash.begin());
+        }
+
+        int enterBootloader() override {
+            downloads++;
+            corrupt = downloads == corruptOn;
+            return 0;
+        }
+
+        int massErase() override {
+            if (downloads == failEraseOn)
+                return -1;
+            massErases++;
+            std::fill(flash.begin(), flash.end(), Fill);
+            return 0;
+        }
+
+        int program(FirmwareImage &image, size_t offset, size_t end,
+                uint32_t &crc) override {
+            // The driver writes whole 8 byte words.
+            size_t len = (end - offset + 7) & ~7;
+            if (any_of(flash.begin() + offset, flash.begin() + offset + len,
+                    [](uint8_t b) { return b != Fill; }))
+                unerasedWrites++;
+            std::fill(flash.begin() + offset, flash.begin() + offset + len, Fill);
+            copy(image.getData() + offset, image.getData() + end,
+                    flash.begin() + offset);
+            crc = updateCrc32(0, image.getData() + offset, end - offset);
+            programmed += len;
+            return len;
+        }
+
+        size_t getSectorSize() override {
+            return sectorSize;
+        }
+
+        int sectorCrc(size_t offset, uint32_t &crc) override {
+            if (!sectorSize)
+                return -1;
+            crc = updateCrc32(0, &flash[offset], sectorSize);
+            return 0;
+        }
+
+        int eraseSector(size_t offset) override {
+            sectorErases++;
+            std::fill(flash.begin() + offset, flash.begin() + offset + sectorSize,
+                    Fill);
+            return 0;
+        }
+
+        int enterNormalMode() override {
+            pollsLeft = bootPolls;
+            return 0;
+        }
+
+        uint32_t getFlashCrc() override {
+            if (silent)
+                return 0;
+            // Still booting
+            if (pollsLeft > 0) {
+                pollsLeft--;
+                return 0;
+            }
+            return updateCrc32(0, flash.data(), FlashSize) ^ (corrupt ? 1 : 0);
+        }
+
+        int downloads;
+        /** The download (counted from 1) whose erase fails. */
+        int failEraseOn;
+        /** The download (counted from 1) which leaves a bad flash CRC. */
+        int corruptOn;
+        /** Never answers once reset. */
+        bool silent;
+        /** How many CRC polls go unanswered after a reset. */
+        int bootPolls;
+        /** 0 for a bootloader without the sector commands. */
+        size_t sectorSize;
+
+        int massErases;
+        int sectorErases;
+        /** Bytes programmed, padding included. */
+        size_t programmed;
+        /** Program calls which found flash that was not erased. */
+        int unerasedWrites;
+
+    private:
+        vector<uint8_t> flash;
+        bool corrupt;
+        int pollsLeft;
+};
+
+/** Writes a test image and maps it.
+ *
+ * @param changeAt The offset of a byte that differs from the base image,
+ * or ImageSize for the base image itself.
+ */
+void makeImage(string &path, FirmwareImage &image, size_t changeAt) {
+    const char *dir = getenv("TMPDIR");
+    path = string(dir ? dir : "/data/local/tmp") + "/bootflasher.XXXXXX";
+    int fd = mkstemp(&path[0]);
+    ASSERT_GE(fd, 0);
+    for (size_t i = 0; i < ImageSize; i++) {
+        uint8_t b = static_cast<uint8_t>(i * 131 + 7);
+        if (i == changeAt)
+            b ^= 0x5a;
+        ASSERT_EQ(1, write(fd, &b, 1));
+    }
+    close(fd);
+    ASSERT_TRUE(image.open(path.c_str()));
+}
+
+class BootFlasherTest : public ::testing::Test {
+    protected:
+        BootFlasherTest() : path(), image(), report(), hub(),
+            flasher(hub, report, FlashSize, Fill) {}
+
+        void SetUp() override {
+            makeImage(path, image, ImageSize);
+            flasher.setRetries(3, 0);
+            flasher.setResetTimeout(ResetTimeoutMs);
+        }
+
+        void TearDown() override {
+            image.close();
+            unlink(path.c_str());
+        }
+
+        /** Saves the report and reads its key=value lines back. */
+        map<string, string> saved() {
+            string reportPath = path + ".report";
+            map<string, string> values;
+            char line[128];
+
+            EXPECT_TRUE(report.write(reportPath.c_str()));
+            FILE *f = fopen(reportPath.c_str(), "r");
+            EXPECT_NE(nullptr, f);
+            if (!f)
+                return values;
+            while (fgets(line, sizeof(line), f)) {
+                string s(line);
+                size_t eq = s.find('=');
+                EXPECT_NE(string::npos, eq) << s;
+                EXPECT_EQ('\n', s.back()) << s;
+                values[s.substr(0, eq)] = s.substr(eq + 1, s.size() - eq - 2);
+            }
+            fclose(f);
+            unlink(reportPath.c_str());
+            return values;
+        }
+
+        string path;
+        FirmwareImage image;
+        BootReport report;
+        FakeHub hub;
+        BootFlasher flasher;
+};
+
+/** Flashes a copy of the image with one byte changed. */
+class ChangedImageTest : public BootFlasherTest {
+    protected:
+        ChangedImageTest() : BootFlasherTest(), changedPath(), changed() {}
+
+        void SetUp() override {
+            BootFlasherTest::SetUp();
+            // In the third sector of the image
+            makeImage(changedPath, changed, 2 * SectorSize + 100);
+            hub.load(image);
+        }
+
+        void TearDown() override {
+            changed.close();
+            unlink(changedPath.c_str());
+            BootFlasherTest::TearDown();
+        }
+
+        /** The CRC of the flash once it holds the changed image. */
+        uint32_t changedFlashCrc() {
+            return changed.getFlashCrc(FlashSize, Fill);
+        }
+
+        string changedPath;
+        FirmwareImage changed;
+};
+
+} // namespace
+
+TEST_F(BootFlasherTest, FlashesAndReports) {
+    EXPECT_EQ(0, flasher.flash(image));
+
+    auto r = saved();
+    EXPECT_EQ("flashed", r["outcome"]);
+    EXPECT_EQ("1", r["downloads"]);
+    EXPECT_EQ(to_string(PaddedImageSize), r["bytes"]);
+    // A blank part is mass erased
+    for (const char *phase : { "bootloader", "sector_check", "erase", "program",
+            "reset", "verify" }) {
+        EXPECT_EQ("1", r[string(phase) + "_count"]) << phase;
+    }
+    EXPECT_EQ(1, hub.massErases);
+    EXPECT_EQ(0, hub.sectorErases);
+    // Phases which the flasher does not own stay empty.
+    EXPECT_EQ("0", r["hub_wait_count"]);
+    EXPECT_EQ("0", r["hub_wait_us"]);
+    // Two unanswered polls while the hub boots, then the match.
+    EXPECT_EQ("3", r["crc_polls"]);
+    EXPECT_NE(string::npos, report.summary().find("flashed in "));
+}
+
+TEST_F(BootFlasherTest, RetriesAfterBadFlashCrc) {
+    hub.corruptOn = 1;
+
+    EXPECT_EQ(0, flasher.flash(image));
+
+    auto r = saved();
+    EXPECT_EQ("flashed", r["outcome"]);
+    EXPECT_EQ("2", r["downloads"]);
+    EXPECT_EQ("2", r["erase_count"]);
+    EXPECT_EQ("2", r["verify_count"]);
+    EXPECT_EQ(to_string(2 * PaddedImageSize), r["bytes"]);
+    // The bad CRC was polled until the timeout.
+    EXPECT_GE(stoull(r["verify_us"]), MinTimeoutUs);
+}
+
+TEST_F(BootFlasherTest, RetriesAfterEraseFailure) {
+    hub.failEraseOn = 1;
+
+    EXPECT_EQ(0, flasher.flash(image));
+
+    auto r = saved();
+    EXPECT_EQ("flashed", r["outcome"]);
+    EXPECT_EQ("2", r["downloads"]);
+    EXPECT_EQ("2", r["erase_count"]);
+    // The failed attempt never got to programming.
+    EXPECT_EQ("1", r["program_count"]);
+    EXPECT_EQ("1", r["reset_count"]);
+}
+
+TEST_F(BootFlasherTest, GivesUpAfterEveryTry) {
+    hub.bootPolls = 0;
+    hub.corruptOn = 1;
+    flasher.setRetries(1, 0);
+
+    EXPECT_GT(0, flasher.flash(image));
+
+    auto r = saved();
+    EXPECT_EQ("flash_failed", r["outcome"]);
+    EXPECT_EQ("1", r["downloads"]);
+}
+
+TEST_F(BootFlasherTest, SilentHubIsNotFlashedAgain) {
+    hub.silent = true;
+
+    EXPECT_EQ(0, flasher.flash(image));
+
+    auto r = saved();
+    EXPECT_EQ("flashed_unverified", r["outcome"]);
+    EXPECT_EQ("1", r["downloads"]);
+    EXPECT_GE(stoull(r["verify_us"]), MinTimeoutUs);
+}
+
+TEST_F(ChangedImageTest, ProgramsOnlyTheChangedSector) {
+    EXPECT_EQ(0, flasher.flash(changed));
+
+    EXPECT_EQ(0, hub.massErases);
+    EXPECT_EQ(1, hub.sectorErases);
+    EXPECT_EQ(SectorSize, hub.programmed);
+    EXPECT_EQ(0, hub.unerasedWrites);
+    EXPECT_EQ(changedFlashCrc(), hub.getFlashCrc());
+
+    auto r = saved();
+    EXPECT_EQ("flashed", r["outcome"]);
+    EXPECT_EQ("1", r["downloads"]);
+    EXPECT_EQ(to_string(SectorSize), r["bytes"]);
+}
+
+TEST_F(ChangedImageTest, NothingChanged) {
+    EXPECT_EQ(0, flasher.flash(image));
+
+    EXPECT_EQ(0, hub.massErases);
+    EXPECT_EQ(0, hub.sectorErases);
+    EXPECT_EQ(0u, hub.programmed);
+    EXPECT_EQ(image.getFlashCrc(FlashSize, Fill), hub.getFlashCrc());
+
+    auto r = saved();
+    EXPECT_EQ("flashed", r["outcome"]);
+    EXPECT_EQ("0", r["bytes"]);
+}
+
+TEST_F(ChangedImageTest, NoSectorCrcSupport) {
+    hub.sectorSize = 0;
+
+    EXPECT_EQ(0, flasher.flash(changed));
+
+    EXPECT_EQ(1, hub.massErases);
+    EXPECT_EQ(0, hub.sectorErases);
+    EXPECT_EQ(PaddedImageSize, hub.programmed);
+    EXPECT_EQ(0, hub.unerasedWrites);
+    EXPECT_EQ(changedFlashCrc(), hub.getFlashCrc());
+
+    auto r = saved();
+    EXPECT_EQ("flashed", r["outcome"]);
+    EXPECT_EQ("0", r["sector_check_count"]);
+    EXPECT_EQ("1", r["erase_count"]);
+}
+
+TEST_F(ChangedImageTest, RetryMassErases) {
+    hub.corruptOn = 1;
+
+    EXPECT_EQ(0, flasher.flash(changed));
+
+    // The sector download was not trusted a second time
+    EXPECT_EQ(1, hub.sectorErases);
+    EXPECT_EQ(1, hub.massErases);
+    EXPECT_EQ(0, hub.unerasedWrites);
+    EXPECT_EQ(changedFlashCrc(), hub.getFlashCrc());
+    EXPECT_EQ("2", saved()["downloads"]);
+}
+
+TEST(BootReportTest, AccumulatesRepeatedPhases) {
+    BootReport report;
+
+    report.begin(BootReport::HUB_WAIT);
+    usleep(2000);
+    report.end(BootReport::HUB_WAIT);
+    report.begin(BootReport::HUB_WAIT);
+    usleep(2000);
+    report.end(BootReport::HUB_WAIT);
+
+    EXPECT_GE(report.getUs(BootReport::HUB_WAIT), 4000u);
+    EXPECT_EQ(0u, report.getUs(BootReport::ERASE));
+    string summary = report.summary();
+    EXPECT_EQ(0u, summary.find("error in "));
+    EXPECT_NE(string::npos, summary.find("hub_wait")) << summary;
+    EXPECT_NE(string::npos, summary.find("(x2)")) << summary;
+    EXPECT_EQ(string::npos, summary.find("erase")) << summary;
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2016 Motorola Mobility
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef DEADBAND_H
+#define DEADBAND_H
+
+#include <math.h>
+
+/*****************************************************************************/
+
+/** Width of the band, in sensor list resolution steps. */
+#define DEADBAND_STEPS 2
+
+/**
+ * On-change suppression state for one sensor. A new value is only reported
+ * if it moved by at least the band from the last reported value. With a band
+ * of #DEADBAND_STEPS resolution steps, a reading hovering between two
+ * adjacent steps is reported once instead of on every change.
+ */
+class Deadband {
+public:
+    Deadband() : mBand(0.f), mLast(0.f), mPrimed(false) {}
+
+    /** \param[in] resolution the sensor list resolution of the sensor */
+    explicit Deadband(float resolution)
+        : mBand(resolution * DEADBAND_STEPS), mLast(0.f), mPrimed(false) {}
+
+    /** The next value is reported whatever it is. */
+    void reset() { mPrimed = false; }
+
+    /**
+     * \returns true if this is the first value since reset(), or if the
+     * value left the band (in which case it becomes the new reference).
+     */
+    bool pass(float value) {
+        if (mPrimed && fabsf(value - mLast) < mBand)
+            return false;
+        mLast = value;
+        mPrimed = true;
+        return true;
+    }
+
+private:
+    float mBand;
+    float mLast;
+    bool mPrimed;
+};
+
+/*****************************************************************************/
+
+#endif  // DEADBAND_H
@@ -42,6 +42,19 @@
 
 /*****************************************************************************/
 
+// Per-axis scale factors for the big-endian (x, y, z) vector records
+static const float sAccelScale[3] = { CONVERT_A_X, CONVERT_A_Y, CONVERT_A_Z };
+#ifdef _ENABLE_LA
+static const float sLinAccelScale[3] = { CONVERT_A_LIN, CONVERT_A_LIN, CONVERT_A_LIN };
+#endif
+#ifdef _ENABLE_GR
+static const float sGravityScale[3] = { CONVERT_GRAVITY, CONVERT_GRAVITY, CONVERT_GRAVITY };
+#endif
+static const float sGyroScale[3] = { CONVERT_G_P, CONVERT_G_R, CONVERT_G_Y };
+static const float sGyroBiasScale[3] = { CONVERT_BIAS_G_P, CONVERT_BIAS_G_R, CONVERT_BIAS_G_Y };
+static const float sMagScale[3] = { CONVERT_M_X, CONVERT_M_Y, CONVERT_M_Z };
+static const float sMagBiasScale[3] = { CONVERT_BIAS_M_X, CONVERT_BIAS_M_Y, CONVERT_BIAS_M_Z };
+
 HubSensors::HubSensors()
 : SensorBase(SENSORHUB_DEVICE_NAME, NULL, SENSORHUB_AS_DATA_NAME),
       mEnabled(0),
@@ -136,6 +149,14 @@ HubSensors::HubSensors()
     for (const auto& s : hubSensorList()) {
         mIdToSensor.insert(std::make_pair(s.handle, &s));
     }
+
+    // Slow environmental sensors report a new record on every hub sample,
+    // even if the value did not change, or only moved back and forth by one
+    // step.
+    for (int32_t handle : { ID_PR, ID_T, ID_L }) {
+        if (mIdToSensor.count(handle) && mIdToSensor[handle]->resolution > 0.f)
+            mDeadband[handle] = Deadband(mIdToSensor[handle]->resolution);
+    }
 }
 
 HubSensors::~HubSensors()
@@ -247,6 +268,12 @@ int HubSensors::setEnable(int32_t handle, int en)
             new_enabled &= ~M_IR_RAW;
             if (newState)
                 new_enabled |= M_IR_RAW;
+#ifdef _ENABLE_RAW_IR_DATA
+            if (newState)
+                mIrRawStream.start();
+            else
+                mIrRawStream.stop();
+#endif
             found = 1;
             break;
         case ID_IR_OBJECT:
@@ -472,6 +499,10 @@ int HubSensors::setEnable(int32_t handle, int en)
         mWakeEnabled = new_enabled;
     }
 
+    // The first value after (re-)enabling must always be reported
+    if (newState && mDeadband.count(handle))
+        mDeadband[handle].reset();
+
     if (newState)
         mEnabledHandles |= ((decltype(mEnabledHandles))1 << handle);
     else
@@ -655,6 +686,15 @@ void HubSensors::logAlsEvent(int32_t lux, int64_t ts_ns) {
     }
 }
 
+bool HubSensors::passDeadband(int32_t handle, float value)
+{
+    auto it = mDeadband.find(handle);
+    if (it == mDeadband.end())
+        return true;
+
+    return it->second.pass(value);
+}
+
 int HubSensors::readEvents(sensors_event_t* d, int dLen)
 {
     struct motosh_android_sensor_data buff;
@@ -748,9 +788,8 @@ int HubSensors::readEvents(sensors_event_t* d, int dLen)
                 data->version = SENSORS_EVENT_T_SIZE;
                 data->sensor =  SENSORS_HANDLE_BASE + ID_A;
                 data->type = SENSOR_TYPE_ACCELEROMETER;
-                data->acceleration.x = STM16TOH(buff.data+ACCEL_X) * CONVERT_A_X;
-                data->acceleration.y = STM16TOH(buff.data+ACCEL_Y) * CONVERT_A_Y;
-                data->acceleration.z = STM16TOH(buff.data+ACCEL_Z) * CONVERT_A_Z;
+                Endian::be16x3ToFloat(buff.data + ACCEL_X, 1, sAccelScale,
+                        data->acceleration.v);
                 data->acceleration.status = SENSOR_STATUS_ACCURACY_HIGH;
                 data->timestamp = buff.timestamp;
                 data++;
@@ -759,9 +798,8 @@ int HubSensors::readEvents(sensors_event_t* d, int dLen)
                 data->version = SENSORS_EVENT_T_SIZE;
                 data->sensor =  SENSORS_HANDLE_BASE + ID_G;
                 data->type = SENSOR_TYPE_GYROSCOPE;
-                data->gyro.x = STM16TOH(buff.data + GYRO_X) * CONVERT_G_P;
-                data->gyro.y = STM16TOH(buff.data + GYRO_Y) * CONVERT_G_R;
-                data->gyro.z = STM16TOH(buff.data + GYRO_Z) * CONVERT_G_Y;
+                Endian::be16x3ToFloat(buff.data + GYRO_X, 1, sGyroScale,
+                        data->gyro.v);
                 data->timestamp = buff.timestamp;
                 data++;
                 break;
@@ -769,12 +807,10 @@ int HubSensors::readEvents(sensors_event_t* d, int dLen)
                 data->version = SENSORS_EVENT_T_SIZE;
                 data->sensor =  SENSORS_HANDLE_BASE + ID_UNCALIB_GYRO;
                 data->type = SENSOR_TYPE_GYROSCOPE_UNCALIBRATED;
-                data->uncalibrated_gyro.x_uncalib = STM16TOH(buff.data + UNCALIB_GYRO_X) * CONVERT_G_P;
-                data->uncalibrated_gyro.y_uncalib = STM16TOH(buff.data + UNCALIB_GYRO_Y) * CONVERT_G_R;
-                data->uncalibrated_gyro.z_uncalib = STM16TOH(buff.data + UNCALIB_GYRO_Z) * CONVERT_G_Y;
-                data->uncalibrated_gyro.x_bias = STM16TOH(buff.data + UNCALIB_GYRO_X_BIAS) * CONVERT_BIAS_G_P;
-                data->uncalibrated_gyro.y_bias = STM16TOH(buff.data + UNCALIB_GYRO_Y_BIAS) * CONVERT_BIAS_G_R;
-                data->uncalibrated_gyro.z_bias = STM16TOH(buff.data + UNCALIB_GYRO_Z_BIAS) * CONVERT_BIAS_G_Y;
+                Endian::be16x3ToFloat(buff.data + UNCALIB_GYRO_X, 1, sGyroScale,
+                        data->uncalibrated_gyro.uncalib);
+                Endian::be16x3ToFloat(buff.data + UNCALIB_GYRO_X_BIAS, 1, sGyroBiasScale,
+                        data->uncalibrated_gyro.bias);
                 data->timestamp = buff.timestamp;
                 data++;
                 break;
@@ -782,12 +818,10 @@ int HubSensors::readEvents(sensors_event_t* d, int dLen)
                 data->version = SENSORS_EVENT_T_SIZE;
                 data->sensor =  SENSORS_HANDLE_BASE + ID_UNCALIB_MAG;
                 data->type = SENSOR_TYPE_MAGNETIC_FIELD_UNCALIBRATED;
-                data->uncalibrated_magnetic.x_uncalib = STM16TOH(buff.data + UNCALIB_MAGNETIC_X) * CONVERT_M_X;
-                data->uncalibrated_magnetic.y_uncalib = STM16TOH(buff.data + UNCALIB_MAGNETIC_Y) * CONVERT_M_Y;
-                data->uncalibrated_magnetic.z_uncalib = STM16TOH(buff.data + UNCALIB_MAGNETIC_Z) * CONVERT_M_Z;
-                data->uncalibrated_magnetic.x_bias = STM16TOH(buff.data + UNCALIB_MAGNETIC_X_BIAS) * CONVERT_BIAS_M_X;
-                data->uncalibrated_magnetic.y_bias = STM16TOH(buff.data + UNCALIB_MAGNETIC_Y_BIAS) * CONVERT_BIAS_M_Y;
-                data->uncalibrated_magnetic.z_bias = STM16TOH(buff.data + UNCALIB_MAGNETIC_Z_BIAS) * CONVERT_BIAS_M_Z;
+                Endian::be16x3ToFloat(buff.data + UNCALIB_MAGNETIC_X, 1, sMagScale,
+                        data->uncalibrated_magnetic.uncalib);
+                Endian::be16x3ToFloat(buff.data + UNCALIB_MAGNETIC_X_BIAS, 1, sMagBiasScale,
+                        data->uncalibrated_magnetic.bias);
                 data->timestamp = buff.timestamp;
                 data++;
                 break;
@@ -866,20 +900,24 @@ int HubSensors::readEvents(sensors_event_t* d, int dLen)
                 break;
 #endif
             case DT_PRESSURE:
+            {
+                float pressure = STM32TOH(buff.data + PRESSURE_PRESSURE) * CONVERT_B;
+                if (!passDeadband(ID_PR, pressure))
+                    break;
                 data->version = SENSORS_EVENT_T_SIZE;
                 data->sensor =  SENSORS_HANDLE_BASE + ID_PR;
                 data->type = SENSOR_TYPE_PRESSURE;
-                data->pressure = STM32TOH(buff.data + PRESSURE_PRESSURE) * CONVERT_B;
+                data->pressure = pressure;
                 data->timestamp = buff.timestamp;
                 data++;
                 break;
+            }
             case DT_MAG:
                 data->version = SENSORS_EVENT_T_SIZE;
                 data->sensor =  SENSORS_HANDLE_BASE + ID_M;
                 data->type = SENSOR_TYPE_MAGNETIC_FIELD;
-                data->magnetic.x = STM16TOH(buff.data + MAGNETIC_X) * CONVERT_M_X;
-                data->magnetic.y = STM16TOH(buff.data + MAGNETIC_Y) * CONVERT_M_Y;
-                data->magnetic.z = STM16TOH(buff.data + MAGNETIC_Z) * CONVERT_M_Z;
+                Endian::be16x3ToFloat(buff.data + MAGNETIC_X, 1, sMagScale,
+                        data->magnetic.v);
                 data->magnetic.status = buff.status;
                 data->timestamp = buff.timestamp;
                 data++;
@@ -897,30 +935,39 @@ int HubSensors::readEvents(sensors_event_t* d, int dLen)
                 data++;
                 break;
             case DT_TEMP:
+            {
+                float temperature = STM16TOH(buff.data + TEMPERATURE_TEMPERATURE) * CONVERT_T;
+                if (!passDeadband(ID_T, temperature))
+                    break;
                 data->version = SENSORS_EVENT_T_SIZE;
                 data->sensor =  SENSORS_HANDLE_BASE + ID_T;
                 data->type = SENSOR_TYPE_TEMPERATURE;
-                data->temperature = STM16TOH(buff.data + TEMPERATURE_TEMPERATURE) * CONVERT_T;
+                data->temperature = temperature;
                 data->timestamp = buff.timestamp;
                 data++;
                 break;
+            }
             case DT_ALS:
+            {
+                float light = (uint16_t)STM16TOH(buff.data + LIGHT_LIGHT);
+                if (!passDeadband(ID_L, light))
+                    break;
                 data->version = SENSORS_EVENT_T_SIZE;
                 data->sensor =  SENSORS_HANDLE_BASE + ID_L;
                 data->type = SENSOR_TYPE_LIGHT;
-                data->light = (uint16_t)STM16TOH(buff.data + LIGHT_LIGHT);
+                data->light = light;
                 data->timestamp = buff.timestamp;
                 logAlsEvent(data->light, data->timestamp);
                 data++;
                 break;
+            }
 #ifdef _ENABLE_LA
             case DT_LIN_ACCEL:
                 data->version = SENSORS_EVENT_T_SIZE;
                 data->sensor =  SENSORS_HANDLE_BASE + ID_LA;
                 data->type = SENSOR_TYPE_LINEAR_ACCELERATION;
-                data->acceleration.x = STM16TOH(buff.data + ACCEL_X) * CONVERT_A_LIN;
-                data->acceleration.y = STM16TOH(buff.data + ACCEL_Y) * CONVERT_A_LIN;
-                data->acceleration.z = STM16TOH(buff.data + ACCEL_Z) * CONVERT_A_LIN;
+                Endian::be16x3ToFloat(buff.data + ACCEL_X, 1, sLinAccelScale,
+                        data->acceleration.v);
                 data->acceleration.status = SENSOR_STATUS_ACCURACY_HIGH;
                 data->timestamp = buff.timestamp;
                 data++;
@@ -931,9 +978,8 @@ int HubSensors::readEvents(sensors_event_t* d, int dLen)
                 data->version = SENSORS_EVENT_T_SIZE;
                 data->sensor =  SENSORS_HANDLE_BASE + ID_GRAVITY;
                 data->type = SENSOR_TYPE_GRAVITY;
-                data->acceleration.x = STM16TOH(buff.data + GRAVITY_X) * CONVERT_GRAVITY;
-                data->acceleration.y = STM16TOH(buff.data + GRAVITY_Y) * CONVERT_GRAVITY;
-                data->acceleration.z = STM16TOH(buff.data + GRAVITY_Z) * CONVERT_GRAVITY;
+                Endian::be16x3ToFloat(buff.data + GRAVITY_X, 1, sGravityScale,
+                        data->acceleration.v);
                 data->acceleration.status = SENSOR_STATUS_ACCURACY_HIGH;
                 data->timestamp = buff.timestamp;
                 data++;
@@ -1021,6 +1067,13 @@ int HubSensors::readEvents(sensors_event_t* d, int dLen)
                 data++;
                 break;
             case DT_IR_RAW:
+#ifdef _ENABLE_RAW_IR_DATA
+                if (mIrRawStream.isActive()) {
+                    // Tuning session: bypass the framework event pipe.
+                    mIrRawStream.push(buff.timestamp, buff.data + IR_TR_H);
+                    break;
+                }
+#endif
                 data->version = SENSORS_EVENT_T_SIZE;
                 data->sensor =  SENSORS_HANDLE_BASE + ID_IR_RAW;
                 data->type = SENSOR_TYPE_IR_RAW;
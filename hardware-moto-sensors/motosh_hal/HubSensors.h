@@ -36,8 +36,13 @@
 #include <android-base/macros.h>
 
 #include "Sensors.h"
+#include "Deadband.h"
+#include "Endian.hpp"
 #include "SensorBase.h"
 #include "SensorsLog.h"
+#ifdef _ENABLE_RAW_IR_DATA
+#include "IrRawStream.h"
+#endif
 
 /*****************************************************************************/
 
@@ -164,9 +169,9 @@
 #define LIFT_ROTATION (4 * sizeof(int8_t))
 #define LIFT_GRAV_DIFF (8 * sizeof(int8_t))
 
-#define STM16TOH(p) (int16_t) be16toh(*((uint16_t *) (p)))
-#define STM32TOH(p) (int32_t) be32toh(*((uint32_t *) (p)))
-#define STMU32TOH(p) (uint32_t) be32toh(*((uint32_t *) (p)))
+#define STM16TOH(p) Endian::extract<int16_t>((const uint8_t *)(p))
+#define STM32TOH(p) Endian::extract<int32_t>((const uint8_t *)(p))
+#define STMU32TOH(p) Endian::extract<uint32_t>((const uint8_t *)(p))
 
 #define ERROR_TYPES    9  /* Largest error code reported by the sensor hub */
 
@@ -267,6 +272,22 @@ private:
 
     void logAlsEvent(int32_t lux, int64_t ts_ns);
 
+    //! \brief Deadband per handle, from the sensor list resolution
+    std::map<int32_t, Deadband> mDeadband;
+
+    /*!
+     * \brief Decide whether a decoded value is worth an event
+     *
+     * \returns true if \c handle has no deadband, otherwise see
+     * Deadband::pass().
+     */
+    bool passDeadband(int32_t handle, float value);
+
+#ifdef _ENABLE_RAW_IR_DATA
+    //! \brief Bulk channel used instead of events while IR tuning
+    IrRawStream mIrRawStream;
+#endif
+
     /**
      * Virtual sensors may generate more than one sensor event per event
      * received. If there's not enough room in the poll buffer, we need to
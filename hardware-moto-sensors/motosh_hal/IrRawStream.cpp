@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2016 Motorola Mobility
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define __STDC_FORMAT_MACROS
+
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <cutils/properties.h>
+
+#include "IrRawStream.h"
+#include "SensorsLog.h"
+
+/*****************************************************************************/
+
+/* Throughput is logged once per window of sensor time */
+#define IR_RAW_REPORT_NS 5000000000LL
+
+IrRawStream::IrRawStream()
+    : mRing(NULL),
+      mFrames(NULL),
+      mMapSize(0),
+      mWindowStart(0),
+      mWindowFrames(0),
+      mWindowDropped(0)
+{
+}
+
+IrRawStream::~IrRawStream()
+{
+    stop();
+}
+
+bool IrRawStream::start()
+{
+    char prop[PROPERTY_VALUE_MAX];
+    struct stat st;
+    void *map;
+    int fd;
+
+    if (mRing)
+        return true;
+
+    if (property_get(IR_RAW_STREAM_PROP, prop, "0") <= 0 || strcmp(prop, "1"))
+        return false;
+
+    mMapSize = sizeof(struct ir_raw_ring_header) +
+        IR_RAW_STREAM_FRAMES * sizeof(struct ir_raw_frame);
+
+    // A reader may still have the ring of an earlier session mapped. Never
+    // shrink the file under it, that would SIGBUS the reader.
+    fd = open(IR_RAW_STREAM_FILE, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        S_LOGE("Can't open %s (%s)", IR_RAW_STREAM_FILE, strerror(errno));
+        return false;
+    }
+    if (fstat(fd, &st) < 0) {
+        S_LOGE("Can't stat %s (%s)", IR_RAW_STREAM_FILE, strerror(errno));
+        close(fd);
+        return false;
+    }
+    if ((size_t)st.st_size < mMapSize && ftruncate(fd, mMapSize) < 0) {
+        S_LOGE("Can't size %s (%s)", IR_RAW_STREAM_FILE, strerror(errno));
+        close(fd);
+        return false;
+    }
+    map = mmap(NULL, mMapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        S_LOGE("Can't map %s (%s)", IR_RAW_STREAM_FILE, strerror(errno));
+        return false;
+    }
+
+    mRing = static_cast<struct ir_raw_ring_header *>(map);
+    mFrames = reinterpret_cast<struct ir_raw_frame *>(mRing + 1);
+
+    // Reset the header in place. The magic is withdrawn first and published
+    // last so a reader never sees a half-initialized header.
+    __atomic_store_n(&mRing->magic, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&mRing->head, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&mRing->tail, 0, __ATOMIC_RELAXED);
+    mRing->frames = 0;
+    mRing->dropped = 0;
+    mRing->reserved = 0;
+    mRing->version = htole16(IR_RAW_STREAM_VERSION);
+    mRing->frame_size = htole16(sizeof(struct ir_raw_frame));
+    mRing->capacity = htole32(IR_RAW_STREAM_FRAMES);
+    __atomic_store_n(&mRing->magic, htole32(IR_RAW_STREAM_MAGIC), __ATOMIC_RELEASE);
+
+    mWindowStart = 0;
+    mWindowFrames = 0;
+    mWindowDropped = 0;
+
+    S_LOGI("IR raw streaming to %s (%d frames)", IR_RAW_STREAM_FILE,
+            IR_RAW_STREAM_FRAMES);
+    return true;
+}
+
+void IrRawStream::stop()
+{
+    if (!mRing)
+        return;
+
+    S_LOGI("IR raw streaming stopped: frames=%" PRIu64 " dropped=%" PRIu64,
+            mRing->frames, mRing->dropped);
+
+    munmap(mRing, mMapSize);
+    mRing = NULL;
+    mFrames = NULL;
+    mMapSize = 0;
+}
+
+void IrRawStream::push(int64_t ts, const uint8_t *data)
+{
+    uint64_t head, tail;
+    struct ir_raw_frame *frame;
+    uint16_t ch;
+    int i;
+
+    if (!mRing)
+        return;
+
+    head = mRing->head;
+    tail = __atomic_load_n(&mRing->tail, __ATOMIC_ACQUIRE);
+
+    if (head - tail >= IR_RAW_STREAM_FRAMES) {
+        // Reader is a full ring behind. Keep the unread frames.
+        mRing->dropped++;
+    } else {
+        frame = &mFrames[head % IR_RAW_STREAM_FRAMES];
+        frame->timestamp = htole64(ts);
+        for (i = 0; i < IR_RAW_CHANNELS; i++) {
+            memcpy(&ch, data + i * sizeof(uint16_t), sizeof(ch));
+            frame->ch[i] = htole16(be16toh(ch));
+        }
+        mRing->frames++;
+        __atomic_store_n(&mRing->head, head + 1, __ATOMIC_RELEASE);
+    }
+
+    reportThroughput(ts);
+}
+
+void IrRawStream::reportThroughput(int64_t ts)
+{
+    int64_t elapsed;
+
+    if (mWindowStart == 0) {
+        mWindowStart = ts;
+        return;
+    }
+
+    elapsed = ts - mWindowStart;
+    if (elapsed < IR_RAW_REPORT_NS)
+        return;
+
+    S_LOGD("IR raw: %" PRIu64 " frames/s, %" PRIu64 " dropped in %" PRId64 "ms",
+            (uint64_t)((mRing->frames - mWindowFrames) * 1000000000LL / elapsed),
+            mRing->dropped - mWindowDropped, elapsed / 1000000);
+
+    mWindowStart = ts;
+    mWindowFrames = mRing->frames;
+    mWindowDropped = mRing->dropped;
+}
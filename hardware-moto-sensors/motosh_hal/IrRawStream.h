@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2016 Motorola Mobility
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IR_RAW_STREAM_H
+#define IR_RAW_STREAM_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <android-base/macros.h>
+
+/*****************************************************************************/
+
+/** Set to "1" to route DT_IR_RAW records to the ring instead of pollEvents. */
+#define IR_RAW_STREAM_PROP      "debug.motosh.ir_raw_stream"
+#define IR_RAW_STREAM_FILE      "/data/misc/sensorhub/ir_raw.ring"
+#define IR_RAW_STREAM_MAGIC     0x57525249 /* "IRRW" */
+#define IR_RAW_STREAM_VERSION   1
+#define IR_RAW_STREAM_FRAMES    4096
+#define IR_RAW_CHANNELS         10
+
+/**
+ * Layout of the memory-mapped ring, shared with the diagnostics reader.
+ * \c magic, \c version, \c frame_size, \c capacity and the frames are
+ * little-endian. \c head, \c tail, \c frames and \c dropped are updated
+ * atomically in place and are therefore in native byte order; the reader runs
+ * on the same device.
+ *
+ * The HAL is the only writer of \c head, \c frames and \c dropped. The reader
+ * is the only writer of \c tail. A frame at index i lives in slot
+ * (i % capacity) and is valid once \c head > i. When the reader falls
+ * \c capacity frames behind, new frames are dropped (and counted) rather than
+ * overwriting unread ones.
+ */
+struct ir_raw_ring_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t frame_size;
+    uint32_t capacity;
+    uint32_t reserved;
+    uint64_t head;
+    uint64_t tail;
+    uint64_t frames;
+    uint64_t dropped;
+};
+
+static_assert(sizeof(struct ir_raw_ring_header) == 48,
+        "ir_raw_ring_header layout is shared with the reader");
+
+struct ir_raw_frame {
+    int64_t timestamp;
+    /** Same order as the DT_IR_RAW record: TR_H, BL_H, BR_H, BB_H, TR_L,
+     * BL_L, BR_L, BB_L, AMBIENT_H, AMBIENT_L. */
+    uint16_t ch[IR_RAW_CHANNELS];
+} __attribute__((packed));
+
+/**
+ * Bulk channel for IR raw data during IR tuning sessions.
+ *
+ * Converting each DT_IR_RAW record into a sensors_event_t floods the
+ * framework event pipe. When streaming is enabled, records are instead packed
+ * into a memory-mapped ring file that a diagnostics tool can consume directly.
+ */
+class IrRawStream {
+public:
+    DISALLOW_COPY_AND_ASSIGN(IrRawStream);
+
+    IrRawStream();
+    ~IrRawStream();
+
+    /** Maps the ring if IR_RAW_STREAM_PROP is set. Safe to call repeatedly.
+     * \returns true if streaming is active. */
+    bool start();
+    /** Unmaps the ring and logs the session totals. */
+    void stop();
+    bool isActive() const { return mRing != NULL; }
+
+    /**
+     * Appends one DT_IR_RAW record to the ring.
+     *
+     * \param[in] ts   the record timestamp in ns
+     * \param[in] data the big-endian record payload from the hub
+     */
+    void push(int64_t ts, const uint8_t *data);
+
+private:
+    void reportThroughput(int64_t ts);
+
+    struct ir_raw_ring_header *mRing;
+    struct ir_raw_frame *mFrames;
+    size_t mMapSize;
+
+    //! \brief timestamp of the start of the current throughput window
+    int64_t mWindowStart;
+    //! \brief \c frames and \c dropped counters at \c mWindowStart
+    uint64_t mWindowFrames;
+    uint64_t mWindowDropped;
+};
+
+/*****************************************************************************/
+
+#endif  // IR_RAW_STREAM_H
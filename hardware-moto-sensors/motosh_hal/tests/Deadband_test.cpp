@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2016 Motorola Mobility
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "Deadband.h"
+
+using namespace std;
+
+namespace {
+
+/** The ALS resolution, 1 lux on integer readings. */
+const float AlsResolution = 1.f;
+
+/** Returns the values which pass, in order. */
+vector<float> passed(Deadband &db, const vector<float> &values) {
+    vector<float> out;
+    for (float v : values) {
+        if (db.pass(v))
+            out.push_back(v);
+    }
+    return out;
+}
+
+} // namespace
+
+TEST(DeadbandTest, DropsRepeats) {
+    Deadband db(AlsResolution);
+
+    EXPECT_EQ(vector<float>({ 100.f }), passed(db, { 100.f, 100.f, 100.f }));
+}
+
+TEST(DeadbandTest, HoveringReportedOnce) {
+    Deadband db(AlsResolution);
+
+    EXPECT_EQ(vector<float>({ 100.f }),
+            passed(db, { 100.f, 101.f, 100.f, 101.f, 101.f, 100.f, 99.f, 100.f }));
+}
+
+TEST(DeadbandTest, ReportsRealChanges) {
+    Deadband db(AlsResolution);
+
+    // Every step is measured from the last reported value, not the last one
+    EXPECT_EQ(vector<float>({ 100.f, 102.f, 104.f, 98.f }),
+            passed(db, { 100.f, 101.f, 102.f, 103.f, 104.f, 98.f }));
+}
+
+TEST(DeadbandTest, ResetReportsNextValue) {
+    Deadband db(AlsResolution);
+
+    EXPECT_TRUE(db.pass(100.f));
+    EXPECT_FALSE(db.pass(100.f));
+    db.reset();
+    EXPECT_TRUE(db.pass(100.f));
+    EXPECT_FALSE(db.pass(101.f));
+}
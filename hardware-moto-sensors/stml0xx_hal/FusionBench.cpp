@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2016 Motorola Mobility
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Compares what the two fusion placements cost the AP, on hub records
+ * captured by the HAL with debug.mot.sensors.record=1 (see HubSensors.h).
+ * Make one recording with persist.mot.sensors.fusion=ap and one with hub
+ * fusion, with the same rotation vectors enabled, and pass both.
+ *
+ * Accel, gyro and mag records go through the AP fusion the way readEvents()
+ * feeds it with Game RV, Geomag RV and RV enabled. Quaternion records go
+ * through hubQuatToEvent(). For each path it prints the records the AP had to
+ * read, which bounds the wakeups of the poll thread, and the CPU time spent
+ * on them, both per second of recording.
+ *
+ * Usage: stml0xx_fusion_bench <recording>...
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "HubSensors.h"
+
+#if !defined(_ENABLE_GYROSCOPE) || !defined(_ENABLE_MAGNETOMETER)
+#error "The fusion benchmark needs the gyroscope and the magnetometer"
+#endif
+
+namespace {
+
+struct PathStat {
+    const char *name;
+    uint64_t records;
+    int64_t cpuNs;
+};
+
+int64_t cpuTime()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void printStat(const PathStat &stat, int64_t durationNs)
+{
+    double seconds = durationNs / 1e9;
+
+    if (stat.records == 0 || seconds <= 0) {
+        printf("  %-10s no records\n", stat.name);
+        return;
+    }
+    printf("  %-10s %8" PRIu64 " records, %8.1f records/s, CPU %8.3f ms/s\n",
+            stat.name, stat.records, stat.records / seconds,
+            stat.cpuNs / 1e6 / seconds);
+}
+
+/* Runs one recording and prints its costs. Returns false if unreadable. */
+bool bench(const char *path)
+{
+    struct stml0xx_android_sensor_data buff;
+    sensors_event_t event;
+    FusionData fusion;
+    PathStat ap = { "AP fusion", 0, 0 };
+    PathStat hub = { "hub fusion", 0, 0 };
+    int64_t first = -1, last = -1, begin;
+    bool geomagReady = false;
+    FILE *fp;
+
+    fp = fopen(path, "r");
+    if (!fp) {
+        fprintf(stderr, "Can't open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    memset(&fusion, 0, sizeof(fusion));
+    GameRotationVector *gameRV = GameRotationVector::getInstance();
+    GeoMagRotationVector *geomagRV = GeoMagRotationVector::getInstance();
+    RotationVector *rotationVect = RotationVector::getInstance();
+    gameRV->processFusion(fusion, true);
+    geomagRV->processFusion(fusion, true);
+    rotationVect->processFusion(fusion, true);
+
+    while (fread(&buff, sizeof(buff), 1, fp) == 1) {
+        if (first < 0)
+            first = buff.timestamp;
+        last = buff.timestamp;
+
+        begin = cpuTime();
+        switch (buff.type) {
+            case DT_ACCEL:
+                fusion.accel.x = STM16TOH(buff.data + ACCEL_X) * CONVERT_A_X;
+                fusion.accel.y = STM16TOH(buff.data + ACCEL_Y) * CONVERT_A_Y;
+                fusion.accel.z = STM16TOH(buff.data + ACCEL_Z) * CONVERT_A_Z;
+                fusion.accel.timestamp = buff.timestamp;
+                geomagReady = geomagRV->processFusion(fusion, false);
+                ap.cpuNs += cpuTime() - begin;
+                ap.records++;
+                break;
+            case DT_GYRO:
+                fusion.gyro.x = STM16TOH(buff.data + GYRO_X) * CONVERT_G_P;
+                fusion.gyro.y = STM16TOH(buff.data + GYRO_Y) * CONVERT_G_R;
+                fusion.gyro.z = STM16TOH(buff.data + GYRO_Z) * CONVERT_G_Y;
+                fusion.gyro.timestamp = buff.timestamp;
+                gameRV->processFusion(fusion, false);
+                rotationVect->processFusion(fusion, !geomagReady);
+                ap.cpuNs += cpuTime() - begin;
+                ap.records++;
+                break;
+            case DT_MAG:
+                fusion.mag.x = STM16TOH(buff.data + MAGNETIC_X) * CONVERT_M_X;
+                fusion.mag.y = STM16TOH(buff.data + MAGNETIC_Y) * CONVERT_M_Y;
+                fusion.mag.z = STM16TOH(buff.data + MAGNETIC_Z) * CONVERT_M_Z;
+                fusion.mag.timestamp = buff.timestamp;
+                ap.cpuNs += cpuTime() - begin;
+                ap.records++;
+                break;
+            case DT_GAME_RV:
+                hubQuatToEvent(&event, ID_GAME_RV, SENSOR_TYPE_GAME_ROTATION_VECTOR,
+                        buff.data, buff.timestamp, HUB_QUAT_GAME_ACCURACY);
+                hub.cpuNs += cpuTime() - begin;
+                hub.records++;
+                break;
+            case DT_QUAT_6AXIS:
+                hubQuatToEvent(&event, ID_GEOMAG_RV,
+                        SENSOR_TYPE_GEOMAGNETIC_ROTATION_VECTOR,
+                        buff.data, buff.timestamp, HUB_QUAT_HEADING_ACCURACY);
+                hub.cpuNs += cpuTime() - begin;
+                hub.records++;
+                break;
+            case DT_QUAT_9AXIS:
+                hubQuatToEvent(&event, ID_RV, SENSOR_TYPE_ROTATION_VECTOR,
+                        buff.data, buff.timestamp, HUB_QUAT_HEADING_ACCURACY);
+                hub.cpuNs += cpuTime() - begin;
+                hub.records++;
+                break;
+            default:
+                break;
+        }
+    }
+    fclose(fp);
+
+    printf("%s: %.2f s\n", path, (last - first) / 1e9);
+    printStat(ap, last - first);
+    printStat(hub, last - first);
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    int i, ret = 0;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <recording>...\n", argv[0]);
+        return 1;
+    }
+    for (i = 1; i < argc; i++) {
+        if (!bench(argv[i]))
+            ret = 1;
+    }
+    return ret;
+}
@@ -33,11 +33,19 @@
 #include <linux/stml0xx.h>
 
 #include <cutils/log.h>
+#include <cutils/properties.h>
 
 #include "mot_sensorhub_stml0xx.h"
 
 #include "HubSensors.h"
 
+#ifdef _ENABLE_AKM_INPROC
+extern "C" {
+#include "Acc_hal.h"
+#include "Hosted.h"
+}
+#endif
+
 /*****************************************************************************/
 
 #ifndef MIN
@@ -47,6 +55,19 @@
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 #endif
 
+// Per-axis scale factors for the big-endian (x, y, z) vector records
+#ifdef _ENABLE_ACCEL_SECONDARY
+static const float sAccelScale[3] = { CONVERT_A_X, CONVERT_A_Y, CONVERT_A_Z };
+#endif
+#ifdef _ENABLE_GYROSCOPE
+static const float sGyroScale[3] = { CONVERT_G_P, CONVERT_G_R, CONVERT_G_Y };
+static const float sGyroBiasScale[3] = { CONVERT_BIAS_G_P, CONVERT_BIAS_G_R, CONVERT_BIAS_G_Y };
+#endif
+#ifdef _ENABLE_MAGNETOMETER
+static const float sMagScale[3] = { CONVERT_M_X, CONVERT_M_Y, CONVERT_M_Z };
+static const float sMagBiasScale[3] = { CONVERT_BIAS_M_X, CONVERT_BIAS_M_Y, CONVERT_BIAS_M_Z };
+#endif
+
 HubSensors HubSensors::self;
 
 HubSensors::HubSensors()
@@ -55,7 +76,15 @@ HubSensors::HubSensors()
     mWakeEnabled(0),
     mPendingMask(0),
     mEnabledHandles(0),
-    mPendingBug2go(0)
+    mPendingBug2go(0),
+#ifdef _ENABLE_AKM_INPROC
+    mCompassRunning(false),
+#endif
+    mHubFusion(false)
+#ifdef _ENABLE_HUB_FUSION
+    , mHubFusionOffered(false)
+    , mRecord(NULL)
+#endif
 {
     // read the actual value of all sensors if they're enabled already
     struct input_absinfo absinfo;
@@ -109,6 +138,8 @@ HubSensors::HubSensors()
     mFusionSensors[ROTATION_VECT].usesGyro = true;
 #endif
 
+    startFusionProbe();
+
 #ifdef _ENABLE_GYROSCOPE
     if ((fp = fopen(GYRO_CAL_FILE, "r")) != NULL) {
         size = fread(mGyroCal, 1, STML0XX_GYRO_CAL_SIZE, fp);
@@ -133,6 +164,13 @@ HubSensors::HubSensors()
     mRotationVect = RotationVector::getInstance();
 #endif
 
+#ifdef _ENABLE_AKM_INPROC
+    if (pipe2(mCompassPipe, O_NONBLOCK | O_CLOEXEC) < 0) {
+        ALOGE("Can't create the compass pipe (%s)", strerror(errno));
+        mCompassPipe[0] = mCompassPipe[1] = -1;
+    }
+#endif
+
     if ((fp = fopen(ACCEL_CAL_FILE, "r")) != NULL) {
         size = fread(mAccelCal, 1, STML0XX_ACCEL_CAL_SIZE, fp);
         fclose(fp);
@@ -157,6 +195,10 @@ HubSensors::HubSensors()
 
 HubSensors::~HubSensors()
 {
+#ifdef _ENABLE_HUB_FUSION
+    if (mRecord)
+        fclose(mRecord);
+#endif
 }
 
 HubSensors *HubSensors::getInstance()
@@ -178,6 +220,11 @@ int HubSensors::setEnable(int32_t handle, int en)
 
     ALOGI("Sensorhub hal enable: %d - %d", handle, en);
 
+#ifdef _ENABLE_HUB_FUSION
+    std::lock_guard<std::mutex> guard(mFusionLock);
+#endif
+    resolveFusionPlacement();
+
     // Check non-wake sensors
     new_enabled = mEnabled;
     switch (handle) {
@@ -200,6 +247,13 @@ int HubSensors::setEnable(int32_t handle, int en)
             break;
         case ID_GAME_RV:
             mFusionSensors[GAME_RV].enabled = newState;
+#ifdef _ENABLE_HUB_FUSION
+            if (isHubFused(GAME_RV)) {
+                new_enabled &= ~M_GAME_RV;
+                if (newState)
+                    new_enabled |= M_GAME_RV;
+            }
+#endif
             found = 1;
             break;
         case ID_LA:
@@ -263,10 +317,24 @@ int HubSensors::setEnable(int32_t handle, int en)
             break;
         case ID_GEOMAG_RV:
             mFusionSensors[GEOMAG_RV].enabled = newState;
+#ifdef _ENABLE_HUB_FUSION
+            if (isHubFused(GEOMAG_RV)) {
+                new_enabled &= ~M_QUAT_6AXIS;
+                if (newState)
+                    new_enabled |= M_QUAT_6AXIS;
+            }
+#endif
             found = 1;
             break;
         case ID_RV:
             mFusionSensors[ROTATION_VECT].enabled = newState;
+#ifdef _ENABLE_HUB_FUSION
+            if (isHubFused(ROTATION_VECT)) {
+                new_enabled &= ~M_QUAT_9AXIS;
+                if (newState)
+                    new_enabled |= M_QUAT_9AXIS;
+            }
+#endif
             found = 1;
             break;
 #endif
@@ -318,6 +386,9 @@ int HubSensors::setEnable(int32_t handle, int en)
         // If Geomag RV is disabled, reset the algo. This in turn will cause
         // the 9-axis RV to reset until mag samples have been received.
         // If only the 9-axis RV has been disabled, reset it directly
+#ifdef _ENABLE_AKM_INPROC
+        updateCompass();
+#endif
         if (!mFusionSensors[GEOMAG_RV].enabled) {
             mGeomagRV->processFusion(mFusionData, true);
         } else if (!mFusionSensors[ROTATION_VECT].enabled) {
@@ -458,6 +529,11 @@ int HubSensors::setDelay(int32_t handle, int64_t ns)
 
     ALOGI("Sensorhub hal setDelay: %d - %d", handle, delay);
 
+#ifdef _ENABLE_HUB_FUSION
+    std::lock_guard<std::mutex> guard(mFusionLock);
+#endif
+    resolveFusionPlacement();
+
     // Clamp delay to min/max
     for (i = 0; i < sSensorList.size(); i++) {
         if ((SENSORS_HANDLE_BASE + handle) == sSensorList[i].handle) {
@@ -481,6 +557,10 @@ int HubSensors::setDelay(int32_t handle, int64_t ns)
             break;
         case ID_GAME_RV:
             mFusionSensors[GAME_RV].delay = delay;
+#ifdef _ENABLE_HUB_FUSION
+            if (isHubFused(GAME_RV))
+                err = ioctl(dev_fd, STML0XX_IOCTL_SET_GAME_RV_DELAY, &delay);
+#endif
             break;
         case ID_LA:
             mFusionSensors[LINEAR_ACCEL].delay = delay;
@@ -524,9 +604,17 @@ int HubSensors::setDelay(int32_t handle, int64_t ns)
             break;
         case ID_GEOMAG_RV:
             mFusionSensors[GEOMAG_RV].delay = delay;
+#ifdef _ENABLE_HUB_FUSION
+            if (isHubFused(GEOMAG_RV))
+                err = ioctl(dev_fd, STML0XX_IOCTL_SET_QUAT_6AXIS_DELAY, &delay);
+#endif
             break;
         case ID_RV:
             mFusionSensors[ROTATION_VECT].delay = delay;
+#ifdef _ENABLE_HUB_FUSION
+            if (isHubFused(ROTATION_VECT))
+                err = ioctl(dev_fd, STML0XX_IOCTL_SET_QUAT_9AXIS_DELAY, &delay);
+#endif
             break;
 #endif
 #ifdef _ENABLE_PEDO
@@ -613,6 +701,10 @@ int HubSensors::readEvents(sensors_event_t* d, int dLen)
     }
 
     while (data < dataEnd && ((ret = read(data_fd, &buff, sizeof(struct stml0xx_android_sensor_data))) != 0)) {
+#ifdef _ENABLE_HUB_FUSION
+        if (mRecord && ret == sizeof(buff))
+            fwrite(&buff, sizeof(buff), 1, mRecord);
+#endif
         /* Sensorhub reset occurred, upload a bug2go if its been at least 10mins since previous bug2go*/
         /* remove this if-clause when corruption issue resolved */
         switch (buff.type) {
@@ -631,6 +723,16 @@ int HubSensors::readEvents(sensors_event_t* d, int dLen)
                 mFusionData.accel.y = STM16TOH(buff.data+ACCEL_Y) * CONVERT_A_Y;
                 mFusionData.accel.z = STM16TOH(buff.data+ACCEL_Z) * CONVERT_A_Z;
                 mFusionData.accel.timestamp = buff.timestamp;
+#ifdef _ENABLE_AKM_INPROC
+                if (mCompassRunning) {
+                    const int16_t acc[3] = {
+                        STM16TOH(buff.data + ACCEL_X),
+                        STM16TOH(buff.data + ACCEL_Y),
+                        STM16TOH(buff.data + ACCEL_Z)
+                    };
+                    ACCHAL_SetAccData(acc, buff.timestamp);
+                }
+#endif
                 if (mFusionSensors[ACCEL].enabled) {
                     data->version = SENSORS_EVENT_T_SIZE;
                     data->sensor = SENSORS_HANDLE_BASE + ID_A;
@@ -643,9 +745,9 @@ int HubSensors::readEvents(sensors_event_t* d, int dLen)
                     data++;
                 }
 #ifdef _ENABLE_MAGNETOMETER
-                if (mFusionSensors[GEOMAG_RV].enabled || mFusionSensors[ROTATION_VECT].enabled) {
+                if (isApFused(GEOMAG_RV) || isApFused(ROTATION_VECT)) {
                     mGeomagRVReady = mGeomagRV->processFusion(mFusionData, false);
-                    if (mFusionSensors[GEOMAG_RV].enabled) {
+                    if (isApFused(GEOMAG_RV)) {
                         data->version = SENSORS_EVENT_T_SIZE;
                         data->sensor = SENSORS_HANDLE_BASE + ID_GEOMAG_RV;
                         data->type = SENSOR_TYPE_GEOMAGNETIC_ROTATION_VECTOR;
@@ -665,9 +767,8 @@ int HubSensors::readEvents(sensors_event_t* d, int dLen)
                 data->version = SENSORS_EVENT_T_SIZE;
                 data->sensor = SENSORS_HANDLE_BASE + ID_A2;
                 data->type = SENSOR_TYPE_ACCELEROMETER;
-                data->acceleration.x = STM16TOH(buff.data+ACCEL_X) * CONVERT_A_X;
-                data->acceleration.y = STM16TOH(buff.data+ACCEL_Y) * CONVERT_A_Y;
-                data->acceleration.z = STM16TOH(buff.data+ACCEL_Z) * CONVERT_A_Z;
+                Endian::be16x3ToFloat(buff.data + ACCEL_X, 1, sAccelScale,
+                        data->acceleration.v);
                 data->acceleration.status = SENSOR_STATUS_ACCURACY_HIGH;
                 data->timestamp = buff.timestamp;
                 data++;
@@ -690,10 +791,10 @@ int HubSensors::readEvents(sensors_event_t* d, int dLen)
                     data->timestamp = mFusionData.gyro.timestamp;
                     data++;
                 }
-                if (mFusionSensors[GAME_RV].enabled || mFusionSensors[LINEAR_ACCEL].enabled
+                if (isApFused(GAME_RV) || mFusionSensors[LINEAR_ACCEL].enabled
                         || mFusionSensors[GRAVITY].enabled) {
                     mGameRV->processFusion(mFusionData, false);
-                    if (mFusionSensors[GAME_RV].enabled) {
+                    if (isApFused(GAME_RV)) {
                         data->version = SENSORS_EVENT_T_SIZE;
                         data->sensor = SENSORS_HANDLE_BASE + ID_GAME_RV;
                         data->type = SENSOR_TYPE_GAME_ROTATION_VECTOR;
@@ -733,7 +834,7 @@ int HubSensors::readEvents(sensors_event_t* d, int dLen)
                     }
                 }
 #ifdef _ENABLE_MAGNETOMETER
-                if (mFusionSensors[ROTATION_VECT].enabled) {
+                if (isApFused(ROTATION_VECT)) {
                     mRotationVect->processFusion(mFusionData, !mGeomagRVReady);
 
                     data->version = SENSORS_EVENT_T_SIZE;
@@ -753,16 +854,41 @@ int HubSensors::readEvents(sensors_event_t* d, int dLen)
                 data->version = SENSORS_EVENT_T_SIZE;
                 data->sensor =  SENSORS_HANDLE_BASE + ID_UNCALIB_GYRO;
                 data->type = SENSOR_TYPE_GYROSCOPE_UNCALIBRATED;
-                data->uncalibrated_gyro.x_uncalib = STM16TOH(buff.data + UNCALIB_GYRO_X) * CONVERT_G_P;
-                data->uncalibrated_gyro.y_uncalib = STM16TOH(buff.data + UNCALIB_GYRO_Y) * CONVERT_G_R;
-                data->uncalibrated_gyro.z_uncalib = STM16TOH(buff.data + UNCALIB_GYRO_Z) * CONVERT_G_Y;
-                data->uncalibrated_gyro.x_bias = STM16TOH(buff.data + UNCALIB_GYRO_X_BIAS) * CONVERT_BIAS_G_P;
-                data->uncalibrated_gyro.y_bias = STM16TOH(buff.data + UNCALIB_GYRO_Y_BIAS) * CONVERT_BIAS_G_R;
-                data->uncalibrated_gyro.z_bias = STM16TOH(buff.data + UNCALIB_GYRO_Z_BIAS) * CONVERT_BIAS_G_Y;
+                Endian::be16x3ToFloat(buff.data + UNCALIB_GYRO_X, 1, sGyroScale,
+                        data->uncalibrated_gyro.uncalib);
+                Endian::be16x3ToFloat(buff.data + UNCALIB_GYRO_X_BIAS, 1, sGyroBiasScale,
+                        data->uncalibrated_gyro.bias);
                 data->timestamp = buff.timestamp;
                 data++;
                 break;
 #endif
+#ifdef _ENABLE_HUB_FUSION
+#ifdef _ENABLE_GYROSCOPE
+            case DT_GAME_RV:
+                if (!mFusionSensors[GAME_RV].enabled)
+                    break;
+                hubQuatToEvent(data, ID_GAME_RV, SENSOR_TYPE_GAME_ROTATION_VECTOR,
+                        buff.data, buff.timestamp, HUB_QUAT_GAME_ACCURACY);
+                data++;
+                break;
+#endif
+#ifdef _ENABLE_MAGNETOMETER
+            case DT_QUAT_6AXIS:
+                if (!mFusionSensors[GEOMAG_RV].enabled)
+                    break;
+                hubQuatToEvent(data, ID_GEOMAG_RV, SENSOR_TYPE_GEOMAGNETIC_ROTATION_VECTOR,
+                        buff.data, buff.timestamp, HUB_QUAT_HEADING_ACCURACY);
+                data++;
+                break;
+            case DT_QUAT_9AXIS:
+                if (!mFusionSensors[ROTATION_VECT].enabled)
+                    break;
+                hubQuatToEvent(data, ID_RV, SENSOR_TYPE_ROTATION_VECTOR,
+                        buff.data, buff.timestamp, HUB_QUAT_HEADING_ACCURACY);
+                data++;
+                break;
+#endif
+#endif // _ENABLE_HUB_FUSION
             case DT_ALS:
                 data->version = SENSORS_EVENT_T_SIZE;
                 data->sensor = SENSORS_HANDLE_BASE + ID_L;
@@ -994,12 +1120,10 @@ int HubSensors::readEvents(sensors_event_t* d, int dLen)
                 data->version = SENSORS_EVENT_T_SIZE;
                 data->sensor =  SENSORS_HANDLE_BASE + ID_UM;
                 data->type = SENSOR_TYPE_MAGNETIC_FIELD_UNCALIBRATED;
-                data->uncalibrated_magnetic.x_uncalib = STM16TOH(buff.data + UNCALIB_MAGNETIC_X) * CONVERT_M_X;
-                data->uncalibrated_magnetic.y_uncalib = STM16TOH(buff.data + UNCALIB_MAGNETIC_Y) * CONVERT_M_Y;
-                data->uncalibrated_magnetic.z_uncalib = STM16TOH(buff.data + UNCALIB_MAGNETIC_Z) * CONVERT_M_Z;
-                data->uncalibrated_magnetic.x_bias = STM16TOH(buff.data + UNCALIB_MAGNETIC_X_BIAS) * CONVERT_BIAS_M_X;
-                data->uncalibrated_magnetic.y_bias = STM16TOH(buff.data + UNCALIB_MAGNETIC_Y_BIAS) * CONVERT_BIAS_M_Y;
-                data->uncalibrated_magnetic.z_bias = STM16TOH(buff.data + UNCALIB_MAGNETIC_Z_BIAS) * CONVERT_BIAS_M_Z;
+                Endian::be16x3ToFloat(buff.data + UNCALIB_MAGNETIC_X, 1, sMagScale,
+                        data->uncalibrated_magnetic.uncalib);
+                Endian::be16x3ToFloat(buff.data + UNCALIB_MAGNETIC_X_BIAS, 1, sMagBiasScale,
+                        data->uncalibrated_magnetic.bias);
                 data->timestamp = buff.timestamp;
                 data++;
                 break;
@@ -1039,6 +1163,13 @@ int HubSensors::readEvents(sensors_event_t* d, int dLen)
                 break;
         }
     }
+#ifdef _ENABLE_AKM_INPROC
+    data += readCompassEvents(data, dataEnd);
+#endif
+#ifdef _ENABLE_HUB_FUSION
+    if (mRecord)
+        fflush(mRecord);
+#endif
     if (mPendingBug2go == 1) {
         time(&timeutc.tv_sec);
         if (timeutc.tv_sec - sent_bug2go_sec > 24*60*60) {
@@ -1175,6 +1306,11 @@ int HubSensors::updateMagRate()
         ALOGI("HubSensors::updateMagRate %d", delay);
         prev_delay = delay;
     }
+#ifdef _ENABLE_AKM_INPROC
+    // The compass doesn't poll its delays, and the orientation delay may
+    // have changed even if the mag rate didn't
+    Hosted_DelayChanged();
+#endif
     return err;
 }
 
@@ -1190,6 +1326,106 @@ bool HubSensors::isMagNeeded()
 }
 #endif
 
+#ifdef _ENABLE_AKM_INPROC
+void HubSensors::updateCompass()
+{
+    int rbuf[AKM_YPR_RECORD_SIZE];
+    bool needed = isMagNeeded();
+
+    if (needed == mCompassRunning)
+        return;
+
+    if (needed) {
+        // Doesn't wait for the device, it is opened on the compass thread
+        if (Hosted_Start(compassResult, this) == AKD_SUCCESS) {
+            mCompassRunning = true;
+            ALOGI("In-process compass started");
+        } else {
+            ALOGE("Could not start the in-process compass");
+        }
+    } else {
+        Hosted_Stop();
+        mCompassRunning = false;
+        // Results of the stopped session are stale
+        while (read(mCompassPipe[0], rbuf, sizeof(rbuf)) > 0)
+            ;
+        ALOGI("In-process compass stopped");
+    }
+}
+
+void HubSensors::compassResult(const int *rbuf, void *ctx)
+{
+    HubSensors *self = static_cast<HubSensors *>(ctx);
+
+    // Records are smaller than PIPE_BUF, so they are never split. If the
+    // poll thread falls behind, new records are dropped like in the driver.
+    if (write(self->mCompassPipe[1], rbuf, AKM_YPR_RECORD_SIZE * sizeof(int)) < 0 &&
+            errno != EAGAIN)
+        ALOGE("Can't queue compass result (%s)", strerror(errno));
+}
+
+int HubSensors::readCompassEvents(sensors_event_t* d, sensors_event_t const* dataEnd)
+{
+    int rbuf[AKM_YPR_RECORD_SIZE];
+    sensors_event_t* data = d;
+    int64_t timestamp;
+    int i;
+
+    // Up to 3 events per record, readEvents() keeps that much room
+    while (data < dataEnd &&
+            read(mCompassPipe[0], rbuf, sizeof(rbuf)) == sizeof(rbuf)) {
+        memcpy(&timestamp, &rbuf[AKM_YPR_DATA_SIZE], sizeof(timestamp));
+
+        if (rbuf[AKM_REC_FLAG] & (1 << MAG_DATA_FLAG)) {
+            mFusionData.mag.x = rbuf[AKM_REC_MAG_X] * CONVERT_M_X;
+            mFusionData.mag.y = rbuf[AKM_REC_MAG_X + 1] * CONVERT_M_Y;
+            mFusionData.mag.z = rbuf[AKM_REC_MAG_X + 2] * CONVERT_M_Z;
+            mFusionData.mag.timestamp = timestamp;
+            if (mFusionSensors[MAG].enabled) {
+                data->version = SENSORS_EVENT_T_SIZE;
+                data->sensor = SENSORS_HANDLE_BASE + ID_M;
+                data->type = SENSOR_TYPE_MAGNETIC_FIELD;
+                data->magnetic.x = mFusionData.mag.x;
+                data->magnetic.y = mFusionData.mag.y;
+                data->magnetic.z = mFusionData.mag.z;
+                data->magnetic.status = rbuf[AKM_REC_MAG_STATUS];
+                data->timestamp = timestamp;
+                data++;
+            }
+            if (mFusionSensors[UNCALIB_MAG].enabled) {
+                data->version = SENSORS_EVENT_T_SIZE;
+                data->sensor = SENSORS_HANDLE_BASE + ID_UM;
+                data->type = SENSOR_TYPE_MAGNETIC_FIELD_UNCALIBRATED;
+                for (i = 0; i < 3; i++) {
+                    data->uncalibrated_magnetic.uncalib[i] =
+                        rbuf[AKM_REC_RAW_MAG_X + i] * sMagScale[i];
+                    data->uncalibrated_magnetic.bias[i] =
+                        (rbuf[AKM_REC_RAW_MAG_X + i] - rbuf[AKM_REC_MAG_X + i]) *
+                        sMagBiasScale[i];
+                }
+                data->timestamp = timestamp;
+                data++;
+            }
+        }
+
+        if ((rbuf[AKM_REC_FLAG] & (1 << FUSION_DATA_FLAG)) &&
+                mFusionSensors[ORIENTATION].enabled) {
+            data->version = SENSORS_EVENT_T_SIZE;
+            data->sensor = SENSORS_HANDLE_BASE + ID_OR;
+            data->type = SENSOR_TYPE_ORIENTATION;
+            data->orientation.azimuth = rbuf[AKM_REC_ORIENT_YAW] * CONVERT_O_Y;
+            data->orientation.pitch = rbuf[AKM_REC_ORIENT_YAW + 1] * CONVERT_O_P;
+            data->orientation.roll = rbuf[AKM_REC_ORIENT_YAW + 2] * CONVERT_O_R;
+            data->orientation.status = rbuf[AKM_REC_MAG_STATUS];
+            data->timestamp = timestamp;
+            data++;
+        }
+    }
+
+    return data - d;
+}
+#endif
+
 int HubSensors::updateAccelRate()
 {
     static unsigned short prev_delay;
@@ -1229,17 +1465,135 @@ bool HubSensors::isAccelNeeded()
 
 bool HubSensors::isRotationVectorRunning()
 {
+    // Only fusion running on the AP needs the raw sensors at fusion rate
     bool rvRunning = (
         false
 #ifdef _ENABLE_MAGNETOMETER
-        || mFusionSensors[GEOMAG_RV].enabled
-        || mFusionSensors[ROTATION_VECT].enabled
+        || isApFused(GEOMAG_RV)
+        || isApFused(ROTATION_VECT)
 #endif
 #ifdef _ENABLE_GYROSCOPE
-        || mFusionSensors[GAME_RV].enabled
-        || mFusionSensors[LINEAR_ACCEL].enabled
-        || mFusionSensors[GRAVITY].enabled
+        || isApFused(GAME_RV)
+        || isApFused(LINEAR_ACCEL)
+        || isApFused(GRAVITY)
 #endif
     );
     return rvRunning;
 }
+
+void HubSensors::startFusionProbe()
+{
+#ifdef _ENABLE_HUB_FUSION
+    char prop[PROPERTY_VALUE_MAX];
+
+    property_get(HUB_RECORD_PROP, prop, "0");
+    if (!strcmp(prop, "1")) {
+        mRecord = fopen(HUB_RECORD_FILE, "w");
+        ALOGE_IF(!mRecord, "Can't record to %s (%s)", HUB_RECORD_FILE,
+                strerror(errno));
+    }
+
+    property_get(HUB_FUSION_PROP, prop, "auto");
+    if (!strcmp(prop, "ap")) {
+        ALOGI("Fusion forced on the AP by %s", HUB_FUSION_PROP);
+        return;
+    }
+
+    // The HAL is constructed while the library loads. The queue's worker
+    // opens the hub and reads the version string in the background. The
+    // queue is destroyed on this thread too: that joins the worker, which
+    // may be stuck in the driver long after the deadline.
+    mot::SensorHubQueue::Clock::time_point deadline =
+            mot::SensorHubQueue::Clock::now()
+            + std::chrono::milliseconds(HUB_FUSION_PROBE_TIMEOUT_MS);
+    std::thread([this, deadline]() {
+        mot::SensorHubQueue probe;
+        probe.getVersionStr(deadline,
+                [this, deadline](const mot::SensorHubQueue::Result &res) {
+                    fusionProbeDone(res, deadline);
+                }).result.wait();
+    }).detach();
+#endif
+}
+
+#ifdef _ENABLE_HUB_FUSION
+void HubSensors::fusionProbeDone(const mot::SensorHubQueue::Result &res,
+        mot::SensorHubQueue::Clock::time_point deadline)
+{
+    std::string version(res.data.begin(), res.data.end());
+
+    if (res.status != mot::SensorHubQueue::Status::OK) {
+        ALOGE("Can't read the hub firmware version, fusing on the AP");
+        return;
+    }
+    if (mot::SensorHubQueue::Clock::now() > deadline) {
+        ALOGE("Hub firmware version read too late, fusing on the AP");
+        return;
+    }
+    if (version.find(HUB_FUSION_CAP_TAG) == std::string::npos) {
+        ALOGI("Hub fusion not supported by firmware '%s', fusing on the AP",
+                version.c_str());
+        return;
+    }
+
+    ALOGI("Hub fusion supported by firmware %s", version.c_str());
+    std::lock_guard<std::mutex> guard(mFusionLock);
+    mHubFusionOffered = true;
+    resolveFusionPlacement();
+}
+#endif
+
+void HubSensors::resolveFusionPlacement()
+{
+#ifdef _ENABLE_HUB_FUSION
+    int i;
+
+    if (mHubFusion || !mHubFusionOffered)
+        return;
+
+    // A rotation vector already running on the AP keeps its raw data until
+    // it is disabled.
+    for (i = 0; i < NUM_FUSION_DEVICES; i++) {
+        if (mFusionSensors[i].enabled && canHubFuse(i))
+            return;
+    }
+
+    ALOGI("Rotation vectors fused on the hub");
+    mHubFusion = true;
+    // The hub streams these already fused, so they don't need any raw data
+    // on the AP.
+    for (i = 0; i < NUM_FUSION_DEVICES; i++) {
+        if (canHubFuse(i)) {
+            mFusionSensors[i].usesAccel = false;
+            mFusionSensors[i].usesGyro = false;
+            mFusionSensors[i].usesMag = false;
+        }
+    }
+#endif
+}
+
+bool HubSensors::canHubFuse(int sensorIdx)
+{
+    switch (sensorIdx) {
+#ifdef _ENABLE_GYROSCOPE
+        case GAME_RV:
+#endif
+#ifdef _ENABLE_MAGNETOMETER
+        case GEOMAG_RV:
+        case ROTATION_VECT:
+#endif
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool HubSensors::isHubFused(int sensorIdx)
+{
+    return mHubFusion && canHubFuse(sensorIdx);
+}
+
+bool HubSensors::isApFused(int sensorIdx)
+{
+    return mFusionSensors[sensorIdx].enabled && !isHubFused(sensorIdx);
+}
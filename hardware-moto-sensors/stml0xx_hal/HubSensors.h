@@ -23,6 +23,7 @@
 
 #include <stdint.h>
 #include <errno.h>
+#include <atomic>
 #include <endian.h>
 #include <sys/cdefs.h>
 #include <sys/types.h>
@@ -35,6 +36,7 @@
 #include "FusionSensorBase.h"
 #include "GameRotationVector.h"
 #include "LinearAccelGravity.h"
+#include "Endian.hpp"
 #include "SensorBase.h"
 #include "SensorList.h"
 #include "Sensors.h"
@@ -60,6 +62,34 @@
 #define GYRO_CAL_FILE  "/data/misc/sensorhub/gyro_cal.bin"
 #define ACCEL_CAL_FILE "/data/misc/sensorhub/accel_cal.bin"
 
+/*
+ * Hub-side fusion (MOT_SENSOR_HUB_FEATURE_HUB_FUSION). Firmware that runs the
+ * quaternion filters on the hub advertises it with HUB_FUSION_CAP_TAG in its
+ * version string and then streams DT_GAME_RV/DT_QUAT_6AXIS/DT_QUAT_9AXIS
+ * records, like motosh does. The kernel must export the records, their enable
+ * bits and their rate ioctls.
+ */
+#ifdef _ENABLE_HUB_FUSION
+#if !defined(DT_GAME_RV) || !defined(DT_QUAT_6AXIS) || !defined(DT_QUAT_9AXIS) || \
+    !defined(M_GAME_RV) || !defined(M_QUAT_6AXIS) || !defined(M_QUAT_9AXIS) || \
+    !defined(STML0XX_IOCTL_SET_GAME_RV_DELAY) || \
+    !defined(STML0XX_IOCTL_SET_QUAT_6AXIS_DELAY) || \
+    !defined(STML0XX_IOCTL_SET_QUAT_9AXIS_DELAY)
+#error "MOT_SENSOR_HUB_FEATURE_HUB_FUSION needs the quaternion records in linux/stml0xx.h"
+#endif
+#include "SensorHubQueue.hpp"
+#endif
+
+#define HUB_FUSION_CAP_TAG          "+quat"
+/* Set to "ap" to keep fusion on the AP even if the hub can do it. */
+#define HUB_FUSION_PROP             "persist.mot.sensors.fusion"
+/* Longest wait for the firmware version before falling back to AP fusion */
+#define HUB_FUSION_PROBE_TIMEOUT_MS 2000
+/* Set to "1" to copy every hub record to HUB_RECORD_FILE for
+ * stml0xx_fusion_bench. Read when the HAL starts. */
+#define HUB_RECORD_PROP             "debug.mot.sensors.record"
+#define HUB_RECORD_FILE             "/data/misc/sensorhub/hub_records.bin"
+
 // Defines for offsets into the sensorhub event data.
 #define ACCEL_X (0 * sizeof(int16_t))
 #define ACCEL_Y (1 * sizeof(int16_t))
@@ -96,9 +126,58 @@
 #define ORIENTATION_AZIMUTH (0 * sizeof(int16_t))
 #define ORIENTATION_PITCH   (1 * sizeof(int16_t))
 #define ORIENTATION_ROLL    (2 * sizeof(int16_t))
+#define QUAT_A (0 * sizeof(int16_t))
+#define QUAT_B (1 * sizeof(int16_t))
+#define QUAT_C (2 * sizeof(int16_t))
+#define QUAT_W (3 * sizeof(int16_t))
+
+#ifdef _ENABLE_AKM_INPROC
+// Fields of the in-process compass records, see Disp_MeasurementRecord().
+// They are in the units the daemon sends to the driver.
+#define AKM_REC_FLAG        0
+#define AKM_REC_MAG_X       5
+#define AKM_REC_MAG_STATUS  8
+#define AKM_REC_ORIENT_YAW  9
+#define AKM_REC_RAW_MAG_X   16
+#endif
+
+/* hub quaternion records are signed Q15 */
+#define CONVERT_HUB_QUAT (1.0f/32767.f)
 
-#define STM16TOH(p) (int16_t) be16toh(*((uint16_t *) (p)))
-#define STM32TOH(p) (int32_t) be32toh(*((uint32_t *) (p)))
+/*
+ * Hub quaternion records carry no accuracy estimate. RV and Geomag RV report
+ * their heading accuracy as unavailable, which sensors.h defines as -1. Game RV
+ * has no heading and reports 0, like GameRotationVector.
+ */
+#define HUB_QUAT_HEADING_ACCURACY   (-1.f)
+#define HUB_QUAT_GAME_ACCURACY      (0.f)
+
+#define STM16TOH(p) Endian::extract<int16_t>((const uint8_t *)(p))
+#define STM32TOH(p) Endian::extract<int32_t>((const uint8_t *)(p))
+
+/*!
+ * \brief Fills a rotation vector event from a hub quaternion record
+ *
+ * \param[out] data     the event
+ * \param[in]  handle   the sensor ID (ID_GAME_RV, ID_GEOMAG_RV or ID_RV)
+ * \param[in]  type     the matching SENSOR_TYPE_*
+ * \param[in]  rec      the big-endian record payload from the hub
+ * \param[in]  ts       the record timestamp in ns
+ * \param[in]  accuracy the heading accuracy to report
+ */
+static inline void hubQuatToEvent(sensors_event_t *data, int32_t handle,
+        int32_t type, const uint8_t *rec, int64_t ts, float accuracy)
+{
+    data->version = SENSORS_EVENT_T_SIZE;
+    data->sensor = SENSORS_HANDLE_BASE + handle;
+    data->type = type;
+    data->data[0] = STM16TOH(rec + QUAT_A) * CONVERT_HUB_QUAT;
+    data->data[1] = STM16TOH(rec + QUAT_B) * CONVERT_HUB_QUAT;
+    data->data[2] = STM16TOH(rec + QUAT_C) * CONVERT_HUB_QUAT;
+    data->data[3] = STM16TOH(rec + QUAT_W) * CONVERT_HUB_QUAT;
+    data->data[4] = accuracy;
+    data->timestamp = ts;
+}
 
 struct input_event;
 
@@ -114,6 +193,10 @@ public:
     virtual int flush(int32_t handle) override;
 
     static HubSensors* getInstance();
+#ifdef _ENABLE_AKM_INPROC
+    //! \brief fd which becomes readable when the compass has results
+    int getCompassFd() const { return mCompassPipe[0]; }
+#endif
 
 private:
     enum fusion_enum
@@ -168,14 +251,65 @@ private:
     RotationVector *mRotationVect;
 #endif
 
+#ifdef _ENABLE_AKM_INPROC
+    //! \brief carries the compass results from its thread to readEvents()
+    int mCompassPipe[2];
+    bool mCompassRunning;
+#endif
+
     uint8_t mAccelCal[STML0XX_ACCEL_CAL_SIZE];
 
+    //! \brief true if the hub firmware fuses Game RV/Geomag RV/RV itself
+    std::atomic<bool> mHubFusion;
+#ifdef _ENABLE_HUB_FUSION
+    //! \brief serializes setEnable()/setDelay() with the probe result
+    std::mutex mFusionLock;
+    //! \brief the firmware version string advertised HUB_FUSION_CAP_TAG
+    bool mHubFusionOffered;
+    //! \brief HUB_RECORD_FILE, or NULL when not recording
+    FILE *mRecord;
+#endif
+
     uint8_t mErrorCnt[RESET_REASON_MAX_CODE + 1];
     gzFile open_dropbox_file(const char* timestamp, const char* dst, const int flags);
     short capture_dump(char* timestamp, const int id, const char* dst, const int flags);
     void logAlsEvent(int32_t lux, int64_t ts_ns);
     bool isRotationVectorRunning(void);
 
+    /*!
+     * \brief Starts reading the hub firmware version string
+     *
+     * The read runs on a libsensorhub queue owned by a detached thread, off
+     * the HAL start path and off every binder call. Nothing is started if
+     * HUB_FUSION_PROP forces AP fusion. Also opens HUB_RECORD_FILE if
+     * HUB_RECORD_PROP asks for it.
+     */
+    void startFusionProbe();
+#ifdef _ENABLE_HUB_FUSION
+    /*!
+     * \brief Completion callback of the version string read
+     *
+     * Looks for HUB_FUSION_CAP_TAG. A version string which arrives after
+     * \c deadline is ignored, the rotation vectors then stay on the AP.
+     */
+    void fusionProbeDone(const mot::SensorHubQueue::Result &res,
+            mot::SensorHubQueue::Clock::time_point deadline);
+#endif
+    /*!
+     * \brief Moves the rotation vectors to the hub once it offers fusion
+     *
+     * Never waits. Until the probe has completed, and while a rotation vector
+     * that could move is enabled, fusion stays where it is. Called with
+     * mFusionLock held.
+     */
+    void resolveFusionPlacement();
+    //! \brief true if the hub firmware can fuse this sensor, if it offers fusion
+    static bool canHubFuse(int sensorIdx);
+    //! \brief true if the fusion sensor is fed by hub quaternions
+    bool isHubFused(int sensorIdx);
+    //! \brief true if the fusion sensor is enabled and fused on the AP
+    bool isApFused(int sensorIdx);
+
 #ifdef _ENABLE_GYROSCOPE
     /*!
      * \brief Helper to update gyro rate
@@ -199,6 +333,19 @@ private:
      */
     int updateMagRate();
     bool isMagNeeded();
+#endif
+#ifdef _ENABLE_AKM_INPROC
+    /*!
+     * \brief Starts or stops the in-process compass
+     *
+     * The AKM measurement loop runs on its own thread in this process
+     * whenever the magnetometer is needed, instead of in akmd09912.
+     */
+    void updateCompass();
+    //! \brief queues a result record, called on the compass thread
+    static void compassResult(const int *rbuf, void *ctx);
+    //! \brief converts the queued compass records into events
+    int readCompassEvents(sensors_event_t* data, sensors_event_t const* dataEnd);
 #endif
     /*!
      * \brief Helper to update accel rate
@@ -71,6 +71,16 @@ SensorsPollContext::SensorsPollContext()
         ALOGE("out of memory: new failed for HubSensors");
     }
 
+#ifdef _ENABLE_AKM_INPROC
+    // The in-process compass results are turned into events by HubSensors
+    mSensors[ecompass] = mSensors[sensor_hub];
+    if (mSensors[ecompass]) {
+        mPollFds[ecompass].fd = HubSensors::getInstance()->getCompassFd();
+        mPollFds[ecompass].events = POLLIN;
+        mPollFds[ecompass].revents = 0;
+    }
+#endif
+
 #ifdef _ENABLE_REARPROX
     mSensors[rearprox] =new RearProxSensor(0);
     ALOGE("rearprox sensor_1 created");
@@ -66,6 +66,9 @@ private:
 #endif
 #ifdef _ENABLE_CAPSENSE
         capsense,
+#endif
+#ifdef _ENABLE_AKM_INPROC
+        ecompass,
 #endif
         numSensorDrivers,
         numFds,
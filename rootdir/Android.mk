@@ -67,6 +67,16 @@ LOCAL_SRC_FILES    := etc/init.mmi.usb.rc
 LOCAL_MODULE_PATH  := $(TARGET_OUT_VENDOR_ETC)/init/hw
 include $(BUILD_PREBUILT)
 
+# Required by the sensor HAL when it doesn't run the compass itself. It goes
+# to /vendor/etc/init, which init reads without an import.
+include $(CLEAR_VARS)
+LOCAL_MODULE       := init.ecompass.rc
+LOCAL_MODULE_TAGS  := optional
+LOCAL_MODULE_CLASS := ETC
+LOCAL_SRC_FILES    := etc/init.ecompass.rc
+LOCAL_MODULE_PATH  := $(TARGET_OUT_VENDOR_ETC)/init
+include $(BUILD_PREBUILT)
+
 include $(CLEAR_VARS)
 LOCAL_MODULE       := init.qcom.rc
 LOCAL_MODULE_TAGS  := optional